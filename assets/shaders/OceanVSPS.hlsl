@@ -4,6 +4,8 @@
 
 TextureCube	textureSkyReflection : register(t0);
 SamplerState samplerSkyReflection : register(s0);
+Texture2DArray heightmapAtlas : register(t1); // Slice 0 is the displacement and slice 1 the normal
+SamplerState samplerHeightmap : register(s1);
 
 cbuffer VSConstants : register(cb0)
 {
@@ -13,10 +15,85 @@ cbuffer VSConstants : register(cb0)
   float3 camView : packoffset(c9);
 };
 
+// What a packed displacement of 1 is, per axis
+cbuffer StreamConstants : register(cb1)
+{
+  float4 dispScale : packoffset(c0);
+};
+
+// The immutable base grid position and the per-frame displacement and normal (whose y is implied)
 struct VS_INPUT
 {
-  float4 position : POSITION;
-  float3 normal : NORMAL;
+  float2 gridPosition : POSITION;
+  float3 displacement : DISPLACEMENT;
+  float2 normalXZ : NORMAL;
+};
+
+// Half precision per-frame stream, with the normal's x packed after the displacement
+struct VS_INPUT_HALF
+{
+  float2 gridPosition : POSITION;
+  float4 displacementNormalX : DISPLACEMENT;
+  float2 normalZ : NORMAL;
+};
+
+// Packed stream, with the displacement as fractions of dispScale and the normal octahedral encoded to 16 bits...
+struct VS_INPUT_PACKED16
+{
+  float2 gridPosition : POSITION;
+  float4 displacementNormalU : DISPLACEMENT;
+  float2 normalV : NORMAL;
+};
+
+// ...or to 8 bits
+struct VS_INPUT_PACKED8
+{
+  float2 gridPosition : POSITION;
+  float2 displacementXY : DISPLACEMENT0;
+  float displacementZ : DISPLACEMENT1;
+  float2 normalUV : NORMAL;
+};
+
+// How positions map onto the periodic heightmap textures
+cbuffer HeightmapConstants : register(cb2)
+{
+  float4 heightmapParams : packoffset(c0); // 1 / the period in x and z, and half a texel to sample at the texel centres
+};
+
+// Where each level of the clipmap is
+cbuffer ClipmapConstants : register(cb3)
+{
+  float4 clipmapLevels[16] : packoffset(c0); // Origin (x, z), spacing and mip level
+  float4 clipmapParams : packoffset(c16); // Quads along a level's side
+};
+
+// Where each level of the CDLOD quadtree morphs to the next
+cbuffer CdlodConstants : register(cb4)
+{
+  float4 cdlodMorph[12] : packoffset(c0); // Distance the morph starts at, 1 / its length, vertex spacing and mip level
+  float4 cdlodCamera : packoffset(c12); // In the ocean's space
+  float4 cdlodParams : packoffset(c13); // Quads along the patch's side
+};
+
+// A vertex of a clipmap piece, placed by its instance's offset (in quads) within its level
+struct VS_INPUT_CLIPMAP
+{
+  float2 gridPosition : POSITION;
+  float3 instance : INSTANCE;
+};
+
+// A vertex of the CDLOD patch, drawn for a node at (x, z) of the given size and level
+struct VS_INPUT_CDLOD
+{
+  float2 gridPosition : POSITION;
+  float4 node : INSTANCE;
+};
+
+// A vertex of the tile patch, relative to the tile's centre, and where the tile is
+struct VS_INPUT_TILE
+{
+  float2 gridPosition : POSITION;
+  float2 offset : INSTANCE;
 };
 
 struct PS_INPUT
@@ -35,13 +112,124 @@ PS_INPUT OceanVS(VS_INPUT input)
 {
   PS_INPUT output;
 
-  output.position = mul(input.position, worldViewProjection);
-  output.normal = mul(input.normal, world);
-  output.wsPos = mul(input.position, world);
+  float4 position = float4(input.gridPosition.x, 0.0f, input.gridPosition.y, 1.0f) + float4(input.displacement, 0.0f);
+  float3 normal = float3(input.normalXZ.x, sqrt(saturate(1.0f - dot(input.normalXZ, input.normalXZ))), input.normalXZ.y);
+
+  output.position = mul(position, worldViewProjection);
+  output.normal = mul(normal, world);
+  output.wsPos = mul(position, world);
 
   return output;
 }
 
+PS_INPUT OceanHalfVS(VS_INPUT_HALF input)
+{
+  VS_INPUT unpacked;
+
+  unpacked.gridPosition = input.gridPosition;
+  unpacked.displacement = input.displacementNormalX.xyz;
+  unpacked.normalXZ = float2(input.displacementNormalX.w, input.normalZ.x);
+
+  return OceanVS(unpacked);
+}
+
+// Undo the 45 degree rotation of the upper half of the octahedron, then project it back onto the sphere
+float2 DecodeNormalXZ(float2 e)
+{
+  float2 p = 0.5f * float2(e.x + e.y, e.x - e.y);
+  return normalize(float3(p.x, 1.0f - abs(p.x) - abs(p.y), p.y)).xz;
+}
+
+PS_INPUT OceanPacked16VS(VS_INPUT_PACKED16 input)
+{
+  VS_INPUT unpacked;
+
+  unpacked.gridPosition = input.gridPosition;
+  unpacked.displacement = input.displacementNormalU.xyz * dispScale.xyz;
+  unpacked.normalXZ = DecodeNormalXZ(float2(input.displacementNormalU.w, input.normalV.x));
+
+  return OceanVS(unpacked);
+}
+
+PS_INPUT OceanPacked8VS(VS_INPUT_PACKED8 input)
+{
+  VS_INPUT unpacked;
+
+  unpacked.gridPosition = input.gridPosition;
+  unpacked.displacement = float3(input.displacementXY, input.displacementZ) * dispScale.xyz;
+  unpacked.normalXZ = DecodeNormalXZ(input.normalUV);
+
+  return OceanVS(unpacked);
+}
+
+void SampleHeightmap(float2 xz, float mip, out float3 displacement, out float2 normalXZ)
+{
+  float2 uv = xz * heightmapParams.xy + heightmapParams.zw;
+  displacement = heightmapAtlas.SampleLevel(samplerHeightmap, float3(uv, 0.0f), mip).xyz;
+  normalXZ = heightmapAtlas.SampleLevel(samplerHeightmap, float3(uv, 1.0f), mip).xy;
+}
+
+PS_INPUT OceanClipmapVS(VS_INPUT_CLIPMAP input)
+{
+  float4 level = clipmapLevels[(int)input.instance.z];
+  float2 grid = input.gridPosition + input.instance.xy;
+  float2 xz = level.xy + grid * level.z;
+
+  VS_INPUT unpacked;
+  unpacked.gridPosition = xz;
+  SampleHeightmap(xz, level.w, unpacked.displacement, unpacked.normalXZ);
+
+  // The outer edge meets the next coarser level, whose every other vertex is missing here. Take the
+  // coarser mip there, and halfway between its vertices the average of theirs, so the edges line up.
+  float2 edge = (grid == 0.0f || grid == clipmapParams.x);
+  if (any(edge))
+  {
+    float2 along = (1.0f - edge) * level.z;
+    float3 displacement0, displacement1;
+    float2 normal0, normal1;
+    SampleHeightmap(xz, level.w + 1.0f, displacement0, normal0);
+    if (fmod(dot(grid, 1.0f - edge), 2.0f) != 0.0f)
+    {
+      SampleHeightmap(xz - along, level.w + 1.0f, displacement0, normal0);
+      SampleHeightmap(xz + along, level.w + 1.0f, displacement1, normal1);
+      displacement0 = 0.5f * (displacement0 + displacement1);
+      normal0 = 0.5f * (normal0 + normal1);
+    }
+    unpacked.displacement = displacement0;
+    unpacked.normalXZ = normal0;
+  }
+
+  return OceanVS(unpacked);
+}
+
+PS_INPUT OceanCdlodVS(VS_INPUT_CDLOD input)
+{
+  float4 morph = cdlodMorph[(int)input.node.w];
+  float spacing = input.node.z / cdlodParams.x;
+
+  // Odd vertices slide onto their even neighbours as the node nears the end of its range, so that at its edge
+  // it has the vertices of the next coarser level, and the mip level blends to that level's too
+  float2 xz = input.node.xy + input.gridPosition * spacing;
+  float k = saturate((distance(cdlodCamera.xyz, float3(xz.x, 0.0f, xz.y)) - morph.x) * morph.y);
+  float2 grid = input.gridPosition - frac(input.gridPosition * 0.5f) * 2.0f * k;
+
+  VS_INPUT unpacked;
+  unpacked.gridPosition = input.node.xy + grid * spacing;
+  SampleHeightmap(unpacked.gridPosition, morph.w + k, unpacked.displacement, unpacked.normalXZ);
+
+  return OceanVS(unpacked);
+}
+
+// Tiles are whole periods apart, so the patch samples the same texels wherever it's drawn
+PS_INPUT OceanTileVS(VS_INPUT_TILE input)
+{
+  VS_INPUT unpacked;
+  unpacked.gridPosition = input.gridPosition + input.offset;
+  SampleHeightmap(input.gridPosition, 0.0f, unpacked.displacement, unpacked.normalXZ);
+
+  return OceanVS(unpacked);
+}
+
 float4 OceanSolidPS(PS_INPUT input) : SV_Target
 {
   float4 shallowWaterColour = float4(0.065f, 0.15f, 0.15f, 1.0f);
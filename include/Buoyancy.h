@@ -0,0 +1,100 @@
+/*!
+  @file Buoyancy.h @date 18/10/26 @brief The buoyancy of rigid bodies floating on the ocean.
+*/
+
+#pragma once
+
+#include <xnamath.h>
+
+#include "OceanKernels.h"
+#include "ThreadPool.h"
+#include "Vertices.h"
+
+namespace OceanWaves
+{
+  const int BUOYANCY_BATCH = 16; // Bodies per task
+  const float BUOYANCY_WATER_DENSITY = 1025.0f; // Sea water, in kg/m^3
+  const float BUOYANCY_GRAVITY = 9.81f;
+  const float BUOYANCY_TOLERANCE = 1e-3f; // How near the displaced surface's queries get to each sample, in metres
+
+  /*!
+    What the water does to a body this frame.
+  */
+  struct BuoyancyForce
+  {
+    XMFLOAT3 force, torque; // Newtons, and newton metres about the body's centre of mass
+    float volume; // Cubic metres under water
+    XMFLOAT3 centre; // Of buoyancy, the centroid of that volume
+  };
+
+  /*!
+    The buoyancy of bodies floating on the heightmap, each of whose hulls is a set of sample points
+    standing for cubes (held upright, however the body turns) that the water fills to the surface height
+    above them. The buoyancy acts up through the centroid of the volume under water, so turns the body
+    about its centre of mass as well.
+
+    Every body's samples are stored one after another, so a batch of bodies' samples are transformed
+    and submerged in runs as long as their hulls, and their surface heights queried in one run, a
+    vector at a time. The batches are spread over the thread pool, and nothing is allocated after Init.
+  */
+  class Buoyancy
+  {
+  public:
+    Buoyancy() : kernels_(NULL), threadPool_(NULL), heightmap_(NULL), maxBodies_(0), maxSamples_(0), numBodies_(0), numSamples_(0),
+      dimX_(0), dimY_(0), spacing_(0.0f), iterations_(0), firstSamples_(NULL), poses_(NULL), forces_(NULL), localX_(NULL),
+      localY_(NULL), localZ_(NULL), radii_(NULL), worldXZ_(NULL), worldY_(NULL), surface_(NULL)
+    {
+      ZeroMemory(&origin_, sizeof(origin_));
+    }
+    ~Buoyancy();
+
+    //! Room for maxBodies with maxSamples between them, floating on a heightmap of dimX x dimY vertices spacing apart,
+    //! vertex (0, 0) lying at origin, spread over threadPool or run on the calling thread if it's NULL
+    void Init(int maxBodies, int maxSamples, int dimX, int dimY, const XMFLOAT2& origin, float spacing, const OceanKernels* kernels,
+      ThreadPool* threadPool);
+
+    //! Add a body whose hull is count samples, each the position of a cube's centre relative to the body's centre of mass in
+    //! x, y and z and its half-size in w, returning its index
+    int AddBody(const XMFLOAT4* samples, int count);
+    //! Where the body's centre of mass is and how it's turned, as a unit quaternion
+    void SetPose(int body, const XMFLOAT3& position, const XMFLOAT4& orientation);
+
+    //! Float every body on the heightmap's vertices. With iterations, the surface is found above each sample as
+    //! QueryDisplacedHeights finds it, taking the choppiness into account; otherwise the heights are sampled where the
+    //! samples are.
+    void Update(const VertexDispNor* heightmap, int iterations);
+
+    int GetNumBodies() const { return numBodies_; }
+    int GetNumSamples() const { return numSamples_; }
+    const BuoyancyForce& GetForce(int body) const { return forces_[body]; }
+
+  private:
+    static void UpdateBatch(void* buoyancy, int batch);
+
+  private:
+    int maxBodies_, maxSamples_;
+    int numBodies_, numSamples_;
+    int dimX_, dimY_;
+    XMFLOAT2 origin_;
+    float spacing_;
+
+    const OceanKernels* kernels_;
+    ThreadPool* threadPool_;
+    const VertexDispNor* heightmap_; // Being floated on, and how
+    int iterations_;
+
+    // Per body, the first of its samples (and one past the last body's), its pose as a row-vector matrix and its force
+    int* firstSamples_;
+    XMFLOAT4X4* poses_;
+    BuoyancyForce* forces_;
+
+    // Per sample, its position relative to its body and half-size, then where it is and the surface height there this frame
+    float* localX_, * localY_, * localZ_, * radii_;
+    XMFLOAT2* worldXZ_;
+    float* worldY_, * surface_;
+  };
+
+  //! Time floating 1,000 and 10,000 bodies with the heights sampled and found on the displaced surface, on one thread and
+  //! across the pool, on every instruction set the CPU supports, and check the forces against a scalar sum, writing a CSV report
+  void WriteBuoyancyBenchmark(const char* fileName);
+}
@@ -0,0 +1,109 @@
+/*!
+  @file Cdlod.h @date 18/10/26 @brief Continuous distance-dependent level of detail for the ocean surface.
+*/
+
+#pragma once
+
+#include <d3d11.h>
+#include <xnamath.h>
+
+#include "Frustum.h"
+
+namespace OceanWaves
+{
+  const int CDLOD_MAX_LEVELS = 12;
+  const int CDLOD_PATCH_QUADS = 32; // Quads along a side of the patch every node is drawn with
+  const int CDLOD_MAX_NODES = 4096; // Selected per part of the patch per frame
+
+  /*!
+    What the most recent selection chose.
+  */
+  struct CdlodStats
+  {
+    int nodesVisited, nodesSelected, nodesDropped;
+  };
+
+  /*!
+    A quadtree over the ocean's plane whose nodes are chosen by their distance from the camera and drawn
+    as one instanced grid patch (after Strugar). Each level's nodes have twice the size, and so twice the
+    vertex spacing, of the level below. Over the far end of its range a node's odd vertices morph onto
+    its even ones, so it matches the coarser level at its edge and a node swapping levels doesn't pop.
+
+    The roots lie on a fixed lattice, so a node's place doesn't change as the camera moves. Selection
+    allocates nothing and needs no device, so it can be measured headless.
+  */
+  class Cdlod
+  {
+    // The ranges of the patch's indices a node can be drawn with: the whole, or a quadrant whose children weren't chosen
+    enum Part
+    {
+      PART_WHOLE = 0,
+      PART_QUADRANT_00,
+      PART_QUADRANT_10,
+      PART_QUADRANT_01,
+      PART_QUADRANT_11,
+      NUM_PARTS
+    };
+
+    struct Constants
+    {
+      XMFLOAT4 morph[CDLOD_MAX_LEVELS]; // Distance the morph starts at, 1 / its length, vertex spacing and mip level
+      XMFLOAT4 camera; // In the ocean's space
+      XMFLOAT4 params; // Quads along the patch's side
+    };
+
+  public:
+    Cdlod() : device_(NULL), immediateContext_(NULL), vertexShader_(NULL), vertexLayout_(NULL), vertexBuffer_(NULL),
+      indexBuffer_(NULL), instanceBuffer_(NULL), vsConstants_(NULL), frustum_(NULL), selected_(NULL), numLevels_(0), leafSize_(0.0f)
+    {
+      ZeroMemory(&stats_, sizeof(stats_));
+      ZeroMemory(numSelected_, sizeof(numSelected_));
+    }
+    ~Cdlod();
+
+    //! numLevels levels of nodes, the finest with their vertices spacing apart
+    void Init(int numLevels, float spacing);
+    //! Create the shaders and buffers to draw the selection with
+    HRESULT InitBuffers(ID3D11Device* device);
+
+    //! Choose the nodes to draw for the camera and frustum, both in the ocean's space. bounds is how far the
+    //! surface can be displaced from the plane along each axis.
+    void Select(const XMFLOAT3& camera, const Frustum& frustum, const XMFLOAT3& bounds);
+    //! Upload the selection and draw it, with the pixel shader, constants and HeightmapTextures already bound
+    void Render();
+
+    const CdlodStats& GetStats() const { return stats_; }
+    float GetRange(int level) const { return ranges_[level]; }
+
+  private:
+    HRESULT InitShaders();
+    bool SelectNode(float x, float z, int level);
+    void AddNode(Part part, float x, float z, int level);
+
+  private:
+    int numLevels_;
+    float leafSize_, spacing_;
+    float ranges_[CDLOD_MAX_LEVELS]; // Furthest a node of each level is drawn from the camera
+    unsigned int partStart_[NUM_PARTS], partCount_[NUM_PARTS]; // Index ranges
+    Constants constantData_;
+    CdlodStats stats_;
+
+    // The selection being made, and CDLOD_MAX_NODES nodes (x, z, size and level) for each part
+    XMFLOAT3 camera_, bounds_;
+    const Frustum* frustum_;
+    XMFLOAT4* selected_;
+    int numSelected_[NUM_PARTS];
+
+    ID3D11Device* device_;
+    ID3D11DeviceContext* immediateContext_;
+    ID3D11VertexShader* vertexShader_;
+    ID3D11InputLayout* vertexLayout_;
+    ID3D11Buffer* vertexBuffer_;
+    ID3D11Buffer* indexBuffer_;
+    ID3D11Buffer* instanceBuffer_;
+    ID3D11Buffer* vsConstants_;
+  };
+
+  //! Time the selection along camera paths at sea level and at altitude for a range of depths, writing a CSV report
+  void WriteCdlodBenchmark(const char* fileName);
+}
@@ -0,0 +1,46 @@
+/*!
+  @file ChannelHistory.h @date 18/10/26 @brief History of an interpolated ocean channel.
+*/
+
+#pragma once
+
+#include <windows.h>
+#include <xnamath.h>
+
+namespace OceanWaves
+{
+  /*!
+    The previous and current results of a channel that isn't computed every frame, for blending
+    between them. Each entry is a pair of values, stored in single or half precision.
+  */
+  class ChannelHistory
+  {
+    // Entries converted at a time when reading half precision history
+    static const unsigned int BLOCK_SIZE = 64;
+
+  public:
+    ChannelHistory() : prev_(NULL), curr_(NULL), halfPrev_(NULL), halfCurr_(NULL), size_(0),
+      halfPrecision_(false) {}
+    ~ChannelHistory();
+
+    void Init(unsigned int size, bool halfPrecision);
+    bool IsEnabled() const { return size_ != 0; }
+
+    //! Make the current result the previous one, ready for a new current result to be stored
+    void Advance();
+    //! Write part of the current result
+    void Store(unsigned int offset, unsigned int count, const XMFLOAT2* values);
+    //! Copy the current result over the previous one, so that blending starts from it
+    void Restart();
+    //! Read part of the blend from the previous (alpha = 0) to the current (alpha = 1) result
+    void Blend(unsigned int offset, unsigned int count, float alpha, XMFLOAT2* values) const;
+
+    unsigned int GetBytes() const;
+
+  private:
+    XMFLOAT2* prev_, * curr_;
+    HALF* halfPrev_, * halfCurr_;
+    unsigned int size_;
+    bool halfPrecision_;
+  };
+}
@@ -0,0 +1,83 @@
+/*!
+  @file Clipmap.h @date 18/10/26 @brief Geometry clipmap rendering of the ocean surface.
+*/
+
+#pragma once
+
+#include <d3d11.h>
+#include <xnamath.h>
+
+
+namespace OceanWaves
+{
+  const int CLIPMAP_MAX_LEVELS = 16;
+  const int CLIPMAP_BLOCK_SIZE = 32; // Vertices along a side of the blocks that make up each level
+
+  /*!
+    Nested square rings of grid centred on the camera, each with twice the spacing of the one inside it
+    (after Losasso and Hoppe). Every level is made of the same few pieces, whose vertices and indices are
+    generated once and drawn instanced, so the vertex count is the same however far the rings reach.
+
+    Each level samples the HeightmapTextures at the mip level matching its spacing, so the surface is
+    textured from the simulation instead of streamed per vertex.
+  */
+  class Clipmap
+  {
+    enum Piece
+    {
+      PIECE_BLOCK = 0,
+      PIECE_FIXUP_VERTICAL, // The two quad wide gaps left between the blocks
+      PIECE_FIXUP_HORIZONTAL,
+      PIECE_TRIM_VERTICAL, // The L-shaped quad wide gap around the next finer level
+      PIECE_TRIM_HORIZONTAL,
+      PIECE_CENTRE, // The two by two quads in the middle of the finest level
+      NUM_PIECES
+    };
+
+    struct PieceRange
+    {
+      unsigned int startIndex, numIndices;
+      int baseVertex;
+      unsigned int firstInstance, numInstances;
+    };
+
+    struct Constants
+    {
+      XMFLOAT4 levels[CLIPMAP_MAX_LEVELS]; // Origin (x, z), spacing and mip level
+      XMFLOAT4 params; // Quads along a level's side
+    };
+
+  public:
+    Clipmap() : device_(NULL), immediateContext_(NULL), vertexShader_(NULL), vertexLayout_(NULL),
+      vertexBuffer_(NULL), indexBuffer_(NULL), instanceBuffer_(NULL), vsConstants_(NULL), instances_(NULL),
+      numLevels_(0), numInstances_(0) {}
+    ~Clipmap();
+
+    void Init(ID3D11Device* device, int numLevels, float spacing);
+    //! Centre the levels on the camera, in the ocean's space
+    void Update(const XMFLOAT3& camera);
+    //! Draw with the pixel shader, constants and HeightmapTextures already bound
+    void Render();
+
+  private:
+    HRESULT InitShaders();
+    HRESULT InitBuffers();
+
+  private:
+    int numLevels_;
+    float spacing_;
+    PieceRange pieces_[NUM_PIECES];
+    XMFLOAT3* instances_; // Offset of a piece in its level's vertices, and the level
+    unsigned int numInstances_;
+    Constants levelConstants_;
+
+    ID3D11Device* device_;
+    ID3D11DeviceContext* immediateContext_;
+    ID3D11VertexShader* vertexShader_;
+    ID3D11InputLayout* vertexLayout_;
+    ID3D11Buffer* vertexBuffer_;
+    ID3D11Buffer* indexBuffer_;
+    ID3D11Buffer* instanceBuffer_;
+    ID3D11Buffer* vsConstants_;
+  };
+}
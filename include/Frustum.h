@@ -0,0 +1,36 @@
+/*!
+  @file Frustum.h @date 18/10/26 @brief A view frustum for culling bounding boxes.
+*/
+
+#pragma once
+
+#include <xnamath.h>
+
+namespace OceanWaves
+{
+  /*!
+    The six planes of a view frustum, pointing inwards, in whichever space the matrix they're extracted
+    from maps to clip space.
+  */
+  class Frustum
+  {
+  public:
+    enum Containment
+    {
+      OUTSIDE = 0,
+      INTERSECTS,
+      INSIDE
+    };
+
+    //! Extract the planes of a (row vector) view-projection matrix, with clip space z in [0, 1]
+    void Extract(const XMFLOAT4X4& viewProjection);
+
+    //! Test an axis-aligned box against each plane, by its corners nearest and furthest along the plane's normal
+    Containment TestBox(const XMFLOAT3& boxMin, const XMFLOAT3& boxMax) const;
+
+    const XMFLOAT4& GetPlane(int i) const { return planes_[i]; }
+
+  private:
+    XMFLOAT4 planes_[6]; // Left, right, bottom, top, near, far
+  };
+}
@@ -0,0 +1,82 @@
+/*!
+  @file HeightPyramid.h @date 18/10/26 @brief Hierarchical bounds of the ocean surface.
+*/
+
+#pragma once
+
+#include <xnamath.h>
+
+#include "OceanKernels.h"
+#include "ThreadPool.h"
+#include "Vertices.h"
+
+namespace OceanWaves
+{
+  const int HEIGHT_PYRAMID_MAX_LEVELS = 16;
+
+  /*!
+    The least and greatest of every component of the heightmap's vertices (the displacement, height
+    included, and the slopes) over the quads between them, then over 2x2 blocks of quads, and so on up.
+    The heightmap is periodic, so its last quads join its last vertices to its first, and a query may
+    cover any region of the plane the patch tiles. As with the mips, the pyramid stops at the first level
+    with an odd dimension.
+
+    Level 0 is reduced from the vertices in one pass, the quads' rows and corners being runs of the
+    vertex rows offset by a row or a vertex, and each level above from the one below, a row at a time
+    across the thread pool.
+  */
+  class HeightPyramid
+  {
+  public:
+    HeightPyramid() : kernels_(NULL), threadPool_(NULL), vertices_(NULL), lower_(NULL), upper_(NULL), scratch_(NULL), dimX_(0),
+      dimY_(0), spacing_(0.0f), numLevels_(0), buildLevel_(0)
+    {
+      ZeroMemory(&origin_, sizeof(origin_));
+      ZeroMemory(levelOffsets_, sizeof(levelOffsets_));
+    }
+    ~HeightPyramid();
+
+    //! Over a heightmap of dimX x dimY vertices spacing apart, vertex (0, 0) lying at origin in the plane
+    void Init(int dimX, int dimY, const XMFLOAT2& origin, float spacing, const OceanKernels* kernels, ThreadPool* threadPool);
+
+    //! Rebuild every level from the heightmap's vertices
+    void Build(const VertexDispNor* vertices);
+
+    //! The bounds of the whole surface
+    void GetBounds(VertexDispNor* lower, VertexDispNor* upper) const;
+    //! Bounds of every vertex that can be displaced into the region of the plane between regionMin and regionMax
+    //! (in x and z), which may lie anywhere the patch tiles and be any size. Returns the level the cells were read from.
+    int Query(const XMFLOAT2& regionMin, const XMFLOAT2& regionMax, VertexDispNor* lower, VertexDispNor* upper) const;
+
+    int GetNumLevels() const { return numLevels_; }
+    //! The bounds of a cell of a level, (dimX >> level) x (dimY >> level) cells, wrapping x and z
+    void GetCell(int level, int x, int z, VertexDispNor* lower, VertexDispNor* upper) const;
+    //! Every cell of a level, row by row, for those that walk it without wrapping each cell
+    void GetLevel(int level, const VertexDispNor** lower, const VertexDispNor** upper) const
+    {
+      *lower = lower_ + levelOffsets_[level];
+      *upper = upper_ + levelOffsets_[level];
+    }
+
+  private:
+    static void ReduceRow(void* pyramid, int row);
+
+  private:
+    int dimX_, dimY_;
+    XMFLOAT2 origin_;
+    float spacing_;
+    int numLevels_;
+    int levelOffsets_[HEIGHT_PYRAMID_MAX_LEVELS + 1]; // Cells before each level
+
+    const OceanKernels* kernels_;
+    ThreadPool* threadPool_;
+    const VertexDispNor* vertices_;
+    VertexDispNor* lower_, * upper_;
+    VertexDispNor* scratch_; // Bounds of each pair of neighbouring cells of a row, before every other one is kept
+    int buildLevel_; // The level being reduced
+  };
+
+  //! Time building the pyramid on every instruction set the CPU supports over a range of sizes, and check random
+  //! regions' bounds, wrapped ones included, hold every vertex displaced into them, writing a CSV report
+  void WriteHeightPyramidReport(const char* fileName);
+}
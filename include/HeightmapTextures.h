@@ -0,0 +1,113 @@
+/*!
+  @file HeightmapTextures.h @date 18/10/26 @brief The heightmap's displacements and normals as textures.
+*/
+
+#pragma once
+
+#include <d3d11.h>
+#include <xnamath.h>
+
+#include "OceanKernels.h"
+#include "ThreadPool.h"
+#include "Vertices.h"
+
+namespace OceanWaves
+{
+  const int HEIGHTMAP_MAX_MIPS = 16;
+
+  /*!
+    How the mips of the heightmap's textures are built.
+  */
+  enum MipFilter
+  {
+    MIP_FILTER_GPU = 0, // GenerateMips' box filter
+    MIP_FILTER_BOX, // A 2x2 box on the CPU
+    MIP_FILTER_KAISER, // A Kaiser-windowed sinc on the CPU, sharper than the box
+    NUM_MIP_FILTERS
+  };
+
+  /*!
+    The displacements and normals of the heightmap as an atlas of two RGBA slices of one texture array,
+    for the rendering modes whose vertices don't map one to one onto the heightmap and so sample it
+    instead (by vertex texture fetch, or from a tessellated patch). Slice 0 holds the displacement
+    (Dx, height, Dz, 0) and slice 1 the normal (nx, nz, 0, 0), in 32 or 16-bit floats.
+
+    The mips are either rebuilt by the GPU or filtered on the CPU, separably and a row at a time across
+    the thread pool. The heightmap is periodic, so the CPU filters wrap rather than clamp at its edges, and
+    its mips tile as it does. That needs every level but the last to have even dimensions, so the CPU's
+    chain stops at the first odd one.
+  */
+  class HeightmapTextures
+  {
+    struct Constants
+    {
+      XMFLOAT4 params; // 1 / the period in x and z, and half a texel in u and v
+    };
+
+  public:
+    HeightmapTextures() : device_(NULL), immediateContext_(NULL), texture_(NULL), srv_(NULL), sampler_(NULL), constants_(NULL),
+      kernels_(NULL), threadPool_(NULL), texels_(NULL), halfTexels_(NULL), scratch_(NULL), dimX_(0), dimY_(0), spacing_(0.0f),
+      filter_(MIP_FILTER_GPU), numLevels_(0), numBuilt_(0), numTaps_(0), tapOffset_(0), padding_(0), buildLevel_(0)
+    {
+      ZeroMemory(levelOffsets_, sizeof(levelOffsets_));
+      ZeroMemory(weights_, sizeof(weights_));
+    }
+    ~HeightmapTextures();
+
+    //! A heightmap of dimX x dimY texels spacing apart, its mips built by filter, stored as halfs if halfTexels
+    void Init(int dimX, int dimY, float spacing, MipFilter filter, bool halfTexels, const OceanKernels* kernels,
+      ThreadPool* threadPool);
+    //! Create the texture array to upload the atlas to
+    HRESULT InitTextures(ID3D11Device* device);
+
+    //! Pack the heightmap into the top level of the atlas and, unless the GPU builds them, filter the mips from it
+    void Build(const VertexDispNor* vertices);
+    //! Upload what was built and rebuild the mips if the GPU builds them, returning the bytes uploaded
+    int Upload();
+    //! Bind to the vertex shader's t1, s1 and cb2
+    void Bind();
+
+    //! The texture array and its wrapping sampler, for rendering paths that bind them elsewhere, such as a domain shader
+    ID3D11ShaderResourceView* GetShaderResourceView() const { return srv_; }
+    ID3D11SamplerState* GetSampler() const { return sampler_; }
+
+    int GetNumLevels() const { return numLevels_; }
+    int GetNumBuiltLevels() const { return numBuilt_; }
+    //! A slice (0 for the displacement, 1 for the normal) of a level built on the CPU, (dimX >> level) x (dimY >> level) texels
+    const XMFLOAT4* GetLevel(int level, int slice) const;
+
+  private:
+    void InitFilter();
+    static void FilterRow(void* textures, int row);
+
+  private:
+    int dimX_, dimY_;
+    float spacing_;
+    MipFilter filter_;
+    int numLevels_, numBuilt_; // In the texture, and built on the CPU
+    int levelOffsets_[HEIGHTMAP_MAX_MIPS + 1]; // Texels before each level, both of its slices together
+
+    // Taps of the CPU filter, how many of them lie left of a destination texel's first source texel, and how far they
+    // reach past the row in destination texels
+    int numTaps_, tapOffset_, padding_;
+    float weights_[8];
+
+    const OceanKernels* kernels_;
+    ThreadPool* threadPool_;
+    XMFLOAT4* texels_;
+    HALF* halfTexels_;
+    XMFLOAT4* scratch_; // A row of each level filtered down the one above, then split into its even and odd texels
+    int buildLevel_; // The level being filtered
+
+    ID3D11Device* device_;
+    ID3D11DeviceContext* immediateContext_;
+    ID3D11Texture2D* texture_;
+    ID3D11ShaderResourceView* srv_;
+    ID3D11SamplerState* sampler_;
+    ID3D11Buffer* constants_;
+  };
+
+  //! Time building the mips with each filter on every instruction set the CPU supports over a range of sizes, and check
+  //! they respect the wrap by building them again from the heightmap shifted by half its size, writing a CSV report
+  void WriteHeightmapMipBenchmark(const char* fileName);
+}
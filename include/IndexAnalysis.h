@@ -0,0 +1,33 @@
+/*!
+  @file IndexAnalysis.h @date 18/10/26 @brief Post-transform vertex cache efficiency of index orderings.
+*/
+
+#pragma once
+
+#include <windows.h>
+
+namespace OceanWaves
+{
+  /*!
+    How often vertices are transformed: per triangle (ACMR, at best 0.5 for a grid) and per distinct
+    vertex (ATVR, at best 1).
+  */
+  struct VertexCacheStats
+  {
+    float acmr, atvr;
+    unsigned int transforms, triangles, vertices;
+  };
+
+  enum VertexCachePolicy
+  {
+    VERTEX_CACHE_FIFO = 0,
+    VERTEX_CACHE_LRU
+  };
+
+  //! Run indices (a triangle strip, or list) through a cache of cacheSize vertices
+  VertexCacheStats SimulateVertexCache(const WORD* indices, unsigned int numIndices, bool strip, int cacheSize,
+    VertexCachePolicy policy);
+
+  //! Compare the orderings over heightmaps of 64 to 1024 vertices square, writing a CSV report
+  void WriteIndexAnalysis(const char* fileName);
+}
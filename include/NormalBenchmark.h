@@ -0,0 +1,12 @@
+/*!
+  @file NormalBenchmark.h @date 18/10/26 @brief Cost and accuracy of the ways of computing the ocean's normals.
+*/
+
+#pragma once
+
+namespace OceanWaves
+{
+  //! Time each normal method on every instruction set the CPU supports, over a range of FFT sizes and choppiness,
+  //! and measure its angular error against the exact normals of the displaced surface, writing a CSV report
+  void WriteNormalBenchmark(const char* fileName);
+}
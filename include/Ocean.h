@@ -11,17 +11,129 @@
 #include <xnamath.h>
 
 #include "fftw3.h"
+#include "Cdlod.h"
+#include "ChannelHistory.h"
+#include "Clipmap.h"
+#include "Frustum.h"
+#include "HeightmapTextures.h"
+#include "HeightPyramid.h"
+#include "OceanKernels.h"
+#include "OceanTiles.h"
+#include "ProjectedGrid.h"
+#include "RayCaster.h"
 #include "Settings.h"
+#include "ThreadPool.h"
+#include "UploadRing.h"
 #include "Utilities.h"
 #include "Vertices.h"
 
 namespace OceanWaves
 {
+  /*!
+    Outputs of the simulation that a consumer can ask for.
+  */
+  enum OceanChannel
+  {
+    OCEAN_CHANNEL_HEIGHT = 0x01,
+    OCEAN_CHANNEL_DISPLACEMENT = 0x02,
+    OCEAN_CHANNEL_NORMALS = 0x04,
+    OCEAN_CHANNEL_LOD = 0x08, // Coarser heightmaps cropped from the same spectrum
+    OCEAN_CHANNEL_FOAM = 0x10, // The Jacobian of the displacement, and the foam accumulated where it folds
+    OCEAN_CHANNEL_VELOCITY = 0x20, // The rate of change of the displacement, height included, from the spectrum
+    OCEAN_CHANNEL_ACCELERATION = 0x40, // And its rate of change
+    OCEAN_CHANNEL_TEXTURES = 0x80, // The surface packed into an atlas of textures with mips, for sampling by vertex texture fetch
+    OCEAN_CHANNEL_SURFACE = 0x07, // What the surface mesh is built from
+    OCEAN_CHANNEL_ALL = 0xFF
+  };
+
+  const int OCEAN_NUM_CHANNELS = 8;
+
+  const float OCEAN_FOAM_THRESHOLD = 0.5f; // Jacobian below which the surface starts to foam, fully where it folds at 0
+  const float OCEAN_FOAM_LIFETIME = 2.0f; // Seconds for foam to fade to 1 / e
+
+  /*!
+    How the normals are computed: by transforming the slopes from the spectrum, or by filtering the transformed height.
+  */
+  enum NormalMethod
+  {
+    NORMAL_METHOD_FFT = 0,
+    NORMAL_METHOD_SOBEL,
+    NORMAL_METHOD_DIFFERENCES, // Central differences of the displaced surface, so the only one the choppiness tilts
+    NUM_NORMAL_METHODS
+  };
+
+  /*!
+    Consumers of the simulation outputs, each of which registers the channels it reads.
+  */
+  enum OceanConsumer
+  {
+    OCEAN_CONSUMER_RENDER = 0,
+    OCEAN_CONSUMER_QUERY,
+    OCEAN_NUM_CONSUMERS
+  };
+
+  /*!
+    Work done (and avoided) by the most recent call to UpdateHeightmap.
+  */
+  struct OceanFrameStats
+  {
+    int channelsComputed, channelsSkipped, channelsInterpolated;
+    int fftsExecuted, fftsSkipped;
+    bool updateSkipped;
+    float updateTime, worstUpdateTime; // Milliseconds, the worst over the last OCEAN_STATS_WINDOW frames
+    int uploadBytes, historyBytes;
+    int uploadStalls; // Frames the upload ring waited for the GPU to finish with, since init
+    float streamPositionError, streamNormalError; // Metres and degrees lost by a half or packed stream, measured every OCEAN_STATS_WINDOW frames
+    float lodTime; // Milliseconds spent cropping and transforming the LOD spectra
+    float foamTime; // Milliseconds spent on the Jacobian and foam, not counting the displacement transforms it may force
+    float mipTime; // Milliseconds spent packing the heightmap into its textures and filtering their mips on the CPU
+    float boundsTime; // Milliseconds spent rebuilding the height pyramid, on demand, since the last update
+    float velocityTime; // Milliseconds spent transforming and sampling the velocity and acceleration, not counting their evolution
+    int tilesDrawn, tilesCulled;
+    float cullTime; // Milliseconds spent culling the tiles, in the last call to Update
+  };
+
+  const int OCEAN_STATS_WINDOW = 64;
+  const int OCEAN_QUERY_BLOCK = 4096; // Positions per task when a query is spread over the thread pool
+
   /*!
     An implementation of Tessendorf's model of ocean surface waves.
   */
   class Ocean
   {
+    /*
+      A coarser level of detail, whose spectrum is the low-frequency block of the full resolution one.
+    */
+    struct SpectralLod
+    {
+      int dimX, dimY, spectrumDimX;
+      fftwf_complex* in;
+      float* out;
+      fftwf_plan plan;
+    };
+
+    /*
+      A time derivative of the displacement (Dx, h, Dz), transformed from the same derivative of the spectrum.
+    */
+    struct SurfaceDerivative
+    {
+      fftwf_complex* in[3];
+      float* out[3];
+      fftwf_plan plans[3];
+      XMFLOAT3* samples; // At the heightmap's vertices, with the choppiness applied as it is to theirs
+    };
+
+    /*
+      A band of whole rows of the heightmap, drawn with the shared indices offset to its first vertex.
+      Neighbouring bands share a row.
+    */
+    struct MeshChunk
+    {
+      int firstRow, numRows;
+      unsigned int startIndex, numIndices;
+      int baseVertex;
+    };
+
     struct VSConstants
     {
       XMFLOAT4X4 world;
@@ -30,10 +142,47 @@ namespace OceanWaves
       XMFLOAT3 camView;
     };
 
+    struct StreamConstants
+    {
+      XMFLOAT4 dispScale; // What a packed displacement of 1 is, per axis
+    };
+
+    // A query spread over the thread pool, a block of positions per task
+    struct HeightQuery
+    {
+      const Ocean* ocean;
+      const XMFLOAT2* positions;
+      int count;
+      float* heights;
+      XMFLOAT3* normals;
+      int maxIterations; // Of the displaced surface's queries
+      float tolerance;
+      int* iterations;
+      float* residuals;
+    };
+
   public:
     Ocean() : device_(NULL), immediateContext_(NULL), vertexShader_(NULL), solidPixelShader_(NULL),
-      wireframePixelShader_(NULL), vertexLayout_(NULL), vertexBuffer_(NULL), indexBuffer_(NULL),
-      vsConstants_(NULL), vertices_(NULL), indices_(NULL), gravity_(9.81f), h0k_(NULL), wk_(NULL) {}
+      wireframePixelShader_(NULL), vertexLayout_(NULL), gridBuffer_(NULL), vertexBuffer_(NULL), indexBuffer_(NULL),
+      vsConstants_(NULL), streamConstants_(NULL), gridSpacing_(0.0f), baseGrid_(NULL),
+      stream_(NULL), indices_(NULL), quadDiagonals_(NULL), chunks_(NULL), numChunks_(0),
+      gravity_(9.81f), h0k_(NULL), wk_(NULL), lastTime_(-1.0f), validChannels_(0),
+      frame_(0), frameTimeIndex_(0), streamHalf_(NULL), rowHalf_(NULL), streamPacked_(NULL),
+      streamTarget_(NULL), rowDisp_(NULL), rowSlope_(NULL), jacobian_(NULL), foam_(NULL),
+      lastFoamTime_(-1.0f), lods_(NULL), heightPyramidDirty_(true),
+      kernels_(NULL), simdPath_(SIMD_PATH_SSE2), evolveTerms_(NULL)
+    {
+      ZeroMemory(&stats_, sizeof(stats_));
+      ZeroMemory(&gridOrigin_, sizeof(gridOrigin_));
+      ZeroMemory(&dispBounds_, sizeof(dispBounds_));
+      ZeroMemory(frameTimes_, sizeof(frameTimes_));
+      ZeroMemory(lastUpdateFrame_, sizeof(lastUpdateFrame_));
+      ZeroMemory(&velocity_, sizeof(velocity_));
+      ZeroMemory(&acceleration_, sizeof(acceleration_));
+      for (int i = 0; i < OCEAN_NUM_CONSUMERS; ++i) {
+        channelDemand_[i] = 0;
+      }
+    }
     ~Ocean();
 
     void Init(ID3D11Device* device, const OceanSettings& settings);
@@ -41,32 +190,146 @@ namespace OceanWaves
     void UpdateHeightmap(float elapsedTime);
     void Render(bool wireframe);
 
+    //! Register the channels a consumer reads; UpdateHeightmap only computes what is demanded
+    void SetChannelDemand(OceanConsumer consumer, unsigned int channels) { channelDemand_[consumer] = channels; }
+    unsigned int GetRequiredChannels() const;
+
+    const OceanFrameStats& GetFrameStats() const { return stats_; }
+    SimdPath GetSimdPath() const { return simdPath_; }
+
+    //! Heightmap of LOD level 1...lodLevels (each half the resolution of the last), valid while OCEAN_CHANNEL_LOD is demanded
+    const float* GetLodHeightmap(int level, int* dimX, int* dimY) const;
+
+    //! The Jacobian of the displacement and the foam coverage in [0, 1], at heightmap resolution, valid while OCEAN_CHANNEL_FOAM is demanded
+    const float* GetJacobian() const { return jacobian_; }
+    const float* GetFoam() const { return foam_; }
+
+    //! The displacements and normals of the current heightmap as a texture atlas with its mips, valid while
+    //! OCEAN_CHANNEL_TEXTURES is demanded, which the clipmap, the quadtree and the tiles do
+    const HeightmapTextures& GetHeightmapTextures() const { return heightmapTextures_; }
+
+    //! The current heightmap, for those that query it in bulk, such as Buoyancy: vertex (0, 0) lies at origin in the ocean's
+    //! space, the vertices spacing apart
+    const VertexDispNor* GetHeightmap(int* dimX, int* dimY, XMFLOAT2* origin, float* spacing) const;
+
+    //! Bounds of the current heightmap over any region of the plane, in the ocean's space, rebuilt first if the heightmap has
+    //! been written since they last were
+    const HeightPyramid& GetHeightPyramid();
+
+    //! Heights, and unit normals unless normals is NULL, of the current heightmap bilinearly interpolated at (x, z) positions
+    //! in the ocean's space, which it tiles, as demanded by OCEAN_CONSUMER_QUERY. Only reads the heightmap, so any number of
+    //! threads can query disjoint spans at once between updates.
+    void QueryHeights(const XMFLOAT2* positions, int count, float* heights, XMFLOAT3* normals) const;
+    //! The same, spread over the ocean's thread pool, from the thread that updates it
+    void QueryHeightsParallel(const XMFLOAT2* positions, int count, float* heights, XMFLOAT3* normals);
+    //! As QueryHeights, but of the displaced surface, which the choppy waves move horizontally as well: finds the vertex
+    //! displaced onto each position by at most maxIterations steps, stopping once it lands within tolerance. Unless NULL,
+    //! iterations and residuals get the steps each position took and how far from it the vertex found is displaced to.
+    void QueryDisplacedHeights(const XMFLOAT2* positions, int count, int maxIterations, float tolerance, float* heights,
+      XMFLOAT3* normals, int* iterations, float* residuals) const;
+    //! The same, spread over the ocean's thread pool, from the thread that updates it
+    void QueryDisplacedHeightsParallel(const XMFLOAT2* positions, int count, int maxIterations, float tolerance, float* heights,
+      XMFLOAT3* normals, int* iterations, float* residuals);
+    //! The surface's velocities and accelerations (the orbital motion of the water there), each unless NULL, at positions as
+    //! QueryHeights samples the heights, valid while OCEAN_CHANNEL_VELOCITY and OCEAN_CHANNEL_ACCELERATION are demanded
+    void QueryVelocities(const XMFLOAT2* positions, int count, XMFLOAT3* velocities, XMFLOAT3* accelerations) const;
+    //! Where each of count rays, from origins along directions in the ocean's space, first meets the current heightmap's mesh
+    //! within maxDistance of them, spread over the ocean's thread pool from the thread that updates it
+    void CastRays(const XMFLOAT3* origins, const XMFLOAT3* directions, int count, float maxDistance, RayHit* hits);
+
   private:
     HRESULT InitShaders();
     HRESULT InitBuffers();
     HRESULT InitTextures();
 
-    float Phillips(const XMFLOAT2& k);
-
     void InitFFTW();
+    void InitDerivative(SurfaceDerivative& derivative);
     void InitHeightmap();
-    void ComputeNormalsFFT();
-    void ComputeNormalsSobel();
+    void InitIndices(int chunkRows);
+    static void GenerateChunk(void* ocean, int chunk);
+    static void QueryHeightBlock(void* query, int block);
+    static void QueryDisplacedHeightBlock(void* query, int block);
+
+    unsigned int ScheduleChannels(unsigned int channels) const;
+    unsigned int AddSourceChannels(unsigned int channels) const;
+    int CountFFTs(unsigned int channels) const;
+    void ComputeLods();
+    void ComputeChannels(float elapsedTime, unsigned int channels);
+    void ComputeFoam(float elapsedTime, bool restart);
+    void ComputeDerivative(SurfaceDerivative& derivative);
+    void StoreHistory(unsigned int channels, unsigned int restarted);
+    void WriteVertices(unsigned int channels);
+    void PackVertices(int row, int count);
+    void MeasureStreamError();
+    void BuildHeightPyramid();
+    void RecordFrameTime(float time);
 
   private:
     OceanSettings settings_;
     const float gravity_;
-    VertexPosNor* vertices_;
-    WORD* indices_;
+    XMFLOAT2 gridOrigin_; // Where vertex (0, 0) lies in the ocean's space, the heightmap centred on its origin
+    float gridSpacing_; // Between neighbouring vertices
+    XMFLOAT2* baseGrid_; // The (x, z) of each vertex, uploaded once
+    VertexDispNor* stream_; // Overwritten every frame
+    VertexDispNorHalf* streamHalf_; // Streamed instead of stream_ in half precision mode
+    HALF* rowHalf_;
+    BYTE* streamPacked_; // Streamed instead of stream_ when the vertices are packed
+    BYTE* streamTarget_; // Where this frame's stream is written: the CPU copy of it, or straight into the ring's frame
+    UINT streamStride_;
+    XMFLOAT3 packScale_, packMax_; // The displacement scale the stream is packed to, and the largest displacement this frame
+    WORD* indices_; // Over one whole chunk and shared by every chunk, then over the last chunk if it's shorter
+    BYTE* quadDiagonals_; // Which diagonal each row of quads is split along, as RayCaster numbers them
     unsigned int numVertices_, numIndices_;
-    unsigned int fftSize_;
+    MeshChunk* chunks_;
+    int numChunks_;
+    ThreadPool threadPool_;
+    Clipmap clipmap_; // Drawn instead of the heightmap mesh when ClipmapLevels is set
+    ProjectedGrid projectedGrid_; // Or when ProjectedGridSize is, projected with the last inverse world-view-projection
+    XMFLOAT4X4 inverseWorldViewProjection_;
+    Cdlod cdlod_; // Or when CdlodLevels is, selected against the frustum in the ocean's space
+    Frustum frustum_;
+    XMFLOAT3 dispBounds_; // The largest displacement last frame, which the quadtree's nodes and the tiles are padded by
+    OceanTiles tiles_; // Or when TileRadius is, culled against the same frustum
+    HeightmapTextures heightmapTextures_; // Made the first time it's demanded
+    HeightPyramid heightPyramid_; // Rebuilt on demand once the heightmap has been written
+    bool heightPyramidDirty_;
+    RayCaster rayCaster_; // Through the heightmap, bounded by the pyramid
+    unsigned int fftSize_, spectrumSize_;
+    int spectrumDimX_;
     XMFLOAT2* h0k_;
     float* wk_;
 
+    // Channels demanded by each consumer and those that are up to date for lastTime_
+    unsigned int channelDemand_[OCEAN_NUM_CONSUMERS];
+    unsigned int validChannels_;
+    float lastTime_;
+    OceanFrameStats stats_;
+    Timer timer_;
+    float frameTimes_[OCEAN_STATS_WINDOW];
+    int frameTimeIndex_;
+
+    // Channels updated less often than every frame blend from the previous to the current result over
+    // their interval, so they lag by up to an interval but never pop. History is at heightmap resolution.
+    unsigned int frame_, lastUpdateFrame_[3];
+    ChannelHistory dispHistory_; // Dx, Dz
+    ChannelHistory slopeHistory_; // dh/dx, dh/dz
+    XMFLOAT2* rowDisp_, * rowSlope_; // A row of blended history
+
+    // The foam is updated with the displacement it's derived from, and fades with the time since it last was
+    float* jacobian_, * foam_;
+    float lastFoamTime_;
+
     // FFTW plans and input and output buffers
     fftwf_complex* hktIn_, * DxtIn_, * DztIn_, * nxIn_, * nzIn_;
     float* hktOut_, * DxtOut_, * DztOut_, * nxOut_, * nzOut_;
     fftwf_plan hktPlan_, DxtPlan_, DztPlan_, nxPlan_, nzPlan_;
+    SpectralLod* lods_;
+    SurfaceDerivative velocity_, acceleration_; // Made the first time they're demanded
+
+    const OceanKernels* kernels_; // Specialised on the FFT size and instruction set at init
+    KernelGrid kernelGrid_;
+    SimdPath simdPath_;
+    float* evolveTerms_; // h0(k) + h0(-k) and h0(k) - h0(-k) over the half spectrum
 
     ID3D11Device* device_;
     ID3D11DeviceContext* immediateContext_;
@@ -74,9 +337,13 @@ namespace OceanWaves
     ID3D11PixelShader* solidPixelShader_;
     ID3D11PixelShader* wireframePixelShader_;
     ID3D11InputLayout* vertexLayout_;
-    ID3D11Buffer* vertexBuffer_;
+    ID3D11Buffer* gridBuffer_;
+    ID3D11Buffer* vertexBuffer_; // Or when UploadFrames is set, the stream goes through the upload ring
     ID3D11Buffer* indexBuffer_;
     ID3D11Buffer* vsConstants_;
+    ID3D11Buffer* streamConstants_;
+    D3D11UploadBackend uploadBackend_;
+    UploadRing uploadRing_;
     ID3D11ShaderResourceView* skyReflectionSRV_;
     ID3D11SamplerState* skyReflectionSampler_;
   };
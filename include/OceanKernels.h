@@ -0,0 +1,131 @@
+/*!
+  @file OceanKernels.h @date 18/10/26 @brief Simulation kernels specialised on the FFT size and instruction set.
+*/
+
+#pragma once
+
+#include <windows.h>
+#include <xnamath.h>
+
+#include "fftw3.h"
+#include "Simd.h"
+#include "Vertices.h"
+
+namespace OceanWaves
+{
+  /*!
+    The grid that a kernel runs over.
+  */
+  struct KernelGrid
+  {
+    int dimX, dimY; // FFT dimensions
+    int spectrumDimX; // Columns of the half spectrum
+    float patchLengthX, patchLengthY;
+  };
+
+  /*!
+    Parameters of the Phillips spectrum.
+  */
+  struct SpectrumParams
+  {
+    float A; // Numeric constant
+    float windX, windZ; // Unit wind direction
+    float S; // Scale of the waves moving against the wind
+    float L, l; // Largest and smallest possible waves
+    float gravity;
+  };
+
+  /*!
+    The simulation kernels for one FFT size and instruction set, chosen once when the ocean is initialised.
+  */
+  struct OceanKernels
+  {
+    int size; // The square size the kernels are specialised on, or 0 for any size
+
+    // ~h0(k) over the full spectrum from a Gaussian pair per wavenumber, then omega(k) and the evolution terms
+    // h0(k) + h0(-k) and h0(k) - h0(-k) over the half spectrum (four planes: real sum, imaginary sum, real and imaginary difference)
+    void (*initSpectrum)(const KernelGrid& grid, const SpectrumParams& params, const XMFLOAT2* gauss, XMFLOAT2* h0k,
+      float* wk, float* terms);
+
+    // h0(k) -> h(k,t) = h0(k) e^(iwt) + conj(h0(-k)) e^(-iwt), over the half spectrum, and unless NULL its first and second
+    // derivatives with respect to real time, of which time is timeScale times
+    void (*evolveSpectrum)(const KernelGrid& grid, const float* terms, const float* wk, float time, float timeScale,
+      fftwf_complex* hkt, fftwf_complex* velocity, fftwf_complex* acceleration);
+
+    // h(k,t) -> Dx(k,t), Dz(k,t) and the slopes, either pair of which may be NULL to skip it
+    void (*deriveChannels)(const KernelGrid& grid, const fftwf_complex* hkt, fftwf_complex* Dx, fftwf_complex* Dz,
+      fftwf_complex* nx, fftwf_complex* nz);
+
+    // Write a row of vertices from every heightStride'th height and the (x, z) displacements and slopes, any of which may be NULL
+    void (*writeVertices)(const float* heights, int heightStride, const XMFLOAT2* disp, const XMFLOAT2* slopes, int count,
+      float choppiness, VertexDispNor* vertices);
+
+    // Slopes of a periodic heightfield with a Sobel filter, at every stepX'th column and stepZ'th row of the slope planes
+    void (*sobelSlopes)(const KernelGrid& grid, const float* heights, int stepX, int stepZ, float* slopeX, float* slopeZ);
+
+    // Slopes of the heightfield whose normals are those of the surface displaced by choppiness times (Dx, Dz), from central
+    // differences, at every stepX'th column and stepZ'th row of the slope planes
+    void (*displacedSlopes)(const KernelGrid& grid, const float* heights, const float* Dx, const float* Dz, float choppiness,
+      int stepX, int stepZ, float* slopeX, float* slopeZ);
+
+    // The Jacobian of the displacement by choppiness times (Dx, Dz), from central differences at every stepX'th column and
+    // stepZ'th row, into jacobian at that resolution. foam is decayed by decay and raised to the coverage where the Jacobian is
+    // below threshold.
+    void (*foam)(const KernelGrid& grid, const float* Dx, const float* Dz, float choppiness, int stepX, int stepZ,
+      float threshold, float decay, float* jacobian, float* foam);
+
+    // Pack vertices to VertexDispNorPacked8 or 16 (by normalBits), as fractions of 1 / inverseScale, raising maxDisp to
+    // the largest displacement seen
+    void (*packVertices)(const VertexDispNor* vertices, int count, const XMFLOAT3& inverseScale, int normalBits,
+      void* packed, XMFLOAT3* maxDisp);
+
+    // Intersect a row of rays with the plane y = 0, their homogeneous near and far ends stepping linearly along the row.
+    // Rays that miss the plane or cross it beyond the far plane end under their far end instead.
+    void (*projectRays)(const XMFLOAT4& nearStart, const XMFLOAT4& nearStep, const XMFLOAT4& farStart,
+      const XMFLOAT4& farStep, int count, XMFLOAT2* hits);
+
+    // Bilinearly sample the periodic heightmap (vertex (0, 0) at origin, spacing apart) at (x, z) positions
+    void (*sampleHeightmap)(const VertexDispNor* heightmap, int dimX, int dimY, const XMFLOAT2& origin, float spacing,
+      const XMFLOAT2* positions, int count, VertexDispNor* samples);
+
+    // The same, but only the height and, unless normals is NULL, the unit normal. The heightmap must have fewer than 2^24 vertices.
+    void (*sampleHeights)(const VertexDispNor* heightmap, int dimX, int dimY, const XMFLOAT2& origin, float spacing,
+      const XMFLOAT2* positions, int count, float* heights, XMFLOAT3* normals);
+
+    // The same, but of the displaced surface, at the vertices displaced onto the positions, found within tolerance by
+    // at most maxIterations steps. Unless NULL, iterations and residuals get each position's steps and the distance left
+    // between it and where the vertex found is displaced to.
+    void (*sampleDisplacedHeights)(const VertexDispNor* heightmap, int dimX, int dimY, const XMFLOAT2& origin, float spacing,
+      const XMFLOAT2* positions, int count, int maxIterations, float tolerance, float* heights, XMFLOAT3* normals,
+      int* iterations, float* residuals);
+
+    // As sampleHeights, but every component of a field of vectors at the heightmap's vertices
+    void (*sampleVectors)(const XMFLOAT3* field, int dimX, int dimY, const XMFLOAT2& origin, float spacing,
+      const XMFLOAT2* positions, int count, XMFLOAT3* samples);
+
+    // Transform count points, given as separate x, y and z, by a row-vector matrix, writing their (x, z) together as the
+    // queries take them and their y apart
+    void (*transformPoints)(const float* x, const float* y, const float* z, int count, const XMFLOAT4X4& transform,
+      XMFLOAT2* xz, float* yOut);
+
+    // The volume under the surface heights of count cubes of half-size radius centred on the points (x, z) and y, whose
+    // sides are held upright, returning it and writing its centroid
+    float (*submergedVolume)(const XMFLOAT2* xz, const float* y, const float* radius, const float* surface, int count,
+      XMFLOAT3* centroid);
+
+    // Test boxes centred on the plane y = 0 at (centreX, centreZ), all halfExtent in size, against six (inward) planes,
+    // writing the indices of those not wholly outside any plane to visible and returning how many there are
+    int (*cullTiles)(const XMFLOAT4* planes, const float* centreX, const float* centreZ, int count,
+      const XMFLOAT3& halfExtent, int* visible);
+
+    // dst = the sum of each of numSources sources weighted by its weight, over count floats
+    void (*weightedSum)(const float* const* sources, const float* weights, int numSources, int count, float* dst);
+
+    // lower = the least of numRows lowerRows and upper the greatest of numRows upperRows, over count floats
+    void (*rowBounds)(const float* const* lowerRows, const float* const* upperRows, int numRows, int count, float* lower,
+      float* upper);
+  };
+
+  // Return the kernels built for the instruction set and specialised on the FFT dimensions, or generic ones for sizes we don't ship
+  const OceanKernels& SelectOceanKernels(int dimX, int dimY, SimdPath path);
+}
@@ -0,0 +1,1512 @@
+/*!
+  @file OceanKernelsImpl.h @date 18/10/26 @brief Bodies of the simulation kernels, built once per instruction set.
+*/
+
+#pragma once
+
+#include <math.h>
+#include <emmintrin.h>
+
+#include "OceanKernels.h"
+
+/*
+  Included only by the OceanKernels*.cpp files, each of which is compiled for its own instruction set and
+  instantiates the kernels with its own Isa policy. Everything is in an anonymous namespace, so each file
+  keeps its own copy of every function here.
+
+  That only holds for functions with internal linkage. An inline function with external linkage (the
+  CRT's float maths on x86, XNA Math's constructors) is emitted by every file that calls it, built for
+  that file's instruction set, and the linker keeps one copy for all callers, which could hand AVX code
+  to the SSE2 path. So the kernels call no such function: scalar maths goes through the helpers below,
+  which use intrinsics and the CRT's double functions (compiled once, in the CRT), and XNA Math types
+  are written member by member.
+*/
+namespace OceanWaves
+{
+namespace
+{
+  /*
+    SSE2, which every x86 target we build for has, and which the SSE4.2 policy extends.
+
+    An Isa policy provides a vector of WIDTH floats, a comparison mask, and the operations below.
+    Select(m, a, b) is m ? a : b, lane by lane. Gather(base, index, stride) loads base[index * stride]
+    lane by lane, the indices being whole numbers held as floats.
+  */
+  struct IsaSse2
+  {
+    typedef __m128 Float;
+    typedef __m128 Mask;
+    enum { WIDTH = 4 };
+
+    static Float Load(const float* p) { return _mm_loadu_ps(p); }
+    static void Store(float* p, Float a) { _mm_storeu_ps(p, a); }
+    static Float Set(float a) { return _mm_set1_ps(a); }
+
+    static Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+    static Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+    static Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+    static Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+    static Float MulAdd(Float a, Float b, Float c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static Float Sqrt(Float a) { return _mm_sqrt_ps(a); }
+    static Float Min(Float a, Float b) { return _mm_min_ps(a, b); }
+    static Float Max(Float a, Float b) { return _mm_max_ps(a, b); }
+
+    // Round to nearest (the MXCSR default), and 2^n for integral n
+    static Float Round(Float a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); }
+    static Float Pow2(Float n) { return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127)), 23)); }
+
+    static Mask Less(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+    static Float Select(Mask m, Float a, Float b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+
+    // Swap the real and imaginary lanes of each complex, and store two vectors interleaved
+    static Float SwapPairs(Float a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)); }
+    static void StoreInterleaved(float* p, Float a, Float b)
+    {
+      _mm_storeu_ps(p, _mm_unpacklo_ps(a, b));
+      _mm_storeu_ps(p + 4, _mm_unpackhi_ps(a, b));
+    }
+    static void LoadInterleaved(const float* p, Float* a, Float* b)
+    {
+      Float lo = _mm_loadu_ps(p), hi = _mm_loadu_ps(p + 4);
+      *a = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+      *b = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+    }
+
+    // No gather instruction, so a lane at a time
+    static Float Gather(const float* base, Float index, int stride)
+    {
+      int i[4];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(i), _mm_cvttps_epi32(index));
+      return _mm_setr_ps(base[i[0] * stride], base[i[1] * stride], base[i[2] * stride], base[i[3] * stride]);
+    }
+  };
+
+  inline float ScalarSqrt(float a) { return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(a))); }
+  inline float ScalarAbs(float a) { return _mm_cvtss_f32(_mm_andnot_ps(_mm_set_ss(-0.0f), _mm_set_ss(a))); }
+  inline float ScalarExp(float a) { return static_cast<float>(exp(static_cast<double>(a))); }
+  inline float ScalarSin(float a) { return static_cast<float>(sin(static_cast<double>(a))); }
+  inline float ScalarCos(float a) { return static_cast<float>(cos(static_cast<double>(a))); }
+
+  inline void StoreFloat2(XMFLOAT2* p, float x, float y)
+  {
+    p->x = x;
+    p->y = y;
+  }
+  inline void StoreFloat3(XMFLOAT3* p, float x, float y, float z)
+  {
+    p->x = x;
+    p->y = y;
+    p->z = z;
+  }
+
+  // Per lane constants, loaded (unaligned) as the first WIDTH floats
+  const float LANE_INDEX[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+  const float PAIR_INDEX[16] = { 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7 };
+  const float PAIR_SIGN[16] = { 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1 };
+
+  const float INV_SQRT2 = 0.7071068f;
+
+  /*
+    A square power of two grid known at compile time, so that the dimensions and strides fold to
+    constants and wrapping an index is a mask rather than a modulo.
+  */
+  template <int N>
+  struct FixedGrid
+  {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "Fixed grids must be a power of two");
+
+    explicit FixedGrid(const KernelGrid&) {}
+
+    int DimX() const { return N; }
+    int DimY() const { return N; }
+    int SpectrumDimX() const { return N / 2 + 1; }
+
+    // Negative indices wrap too, as -i & (N - 1) == N - i
+    int WrapX(int i) const { return i & (N - 1); }
+    int WrapY(int i) const { return i & (N - 1); }
+  };
+
+  /*
+    Any grid the FFT supports (rectangular and mixed radix), read from the settings at run time.
+  */
+  struct RuntimeGrid
+  {
+    explicit RuntimeGrid(const KernelGrid& grid) : grid_(grid) {}
+
+    int DimX() const { return grid_.dimX; }
+    int DimY() const { return grid_.dimY; }
+    int SpectrumDimX() const { return grid_.spectrumDimX; }
+
+    // Only ever asked to wrap indices that are at most one grid out of range
+    int WrapX(int i) const { return (i + grid_.dimX) % grid_.dimX; }
+    int WrapY(int i) const { return (i + grid_.dimY) % grid_.dimY; }
+
+    const KernelGrid& grid_;
+  };
+
+  // Indices above n / 2 are the negative frequencies
+  inline int SignedFrequency(int i, int n)
+  {
+    return (i <= n / 2) ? i : i - n;
+  }
+
+  template <class Isa>
+  typename Isa::Float Abs(typename Isa::Float a)
+  {
+    return Isa::Max(a, Isa::Sub(Isa::Set(0.0f), a));
+  }
+
+  // Round can go either way at .5, so it's corrected down where it went up
+  template <class Isa>
+  typename Isa::Float Floor(typename Isa::Float a)
+  {
+    typename Isa::Float r = Isa::Round(a);
+    return Isa::Select(Isa::Less(a, r), Isa::Sub(r, Isa::Set(1.0f)), r);
+  }
+
+  // sin(x) and cos(x), reduced to [-pi/4, pi/4] about the nearest multiple of pi/2 (Cephes' minimax polynomials)
+  template <class Isa>
+  void SinCos(typename Isa::Float x, typename Isa::Float* sin, typename Isa::Float* cos)
+  {
+    typedef typename Isa::Float Float;
+
+    // The multiple of pi/2 is subtracted in three parts to keep the precision of large arguments
+    Float j = Isa::Round(Isa::Mul(x, Isa::Set(0.63661977f)));
+    Float r = Isa::MulAdd(j, Isa::Set(-1.5703125f), x);
+    r = Isa::MulAdd(j, Isa::Set(-4.837512969970703125e-4f), r);
+    r = Isa::MulAdd(j, Isa::Set(-7.54978995489188216e-8f), r);
+    Float r2 = Isa::Mul(r, r);
+
+    Float s = Isa::MulAdd(r2, Isa::Set(-1.9515295891e-4f), Isa::Set(8.3321608736e-3f));
+    s = Isa::MulAdd(r2, s, Isa::Set(-1.6666654611e-1f));
+    s = Isa::MulAdd(Isa::Mul(r2, r), s, r);
+
+    Float c = Isa::MulAdd(r2, Isa::Set(2.443315711809948e-5f), Isa::Set(-1.388731625493765e-3f));
+    c = Isa::MulAdd(r2, c, Isa::Set(4.166664568298827e-2f));
+    c = Isa::MulAdd(Isa::Mul(r2, r2), c, Isa::MulAdd(r2, Isa::Set(-0.5f), Isa::Set(1.0f)));
+
+    // The quadrant j mod 4, without integer vectors: floor(j / 4) == round((j - 1.5) / 4) for integral j
+    Float q = Isa::Sub(j, Isa::Mul(Isa::Set(4.0f), Isa::Round(Isa::Mul(Isa::Sub(j, Isa::Set(1.5f)), Isa::Set(0.25f)))));
+    Float odd = Isa::Sub(q, Isa::Mul(Isa::Set(2.0f), Isa::Round(Isa::Mul(Isa::Sub(q, Isa::Set(0.5f)), Isa::Set(0.5f)))));
+    Float qc = Isa::Sub(q, Isa::Set(1.5f));
+
+    typename Isa::Mask swap = Isa::Less(Isa::Set(0.5f), odd);
+    typename Isa::Mask sinNegative = Isa::Less(Isa::Set(0.0f), qc);
+    typename Isa::Mask cosNegative = Isa::Less(Isa::Max(qc, Isa::Sub(Isa::Set(0.0f), qc)), Isa::Set(1.0f));
+
+    Float rs = Isa::Select(swap, c, s);
+    Float rc = Isa::Select(swap, s, c);
+    *sin = Isa::Select(sinNegative, Isa::Sub(Isa::Set(0.0f), rs), rs);
+    *cos = Isa::Select(cosNegative, Isa::Sub(Isa::Set(0.0f), rc), rc);
+  }
+
+  // e^x, from 2^n e^r with r in [-ln(2) / 2, ln(2) / 2] (Cephes' polynomial), clamped to the normal range
+  template <class Isa>
+  typename Isa::Float Exp(typename Isa::Float x)
+  {
+    typedef typename Isa::Float Float;
+
+    x = Isa::Min(Isa::Max(x, Isa::Set(-87.3f)), Isa::Set(88.3f));
+    Float n = Isa::Round(Isa::Mul(x, Isa::Set(1.44269504f)));
+    Float r = Isa::MulAdd(n, Isa::Set(-0.693359375f), x);
+    r = Isa::MulAdd(n, Isa::Set(2.12194440e-4f), r);
+
+    Float p = Isa::MulAdd(r, Isa::Set(1.9875691500e-4f), Isa::Set(1.3981999507e-3f));
+    p = Isa::MulAdd(r, p, Isa::Set(8.3334519073e-3f));
+    p = Isa::MulAdd(r, p, Isa::Set(4.1665795894e-2f));
+    p = Isa::MulAdd(r, p, Isa::Set(1.6666665459e-1f));
+    p = Isa::MulAdd(r, p, Isa::Set(5.0000001201e-1f));
+    p = Isa::MulAdd(Isa::Mul(r, r), p, Isa::Add(r, Isa::Set(1.0f)));
+
+    return Isa::Mul(p, Isa::Pow2(n));
+  }
+
+  // sqrt(P(k)) / sqrt(2), P being the Phillips spectrum
+  inline float PhillipsAmplitude(float kx, float ky, const SpectrumParams& params)
+  {
+    float ksqr = kx * kx + ky * ky;
+    if (ksqr == 0.0f) {
+      return 0.0f;
+    }
+    float hcos = kx * params.windX + ky * params.windZ;
+    float P = params.A * (ScalarExp(-1.0f / (ksqr * params.L * params.L)) / (ksqr * ksqr * ksqr)) * (hcos * hcos);
+
+    // Filter out waves moving opposite to wind
+    if (hcos < 0.0f) {
+      P *= params.S;
+    }
+    return INV_SQRT2 * ScalarSqrt(P * ScalarExp(-ksqr * params.l * params.l));
+  }
+
+  template <class Isa>
+  typename Isa::Float PhillipsAmplitude(typename Isa::Float kx, typename Isa::Float ky, const SpectrumParams& params)
+  {
+    typedef typename Isa::Float Float;
+
+    Float ksqr = Isa::MulAdd(kx, kx, Isa::Mul(ky, ky));
+    Float ksafe = Isa::Max(ksqr, Isa::Set(1e-20f));
+    Float hcos = Isa::MulAdd(kx, Isa::Set(params.windX), Isa::Mul(ky, Isa::Set(params.windZ)));
+
+    Float ksqr3 = Isa::Mul(Isa::Mul(ksafe, ksafe), ksafe);
+    Float P = Exp<Isa>(Isa::Div(Isa::Set(-1.0f), Isa::Mul(ksafe, Isa::Set(params.L * params.L))));
+    P = Isa::Mul(Isa::Div(Isa::Mul(Isa::Set(params.A), P), ksqr3), Isa::Mul(hcos, hcos));
+    P = Isa::Select(Isa::Less(hcos, Isa::Set(0.0f)), Isa::Mul(P, Isa::Set(params.S)), P);
+    P = Isa::Mul(P, Exp<Isa>(Isa::Mul(ksafe, Isa::Set(-params.l * params.l))));
+
+    P = Isa::Select(Isa::Less(ksqr, Isa::Set(1e-20f)), Isa::Set(0.0f), P);
+    return Isa::Mul(Isa::Set(INV_SQRT2), Isa::Sqrt(P));
+  }
+
+  template <class Isa, class Grid>
+  void InitSpectrum(const KernelGrid& kernelGrid, const SpectrumParams& params, const XMFLOAT2* gauss, XMFLOAT2* h0k,
+    float* wk, float* terms)
+  {
+    typedef typename Isa::Float Float;
+    Grid grid(kernelGrid);
+
+    const float scaleX = XM_2PI / kernelGrid.patchLengthX;
+    const float scaleY = XM_2PI / kernelGrid.patchLengthY;
+
+    // ~h0(k), a complex to each pair of lanes
+    for (int y = 0; y < grid.DimY(); ++y)
+    {
+      float ky = scaleY * SignedFrequency(y, grid.DimY());
+      const float* g = reinterpret_cast<const float*>(gauss + y * grid.DimX());
+      float* h = reinterpret_cast<float*>(h0k + y * grid.DimX());
+
+      int x = 0;
+      for (; x + Isa::WIDTH / 2 <= grid.DimX(); x += Isa::WIDTH / 2)
+      {
+        Float i = Isa::Add(Isa::Set(static_cast<float>(x)), Isa::Load(PAIR_INDEX));
+        i = Isa::Select(Isa::Less(Isa::Set(grid.DimX() / 2 + 0.5f), i), Isa::Sub(i, Isa::Set(static_cast<float>(grid.DimX()))), i);
+
+        Float amplitude = PhillipsAmplitude<Isa>(Isa::Mul(i, Isa::Set(scaleX)), Isa::Set(ky), params);
+        Isa::Store(h + 2 * x, Isa::Mul(Isa::Load(g + 2 * x), amplitude));
+      }
+      for (; x < grid.DimX(); ++x)
+      {
+        float amplitude = PhillipsAmplitude(scaleX * SignedFrequency(x, grid.DimX()), ky, params);
+        h0k[y * grid.DimX() + x].x = gauss[y * grid.DimX() + x].x * amplitude;
+        h0k[y * grid.DimX() + x].y = gauss[y * grid.DimX() + x].y * amplitude;
+      }
+    }
+
+    // omega(k) = sqrt(g|k|), a wavenumber to each lane
+    for (int y = 0; y < grid.DimY(); ++y)
+    {
+      float ky = scaleY * SignedFrequency(y, grid.DimY());
+      float* w = wk + y * grid.SpectrumDimX();
+
+      int x = 0;
+      for (; x + Isa::WIDTH <= grid.SpectrumDimX(); x += Isa::WIDTH)
+      {
+        Float kx = Isa::Mul(Isa::Add(Isa::Set(static_cast<float>(x)), Isa::Load(LANE_INDEX)), Isa::Set(scaleX));
+        Float k = Isa::Sqrt(Isa::MulAdd(kx, kx, Isa::Set(ky * ky)));
+        Isa::Store(w + x, Isa::Sqrt(Isa::Mul(k, Isa::Set(params.gravity))));
+      }
+      for (; x < grid.SpectrumDimX(); ++x)
+      {
+        float kx = scaleX * x;
+        w[x] = ScalarSqrt(params.gravity * ScalarSqrt(kx * kx + ky * ky));
+      }
+    }
+
+    // The evolution terms, reading h0(-k) once here rather than every frame
+    int size = grid.SpectrumDimX() * grid.DimY();
+    for (int y = 0; y < grid.DimY(); ++y)
+    {
+      const XMFLOAT2* h0Row = h0k + y * grid.DimX();
+      const XMFLOAT2* h0MinusRow = h0k + grid.WrapY(-y) * grid.DimX();
+
+      for (int x = 0; x < grid.SpectrumDimX(); ++x)
+      {
+        XMFLOAT2 h0 = h0Row[x];
+        XMFLOAT2 h0m = h0MinusRow[grid.WrapX(-x)];
+
+        int i = y * grid.SpectrumDimX() + x;
+        terms[i] = h0.x + h0m.x;
+        terms[size + i] = h0.y + h0m.y;
+        terms[2 * size + i] = h0.x - h0m.x;
+        terms[3 * size + i] = h0.y - h0m.y;
+      }
+    }
+  }
+
+  /*
+    h(k,t) = re + i im with re = sumRe cos(wt) - sumIm sin(wt) and im = difRe sin(wt) + difIm cos(wt), so its
+    time derivative is w (-(sumRe sin + sumIm cos), difRe cos - difIm sin), and its second -w^2 h(k,t). Both are
+    exact, and cost no more sines or cosines.
+  */
+  template <class Isa, class Grid, bool Velocity, bool Acceleration>
+  void EvolveSpectrum(const KernelGrid& kernelGrid, const float* terms, const float* wk, float time, float timeScale,
+    fftwf_complex* hkt, fftwf_complex* velocity, fftwf_complex* acceleration)
+  {
+    typedef typename Isa::Float Float;
+    Grid grid(kernelGrid);
+
+    // The half spectrum is contiguous, so it's evolved as one flat run of wavenumbers
+    const int size = grid.SpectrumDimX() * grid.DimY();
+    const float* sumRe = terms;
+    const float* sumIm = terms + size;
+    const float* difRe = terms + 2 * size;
+    const float* difIm = terms + 3 * size;
+    float* h = reinterpret_cast<float*>(hkt);
+    float* v = reinterpret_cast<float*>(velocity);
+    float* a = reinterpret_cast<float*>(acceleration);
+
+    int i = 0;
+    for (; i + Isa::WIDTH <= size; i += Isa::WIDTH)
+    {
+      Float w = Isa::Load(wk + i);
+      Float sin, cos;
+      SinCos<Isa>(Isa::Mul(w, Isa::Set(time)), &sin, &cos);
+
+      Float re = Isa::Sub(Isa::Mul(Isa::Load(sumRe + i), cos), Isa::Mul(Isa::Load(sumIm + i), sin));
+      Float im = Isa::MulAdd(Isa::Load(difRe + i), sin, Isa::Mul(Isa::Load(difIm + i), cos));
+      Isa::StoreInterleaved(h + 2 * i, re, im);
+
+      Float rate = Isa::Mul(w, Isa::Set(timeScale));
+      if (Velocity)
+      {
+        Float vre = Isa::Mul(Isa::Sub(Isa::Set(0.0f), rate), Isa::MulAdd(Isa::Load(sumRe + i), sin, Isa::Mul(Isa::Load(sumIm + i), cos)));
+        Float vim = Isa::Mul(rate, Isa::Sub(Isa::Mul(Isa::Load(difRe + i), cos), Isa::Mul(Isa::Load(difIm + i), sin)));
+        Isa::StoreInterleaved(v + 2 * i, vre, vim);
+      }
+      if (Acceleration)
+      {
+        Float scale = Isa::Sub(Isa::Set(0.0f), Isa::Mul(rate, rate));
+        Isa::StoreInterleaved(a + 2 * i, Isa::Mul(scale, re), Isa::Mul(scale, im));
+      }
+    }
+    for (; i < size; ++i)
+    {
+      float sin = ScalarSin(wk[i] * time);
+      float cos = ScalarCos(wk[i] * time);
+
+      hkt[i][0] = sumRe[i] * cos - sumIm[i] * sin;
+      hkt[i][1] = difRe[i] * sin + difIm[i] * cos;
+
+      float rate = wk[i] * timeScale;
+      if (Velocity)
+      {
+        velocity[i][0] = -rate * (sumRe[i] * sin + sumIm[i] * cos);
+        velocity[i][1] = rate * (difRe[i] * cos - difIm[i] * sin);
+      }
+      if (Acceleration)
+      {
+        acceleration[i][0] = -rate * rate * hkt[i][0];
+        acceleration[i][1] = -rate * rate * hkt[i][1];
+      }
+    }
+  }
+
+  // Pick the variant once per call, as DeriveChannels does
+  template <class Isa, class Grid>
+  void EvolveSpectrum(const KernelGrid& kernelGrid, const float* terms, const float* wk, float time, float timeScale,
+    fftwf_complex* hkt, fftwf_complex* velocity, fftwf_complex* acceleration)
+  {
+    if (velocity && acceleration) {
+      EvolveSpectrum<Isa, Grid, true, true>(kernelGrid, terms, wk, time, timeScale, hkt, velocity, acceleration);
+    }
+    else if (velocity) {
+      EvolveSpectrum<Isa, Grid, true, false>(kernelGrid, terms, wk, time, timeScale, hkt, velocity, acceleration);
+    }
+    else if (acceleration) {
+      EvolveSpectrum<Isa, Grid, false, true>(kernelGrid, terms, wk, time, timeScale, hkt, velocity, acceleration);
+    }
+    else {
+      EvolveSpectrum<Isa, Grid, false, false>(kernelGrid, terms, wk, time, timeScale, hkt, velocity, acceleration);
+    }
+  }
+
+  template <class Isa, class Grid, bool Displacement, bool Slopes>
+  void DeriveChannels(const KernelGrid& kernelGrid, const fftwf_complex* hkt, fftwf_complex* Dx, fftwf_complex* Dz,
+    fftwf_complex* nx, fftwf_complex* nz)
+  {
+    typedef typename Isa::Float Float;
+    Grid grid(kernelGrid);
+
+    const float scaleX = XM_2PI / kernelGrid.patchLengthX;
+    const float scaleY = XM_2PI / kernelGrid.patchLengthY;
+
+    for (int y = 0; y < grid.DimY(); ++y)
+    {
+      float ky = scaleY * SignedFrequency(y, grid.DimY());
+      int row = y * grid.SpectrumDimX();
+
+      // The half spectrum only holds the non-negative x frequencies, a complex to each pair of lanes
+      int x = 0;
+      for (; x + Isa::WIDTH / 2 <= grid.SpectrumDimX(); x += Isa::WIDTH / 2)
+      {
+        Float kx = Isa::Mul(Isa::Add(Isa::Set(static_cast<float>(x)), Isa::Load(PAIR_INDEX)), Isa::Set(scaleX));
+
+        // -i h(k,t) = (im, -re)
+        Float h = Isa::Mul(Isa::SwapPairs(Isa::Load(hkt[row + x])), Isa::Load(PAIR_SIGN));
+
+        if (Displacement)
+        {
+          Float ksqr = Isa::MulAdd(kx, kx, Isa::Set(ky * ky));
+          Float krsqr = Isa::Select(Isa::Less(Isa::Set(1e-12f), ksqr), Isa::Div(Isa::Set(1.0f), Isa::Sqrt(ksqr)), Isa::Set(0.0f));
+
+          Isa::Store(Dx[row + x], Isa::Mul(Isa::Mul(kx, krsqr), h));
+          Isa::Store(Dz[row + x], Isa::Mul(Isa::Mul(Isa::Set(ky), krsqr), h));
+        }
+        if (Slopes)
+        {
+          Isa::Store(nx[row + x], Isa::Mul(Isa::Sub(Isa::Set(0.0f), kx), h));
+          Isa::Store(nz[row + x], Isa::Mul(Isa::Set(-ky), h));
+        }
+      }
+      for (; x < grid.SpectrumDimX(); ++x)
+      {
+        float kx = scaleX * x;
+        const fftwf_complex& h = hkt[row + x];
+
+        if (Displacement)
+        {
+          float ksqr = kx * kx + ky * ky;
+          float krsqr = (ksqr > 1e-12f) ? 1.0f / ScalarSqrt(ksqr) : 0.0f;
+
+          Dx[row + x][0] = kx * krsqr * h[1];
+          Dx[row + x][1] = kx * krsqr * -h[0];
+
+          Dz[row + x][0] = ky * krsqr * h[1];
+          Dz[row + x][1] = ky * krsqr * -h[0];
+        }
+        if (Slopes)
+        {
+          nx[row + x][0] = kx * -h[1];
+          nx[row + x][1] = kx * h[0];
+
+          nz[row + x][0] = ky * -h[1];
+          nz[row + x][1] = ky * h[0];
+        }
+      }
+    }
+  }
+
+  // Pick the variant once per call so that the inner loop has no channel tests left in it
+  template <class Isa, class Grid>
+  void DeriveChannels(const KernelGrid& kernelGrid, const fftwf_complex* hkt, fftwf_complex* Dx, fftwf_complex* Dz,
+    fftwf_complex* nx, fftwf_complex* nz)
+  {
+    if (Dx && nx) {
+      DeriveChannels<Isa, Grid, true, true>(kernelGrid, hkt, Dx, Dz, nx, nz);
+    }
+    else if (Dx) {
+      DeriveChannels<Isa, Grid, true, false>(kernelGrid, hkt, Dx, Dz, nx, nz);
+    }
+    else if (nx) {
+      DeriveChannels<Isa, Grid, false, true>(kernelGrid, hkt, Dx, Dz, nx, nz);
+    }
+  }
+
+  template <class Isa>
+  void WriteVertices(const float* heights, int heightStride, const XMFLOAT2* disp, const XMFLOAT2* slopes, int count,
+    float choppiness, VertexDispNor* vertices)
+  {
+    typedef typename Isa::Float Float;
+
+    // Displacements are copies, so they're left to the compiler
+    for (int i = 0; heights && i < count; ++i) {
+      vertices[i].Disp.y = heights[i * heightStride];
+    }
+    for (int i = 0; disp && i < count; ++i)
+    {
+      vertices[i].Disp.x = choppiness * disp[i].x;
+      vertices[i].Disp.z = choppiness * disp[i].y;
+    }
+    if (!slopes) {
+      return;
+    }
+
+    // The normal of y = h(x, z) is (-dh/dx, 1, -dh/dz) normalised, a slope pair to each pair of lanes
+    float normal[Isa::WIDTH];
+
+    int i = 0;
+    for (; i + Isa::WIDTH / 2 <= count; i += Isa::WIDTH / 2)
+    {
+      Float s = Isa::Load(&slopes[i].x);
+      Float s2 = Isa::Mul(s, s);
+      Float inverseLength = Isa::Div(Isa::Set(1.0f), Isa::Sqrt(Isa::Add(Isa::Set(1.0f), Isa::Add(s2, Isa::SwapPairs(s2)))));
+
+      Isa::Store(normal, Isa::Mul(Isa::Sub(Isa::Set(0.0f), s), inverseLength));
+
+      // Only x and z are streamed, which are already paired
+      for (int j = 0; j < Isa::WIDTH / 2; ++j)
+      {
+        vertices[i + j].Nor.x = normal[2 * j];
+        vertices[i + j].Nor.y = normal[2 * j + 1];
+      }
+    }
+    for (; i < count; ++i)
+    {
+      float length = ScalarSqrt(slopes[i].x * slopes[i].x + 1.0f + slopes[i].y * slopes[i].y);
+
+      vertices[i].Nor.x = -slopes[i].x / length;
+      vertices[i].Nor.y = -slopes[i].y / length;
+    }
+  }
+
+  /*
+    A heightfield's normal is always in the upper hemisphere, where the octahedral encoding is the normal
+    divided by its L1 norm, projected onto xz. That fills a diamond, which is rotated 45 degrees (and scaled)
+    to fill the square so that every code is used.
+  */
+  template <class Isa>
+  void PackVertices(const VertexDispNor* vertices, int count, const XMFLOAT3& inverseScale, int normalBits,
+    void* packed, XMFLOAT3* maxDisp)
+  {
+    typedef typename Isa::Float Float;
+
+    // One array per component, transposed from and back to the interleaved vertices
+    float in[5][Isa::WIDTH], out[5][Isa::WIDTH];
+
+    Float one = Isa::Set(1.0f), minusOne = Isa::Set(-1.0f);
+    Float dispRange = Isa::Set(32767.0f);
+    Float normalRange = Isa::Set(normalBits == 8 ? 127.0f : 32767.0f);
+    Float maxX = Isa::Set(0.0f), maxY = Isa::Set(0.0f), maxZ = Isa::Set(0.0f);
+
+    for (int i = 0; i < count; i += Isa::WIDTH)
+    {
+      int n = min(static_cast<int>(Isa::WIDTH), count - i);
+
+      // The tail is padded with a flat vertex
+      const float* v = reinterpret_cast<const float*>(vertices + i);
+      for (int j = 0; j < Isa::WIDTH; ++j)
+      {
+        for (int c = 0; c < 5; ++c) {
+          in[c][j] = (j < n) ? v[j * 5 + c] : 0.0f;
+        }
+      }
+
+      Float dx = Isa::Load(in[0]), dy = Isa::Load(in[1]), dz = Isa::Load(in[2]);
+      maxX = Isa::Max(maxX, Abs<Isa>(dx));
+      maxY = Isa::Max(maxY, Abs<Isa>(dy));
+      maxZ = Isa::Max(maxZ, Abs<Isa>(dz));
+
+      dx = Isa::Min(Isa::Max(Isa::Mul(dx, Isa::Set(inverseScale.x)), minusOne), one);
+      dy = Isa::Min(Isa::Max(Isa::Mul(dy, Isa::Set(inverseScale.y)), minusOne), one);
+      dz = Isa::Min(Isa::Max(Isa::Mul(dz, Isa::Set(inverseScale.z)), minusOne), one);
+      Isa::Store(out[0], Isa::Round(Isa::Mul(dx, dispRange)));
+      Isa::Store(out[1], Isa::Round(Isa::Mul(dy, dispRange)));
+      Isa::Store(out[2], Isa::Round(Isa::Mul(dz, dispRange)));
+
+      // The streamed normal is only x and z, so y is put back first
+      Float nx = Isa::Load(in[3]), nz = Isa::Load(in[4]);
+      Float ny = Isa::Sqrt(Isa::Max(Isa::Set(0.0f), Isa::Sub(one, Isa::MulAdd(nx, nx, Isa::Mul(nz, nz)))));
+      Float inverseL1 = Isa::Div(one, Isa::Add(Isa::Add(Abs<Isa>(nx), ny), Abs<Isa>(nz)));
+      Float u = Isa::Mul(nx, inverseL1), w = Isa::Mul(nz, inverseL1);
+      Isa::Store(out[3], Isa::Round(Isa::Mul(Isa::Add(u, w), normalRange)));
+      Isa::Store(out[4], Isa::Round(Isa::Mul(Isa::Sub(u, w), normalRange)));
+
+      if (normalBits == 8)
+      {
+        VertexDispNorPacked8* p = static_cast<VertexDispNorPacked8*>(packed) + i;
+        for (int j = 0; j < n; ++j)
+        {
+          p[j].Disp[0] = static_cast<SHORT>(out[0][j]);
+          p[j].Disp[1] = static_cast<SHORT>(out[1][j]);
+          p[j].Disp[2] = static_cast<SHORT>(out[2][j]);
+          p[j].Nor[0] = static_cast<CHAR>(out[3][j]);
+          p[j].Nor[1] = static_cast<CHAR>(out[4][j]);
+        }
+      }
+      else
+      {
+        VertexDispNorPacked16* p = static_cast<VertexDispNorPacked16*>(packed) + i;
+        for (int j = 0; j < n; ++j)
+        {
+          p[j].Disp[0] = static_cast<SHORT>(out[0][j]);
+          p[j].Disp[1] = static_cast<SHORT>(out[1][j]);
+          p[j].Disp[2] = static_cast<SHORT>(out[2][j]);
+          p[j].Nor[0] = static_cast<SHORT>(out[3][j]);
+          p[j].Nor[1] = static_cast<SHORT>(out[4][j]);
+          p[j].Pad = 0;
+        }
+      }
+    }
+
+    Isa::Store(out[0], maxX);
+    Isa::Store(out[1], maxY);
+    Isa::Store(out[2], maxZ);
+    for (int j = 0; j < Isa::WIDTH; ++j)
+    {
+      maxDisp->x = max(maxDisp->x, out[0][j]);
+      maxDisp->y = max(maxDisp->y, out[1][j]);
+      maxDisp->z = max(maxDisp->z, out[2][j]);
+    }
+  }
+
+  template <class Isa>
+  void ProjectRays(const XMFLOAT4& nearStart, const XMFLOAT4& nearStep, const XMFLOAT4& farStart, const XMFLOAT4& farStep,
+    int count, XMFLOAT2* hits)
+  {
+    typedef typename Isa::Float Float;
+
+    Float zero = Isa::Set(0.0f), one = Isa::Set(1.0f);
+
+    int i = 0;
+    for (; i + Isa::WIDTH <= count; i += Isa::WIDTH)
+    {
+      Float lane = Isa::Add(Isa::Set(static_cast<float>(i)), Isa::Load(LANE_INDEX));
+
+      // Divide through by w, then step from the near end towards the far one until y = 0
+      Float inverseNearW = Isa::Div(one, Isa::MulAdd(lane, Isa::Set(nearStep.w), Isa::Set(nearStart.w)));
+      Float inverseFarW = Isa::Div(one, Isa::MulAdd(lane, Isa::Set(farStep.w), Isa::Set(farStart.w)));
+      Float nx = Isa::Mul(Isa::MulAdd(lane, Isa::Set(nearStep.x), Isa::Set(nearStart.x)), inverseNearW);
+      Float ny = Isa::Mul(Isa::MulAdd(lane, Isa::Set(nearStep.y), Isa::Set(nearStart.y)), inverseNearW);
+      Float nz = Isa::Mul(Isa::MulAdd(lane, Isa::Set(nearStep.z), Isa::Set(nearStart.z)), inverseNearW);
+      Float dx = Isa::Sub(Isa::Mul(Isa::MulAdd(lane, Isa::Set(farStep.x), Isa::Set(farStart.x)), inverseFarW), nx);
+      Float dy = Isa::Sub(Isa::Mul(Isa::MulAdd(lane, Isa::Set(farStep.y), Isa::Set(farStart.y)), inverseFarW), ny);
+      Float dz = Isa::Sub(Isa::Mul(Isa::MulAdd(lane, Isa::Set(farStep.z), Isa::Set(farStart.z)), inverseFarW), nz);
+
+      Float t = Isa::Select(Isa::Less(dy, zero), Isa::Div(Isa::Sub(zero, ny), dy), one);
+      t = Isa::Min(Isa::Max(t, zero), one);
+
+      Isa::StoreInterleaved(&hits[i].x, Isa::MulAdd(t, dx, nx), Isa::MulAdd(t, dz, nz));
+    }
+    for (; i < count; ++i)
+    {
+      float inverseNearW = 1.0f / (nearStart.w + i * nearStep.w);
+      float inverseFarW = 1.0f / (farStart.w + i * farStep.w);
+      float nx = (nearStart.x + i * nearStep.x) * inverseNearW;
+      float ny = (nearStart.y + i * nearStep.y) * inverseNearW;
+      float nz = (nearStart.z + i * nearStep.z) * inverseNearW;
+      float dx = (farStart.x + i * farStep.x) * inverseFarW - nx;
+      float dy = (farStart.y + i * farStep.y) * inverseFarW - ny;
+      float dz = (farStart.z + i * farStep.z) * inverseFarW - nz;
+
+      float t = (dy < 0.0f) ? -ny / dy : 1.0f;
+      t = min(max(t, 0.0f), 1.0f);
+
+      StoreFloat2(&hits[i], nx + t * dx, nz + t * dz);
+    }
+  }
+
+  // A texel coordinate wrapped into a heightmap size texels across, as the cell it lies in and how far across that the
+  // coordinate is. Rounding can leave the wrapped coordinate just outside [0, size), either side, so the cell is brought
+  // back into range, its weight then being (nearly) 0 or 1, and never indexes outside the heightmap.
+  template <class Isa>
+  void WrapTexel(typename Isa::Float t, typename Isa::Float size, typename Isa::Float inverseSize, typename Isa::Float* cell,
+    typename Isa::Float* weight)
+  {
+    typedef typename Isa::Float Float;
+
+    t = Isa::Sub(t, Isa::Mul(Floor<Isa>(Isa::Mul(t, inverseSize)), size));
+    Float c = Floor<Isa>(t);
+    *weight = Isa::Sub(t, c);
+    *cell = Isa::Select(Isa::Less(c, Isa::Set(0.0f)), Isa::Add(c, size), Isa::Select(Isa::Less(c, size), c, Isa::Sub(c, size)));
+  }
+
+  /*
+    The texel coordinates and weights are vectorised, and the four corners gathered lane by lane into one
+    array per component so that the blend is too.
+  */
+  template <class Isa>
+  void SampleHeightmap(const VertexDispNor* heightmap, int dimX, int dimY, const XMFLOAT2& origin, float spacing,
+    const XMFLOAT2* positions, int count, VertexDispNor* samples)
+  {
+    typedef typename Isa::Float Float;
+
+    float x[Isa::WIDTH], z[Isa::WIDTH], cellX[Isa::WIDTH], cellZ[Isa::WIDTH];
+    float corners[4][5][Isa::WIDTH], out[5][Isa::WIDTH];
+
+    Float inverseSpacing = Isa::Set(1.0f / spacing);
+    Float width = Isa::Set(static_cast<float>(dimX)), height = Isa::Set(static_cast<float>(dimY));
+    Float inverseWidth = Isa::Set(1.0f / dimX), inverseHeight = Isa::Set(1.0f / dimY);
+
+    for (int i = 0; i < count; i += Isa::WIDTH)
+    {
+      int n = min(static_cast<int>(Isa::WIDTH), count - i);
+
+      // The tail is padded with the last position
+      for (int j = 0; j < Isa::WIDTH; ++j)
+      {
+        x[j] = positions[i + min(j, n - 1)].x;
+        z[j] = positions[i + min(j, n - 1)].y;
+      }
+
+      // Into texels, wrapped into the heightmap
+      Float fx, fz, wx, wz;
+      WrapTexel<Isa>(Isa::Mul(Isa::Sub(Isa::Load(x), Isa::Set(origin.x)), inverseSpacing), width, inverseWidth, &fx, &wx);
+      WrapTexel<Isa>(Isa::Mul(Isa::Sub(Isa::Load(z), Isa::Set(origin.y)), inverseSpacing), height, inverseHeight, &fz, &wz);
+      Isa::Store(cellX, fx);
+      Isa::Store(cellZ, fz);
+
+      for (int j = 0; j < Isa::WIDTH; ++j)
+      {
+        int x0 = static_cast<int>(cellX[j]), z0 = static_cast<int>(cellZ[j]);
+        int x1 = (x0 + 1 == dimX) ? 0 : x0 + 1;
+        int z1 = (z0 + 1 == dimY) ? 0 : z0 + 1;
+
+        const float* v[4] =
+        {
+          reinterpret_cast<const float*>(heightmap + x0 + z0 * dimX), reinterpret_cast<const float*>(heightmap + x1 + z0 * dimX),
+          reinterpret_cast<const float*>(heightmap + x0 + z1 * dimX), reinterpret_cast<const float*>(heightmap + x1 + z1 * dimX)
+        };
+        for (int k = 0; k < 4; ++k)
+        {
+          for (int c = 0; c < 5; ++c) {
+            corners[k][c][j] = v[k][c];
+          }
+        }
+      }
+
+      for (int c = 0; c < 5; ++c)
+      {
+        Float c00 = Isa::Load(corners[0][c]), c10 = Isa::Load(corners[1][c]);
+        Float c01 = Isa::Load(corners[2][c]), c11 = Isa::Load(corners[3][c]);
+        Float bottom = Isa::MulAdd(wx, Isa::Sub(c10, c00), c00);
+        Float top = Isa::MulAdd(wx, Isa::Sub(c11, c01), c01);
+        Isa::Store(out[c], Isa::MulAdd(wz, Isa::Sub(top, bottom), bottom));
+      }
+
+      float* s = reinterpret_cast<float*>(samples + i);
+      for (int j = 0; j < n; ++j)
+      {
+        for (int c = 0; c < 5; ++c) {
+          s[j * 5 + c] = out[c][j];
+        }
+      }
+    }
+  }
+
+  /*
+    Where a vector of (x, z) positions fall in the periodic heightmap, as the indices of the vertices at the
+    corners of their quads (as floats, which hold them exactly) and the weights between them, and the bilinear
+    blend of any component gathered from those corners.
+  */
+  template <class Isa>
+  struct HeightmapCells
+  {
+    typedef typename Isa::Float Float;
+
+    HeightmapCells(int dimX, int dimY, const XMFLOAT2& origin, float spacing)
+    {
+      originX = Isa::Set(origin.x);
+      originZ = Isa::Set(origin.y);
+      inverseSpacing = Isa::Set(1.0f / spacing);
+      width = Isa::Set(static_cast<float>(dimX));
+      height = Isa::Set(static_cast<float>(dimY));
+      inverseWidth = Isa::Set(1.0f / dimX);
+      inverseHeight = Isa::Set(1.0f / dimY);
+    }
+
+    void Locate(Float x, Float z)
+    {
+      Float zero = Isa::Set(0.0f), one = Isa::Set(1.0f);
+
+      // Into texels, wrapped into the heightmap
+      Float x0, z0;
+      WrapTexel<Isa>(Isa::Mul(Isa::Sub(x, originX), inverseSpacing), width, inverseWidth, &x0, &wx);
+      WrapTexel<Isa>(Isa::Mul(Isa::Sub(z, originZ), inverseSpacing), height, inverseHeight, &z0, &wz);
+      Float x1 = Isa::Add(x0, one), z1 = Isa::Add(z0, one);
+      x1 = Isa::Select(Isa::Less(x1, width), x1, zero);
+      z1 = Isa::Select(Isa::Less(z1, height), z1, zero);
+
+      Float row0 = Isa::Mul(z0, width), row1 = Isa::Mul(z1, width);
+      i00 = Isa::Add(row0, x0);
+      i10 = Isa::Add(row0, x1);
+      i01 = Isa::Add(row1, x0);
+      i11 = Isa::Add(row1, x1);
+    }
+
+    // A component of the located vertices, the first at base and stride floats apart
+    Float Sample(const float* base, int stride) const
+    {
+      Float c00 = Isa::Gather(base, i00, stride), c10 = Isa::Gather(base, i10, stride);
+      Float c01 = Isa::Gather(base, i01, stride), c11 = Isa::Gather(base, i11, stride);
+      Float bottom = Isa::MulAdd(wx, Isa::Sub(c10, c00), c00);
+      Float top = Isa::MulAdd(wx, Isa::Sub(c11, c01), c01);
+      return Isa::MulAdd(wz, Isa::Sub(top, bottom), bottom);
+    }
+
+    // The same, and its derivatives in x and z across the quad
+    Float Sample(const float* base, int stride, Float* ddx, Float* ddz) const
+    {
+      Float c00 = Isa::Gather(base, i00, stride), c10 = Isa::Gather(base, i10, stride);
+      Float c01 = Isa::Gather(base, i01, stride), c11 = Isa::Gather(base, i11, stride);
+      Float bottomRise = Isa::Sub(c10, c00), topRise = Isa::Sub(c11, c01);
+      Float bottom = Isa::MulAdd(wx, bottomRise, c00);
+      Float top = Isa::MulAdd(wx, topRise, c01);
+      *ddx = Isa::Mul(Isa::MulAdd(wz, Isa::Sub(topRise, bottomRise), bottomRise), inverseSpacing);
+      *ddz = Isa::Mul(Isa::Sub(top, bottom), inverseSpacing);
+      return Isa::MulAdd(wz, Isa::Sub(top, bottom), bottom);
+    }
+
+    Float originX, originZ, inverseSpacing;
+    Float width, height, inverseWidth, inverseHeight;
+    Float i00, i10, i01, i11; // The corners' indices
+    Float wx, wz;
+  };
+
+  // Load WIDTH positions, the tail padded with the last one
+  template <class Isa>
+  void LoadPositions(const XMFLOAT2* positions, int n, typename Isa::Float* x, typename Isa::Float* z)
+  {
+    float tail[2 * Isa::WIDTH];
+    const float* p = &positions->x;
+    if (n < Isa::WIDTH)
+    {
+      for (int j = 0; j < Isa::WIDTH; ++j)
+      {
+        tail[2 * j] = positions[min(j, n - 1)].x;
+        tail[2 * j + 1] = positions[min(j, n - 1)].y;
+      }
+      p = tail;
+    }
+    Isa::LoadInterleaved(p, x, z);
+  }
+
+  // Store the first n lanes of heights and, unless normals is NULL, the unit normals with x and z blended from the
+  // vertices and the y that makes them unit length, as the vertex shader does
+  template <class Isa>
+  void StoreHeights(const HeightmapCells<Isa>& cells, const VertexDispNor* heightmap, int n, float* heights, XMFLOAT3* normals)
+  {
+    typedef typename Isa::Float Float;
+
+    const int stride = sizeof(VertexDispNor) / sizeof(float);
+    float out[3][Isa::WIDTH];
+
+    Float h = cells.Sample(&heightmap[0].Disp.y, stride);
+    if (n == Isa::WIDTH) {
+      Isa::Store(heights, h);
+    }
+    else
+    {
+      Isa::Store(out[0], h);
+      for (int j = 0; j < n; ++j) {
+        heights[j] = out[0][j];
+      }
+    }
+
+    if (normals)
+    {
+      Float nx = cells.Sample(&heightmap[0].Nor.x, stride), nz = cells.Sample(&heightmap[0].Nor.y, stride);
+      Float ny = Isa::Sqrt(Isa::Max(Isa::Sub(Isa::Set(1.0f), Isa::MulAdd(nx, nx, Isa::Mul(nz, nz))), Isa::Set(0.0f)));
+      Isa::Store(out[0], nx);
+      Isa::Store(out[1], ny);
+      Isa::Store(out[2], nz);
+      for (int j = 0; j < n; ++j) {
+        StoreFloat3(&normals[j], out[0][j], out[1][j], out[2][j]);
+      }
+    }
+  }
+
+  /*
+    As SampleHeightmap, but with the corners' indices kept in vectors and only the components asked for
+    gathered straight from the vertices, so nothing goes lane by lane but the tail and the normals' stores.
+  */
+  template <class Isa>
+  void SampleHeights(const VertexDispNor* heightmap, int dimX, int dimY, const XMFLOAT2& origin, float spacing,
+    const XMFLOAT2* positions, int count, float* heights, XMFLOAT3* normals)
+  {
+    typedef typename Isa::Float Float;
+
+    HeightmapCells<Isa> cells(dimX, dimY, origin, spacing);
+
+    for (int i = 0; i < count; i += Isa::WIDTH)
+    {
+      int n = min(static_cast<int>(Isa::WIDTH), count - i);
+
+      Float x, z;
+      LoadPositions<Isa>(positions + i, n, &x, &z);
+      cells.Locate(x, z);
+      StoreHeights<Isa>(cells, heightmap, n, heights + i, normals ? normals + i : NULL);
+    }
+  }
+
+  /*
+    The vertex displaced onto target t lies at the p where p + D(p) = t, D being the blended horizontal
+    displacement. Starting from p = t, each step solves the bilinear blend's linearisation about p, a Newton
+    step, or where its Jacobian (1 + dDx/dx)(1 + dDz/dz) - (dDx/dz)(dDz/dx) is near zero or negative, because
+    the surface is folding there and the Newton step would shoot off, takes the fixed-point step p = t - D(p)
+    instead. Lanes that have converged stop moving, and the vector stops once they all have.
+  */
+  template <class Isa>
+  void SampleDisplacedHeights(const VertexDispNor* heightmap, int dimX, int dimY, const XMFLOAT2& origin, float spacing,
+    const XMFLOAT2* positions, int count, int maxIterations, float tolerance, float* heights, XMFLOAT3* normals,
+    int* iterations, float* residuals)
+  {
+    typedef typename Isa::Float Float;
+
+    const int stride = sizeof(VertexDispNor) / sizeof(float);
+    float out[2][Isa::WIDTH];
+
+    HeightmapCells<Isa> cells(dimX, dimY, origin, spacing);
+    Float zero = Isa::Set(0.0f), one = Isa::Set(1.0f);
+    Float toleranceSq = Isa::Set(tolerance * tolerance), minJacobian = Isa::Set(0.1f);
+
+    for (int i = 0; i < count; i += Isa::WIDTH)
+    {
+      int n = min(static_cast<int>(Isa::WIDTH), count - i);
+
+      Float tx, tz;
+      LoadPositions<Isa>(positions + i, n, &tx, &tz);
+
+      Float x = tx, z = tz, steps = zero, residualSq;
+      for (int k = 0; ; ++k)
+      {
+        cells.Locate(x, z);
+        Float dxdx, dxdz, dzdx, dzdz;
+        Float Dx = cells.Sample(&heightmap[0].Disp.x, stride, &dxdx, &dxdz);
+        Float Dz = cells.Sample(&heightmap[0].Disp.z, stride, &dzdx, &dzdz);
+
+        // How far the displaced point misses the target
+        Float fx = Isa::Sub(Isa::Add(x, Dx), tx), fz = Isa::Sub(Isa::Add(z, Dz), tz);
+        residualSq = Isa::MulAdd(fx, fx, Isa::Mul(fz, fz));
+        if (k == maxIterations) {
+          break;
+        }
+
+        typename Isa::Mask converged = Isa::Less(residualSq, toleranceSq);
+        Float moving = Isa::Select(converged, zero, one);
+        Isa::Store(out[0], moving);
+        bool anyMoving = false;
+        for (int j = 0; j < Isa::WIDTH; ++j) {
+          anyMoving = anyMoving || (out[0][j] != 0.0f);
+        }
+        if (!anyMoving) {
+          break;
+        }
+
+        Float j00 = Isa::Add(one, dxdx), j11 = Isa::Add(one, dzdz);
+        Float jacobian = Isa::Sub(Isa::Mul(j00, j11), Isa::Mul(dxdz, dzdx));
+        typename Isa::Mask folding = Isa::Less(jacobian, minJacobian);
+        Float inverse = Isa::Div(one, Isa::Select(folding, one, jacobian));
+        Float newtonX = Isa::Mul(Isa::Sub(Isa::Mul(j11, fx), Isa::Mul(dxdz, fz)), inverse);
+        Float newtonZ = Isa::Mul(Isa::Sub(Isa::Mul(j00, fz), Isa::Mul(dzdx, fx)), inverse);
+        Float stepX = Isa::Select(folding, fx, newtonX), stepZ = Isa::Select(folding, fz, newtonZ);
+
+        x = Isa::Sub(x, Isa::Mul(stepX, moving));
+        z = Isa::Sub(z, Isa::Mul(stepZ, moving));
+        steps = Isa::Add(steps, moving);
+      }
+
+      // The cells are still located at the last point
+      StoreHeights<Isa>(cells, heightmap, n, heights + i, normals ? normals + i : NULL);
+
+      Isa::Store(out[0], steps);
+      Isa::Store(out[1], Isa::Sqrt(residualSq));
+      for (int j = 0; j < n; ++j)
+      {
+        if (iterations) {
+          iterations[i + j] = static_cast<int>(out[0][j]);
+        }
+        if (residuals) {
+          residuals[i + j] = out[1][j];
+        }
+      }
+    }
+  }
+
+  // As SampleHeights, but every component of a field of vectors at the heightmap's vertices
+  template <class Isa>
+  void SampleVectors(const XMFLOAT3* field, int dimX, int dimY, const XMFLOAT2& origin, float spacing, const XMFLOAT2* positions,
+    int count, XMFLOAT3* samples)
+  {
+    typedef typename Isa::Float Float;
+
+    const int stride = sizeof(XMFLOAT3) / sizeof(float);
+    float out[3][Isa::WIDTH];
+
+    HeightmapCells<Isa> cells(dimX, dimY, origin, spacing);
+
+    for (int i = 0; i < count; i += Isa::WIDTH)
+    {
+      int n = min(static_cast<int>(Isa::WIDTH), count - i);
+
+      Float x, z;
+      LoadPositions<Isa>(positions + i, n, &x, &z);
+      cells.Locate(x, z);
+      Isa::Store(out[0], cells.Sample(&field[0].x, stride));
+      Isa::Store(out[1], cells.Sample(&field[0].y, stride));
+      Isa::Store(out[2], cells.Sample(&field[0].z, stride));
+      for (int j = 0; j < n; ++j) {
+        StoreFloat3(&samples[i + j], out[0][j], out[1][j], out[2][j]);
+      }
+    }
+  }
+
+  template <class Isa>
+  void TransformPoints(const float* x, const float* y, const float* z, int count, const XMFLOAT4X4& transform, XMFLOAT2* xz,
+    float* yOut)
+  {
+    typedef typename Isa::Float Float;
+
+    int i = 0;
+    for (; i + Isa::WIDTH <= count; i += Isa::WIDTH)
+    {
+      Float px = Isa::Load(x + i), py = Isa::Load(y + i), pz = Isa::Load(z + i);
+      Float wx = Isa::MulAdd(px, Isa::Set(transform._11), Isa::MulAdd(py, Isa::Set(transform._21),
+        Isa::MulAdd(pz, Isa::Set(transform._31), Isa::Set(transform._41))));
+      Float wy = Isa::MulAdd(px, Isa::Set(transform._12), Isa::MulAdd(py, Isa::Set(transform._22),
+        Isa::MulAdd(pz, Isa::Set(transform._32), Isa::Set(transform._42))));
+      Float wz = Isa::MulAdd(px, Isa::Set(transform._13), Isa::MulAdd(py, Isa::Set(transform._23),
+        Isa::MulAdd(pz, Isa::Set(transform._33), Isa::Set(transform._43))));
+      Isa::StoreInterleaved(&xz[i].x, wx, wz);
+      Isa::Store(yOut + i, wy);
+    }
+    for (; i < count; ++i)
+    {
+      xz[i].x = x[i] * transform._11 + y[i] * transform._21 + z[i] * transform._31 + transform._41;
+      yOut[i] = x[i] * transform._12 + y[i] * transform._22 + z[i] * transform._32 + transform._42;
+      xz[i].y = x[i] * transform._13 + y[i] * transform._23 + z[i] * transform._33 + transform._43;
+    }
+  }
+
+  /*
+    The cube is under water for the fraction f = (surface - (y - radius)) / 2 radius of its height,
+    clamped to [0, 1], so holds 8 radius^3 f of it, centred f radius above its bottom.
+  */
+  template <class Isa>
+  float SubmergedVolume(const XMFLOAT2* xz, const float* y, const float* radius, const float* surface, int count,
+    XMFLOAT3* centroid)
+  {
+    typedef typename Isa::Float Float;
+
+    Float zero = Isa::Set(0.0f), one = Isa::Set(1.0f);
+    Float volume = zero, momentX = zero, momentY = zero, momentZ = zero;
+
+    int i = 0;
+    for (; i + Isa::WIDTH <= count; i += Isa::WIDTH)
+    {
+      Float x, z;
+      Isa::LoadInterleaved(&xz[i].x, &x, &z);
+      Float r = Isa::Load(radius + i);
+      Float bottom = Isa::Sub(Isa::Load(y + i), r);
+      Float f = Isa::Min(Isa::Max(Isa::Div(Isa::Sub(Isa::Load(surface + i), bottom), Isa::Add(r, r)), zero), one);
+      Float v = Isa::Mul(Isa::Mul(Isa::Set(8.0f), Isa::Mul(r, Isa::Mul(r, r))), f);
+
+      volume = Isa::Add(volume, v);
+      momentX = Isa::MulAdd(v, x, momentX);
+      momentY = Isa::MulAdd(v, Isa::MulAdd(f, r, bottom), momentY);
+      momentZ = Isa::MulAdd(v, z, momentZ);
+    }
+
+    float lanes[4][Isa::WIDTH];
+    Isa::Store(lanes[0], volume);
+    Isa::Store(lanes[1], momentX);
+    Isa::Store(lanes[2], momentY);
+    Isa::Store(lanes[3], momentZ);
+    float sums[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int j = 0; j < Isa::WIDTH; ++j)
+    {
+      for (int k = 0; k < 4; ++k) {
+        sums[k] += lanes[k][j];
+      }
+    }
+
+    for (; i < count; ++i)
+    {
+      float bottom = y[i] - radius[i];
+      float f = min(max((surface[i] - bottom) / (2.0f * radius[i]), 0.0f), 1.0f);
+      float v = 8.0f * radius[i] * radius[i] * radius[i] * f;
+
+      sums[0] += v;
+      sums[1] += v * xz[i].x;
+      sums[2] += v * (bottom + f * radius[i]);
+      sums[3] += v * xz[i].y;
+    }
+
+    if (sums[0] > 0.0f) {
+      StoreFloat3(centroid, sums[1] / sums[0], sums[2] / sums[0], sums[3] / sums[0]);
+    }
+    else {
+      StoreFloat3(centroid, 0.0f, 0.0f, 0.0f);
+    }
+    return sums[0];
+  }
+
+  /*
+    A box is outside a plane if its centre is further behind it than the box reaches along its normal.
+    That reach is the same for every box, so it's found once per plane and the tiles are vectorised.
+  */
+  template <class Isa>
+  int CullTiles(const XMFLOAT4* planes, const float* centreX, const float* centreZ, int count, const XMFLOAT3& halfExtent,
+    int* visible)
+  {
+    typedef typename Isa::Float Float;
+
+    float reach[6];
+    for (int p = 0; p < 6; ++p) {
+      reach[p] = ScalarAbs(planes[p].x) * halfExtent.x + ScalarAbs(planes[p].y) * halfExtent.y +
+        ScalarAbs(planes[p].z) * halfExtent.z;
+    }
+
+    float inside[Isa::WIDTH];
+    int numVisible = 0;
+
+    int i = 0;
+    for (; i + Isa::WIDTH <= count; i += Isa::WIDTH)
+    {
+      Float x = Isa::Load(centreX + i), z = Isa::Load(centreZ + i);
+      Float in = Isa::Set(1.0f);
+      for (int p = 0; p < 6; ++p)
+      {
+        Float distance = Isa::MulAdd(x, Isa::Set(planes[p].x), Isa::MulAdd(z, Isa::Set(planes[p].z), Isa::Set(planes[p].w)));
+        in = Isa::Select(Isa::Less(distance, Isa::Set(-reach[p])), Isa::Set(0.0f), in);
+      }
+      Isa::Store(inside, in);
+
+      for (int j = 0; j < Isa::WIDTH; ++j)
+      {
+        visible[numVisible] = i + j;
+        numVisible += (inside[j] != 0.0f);
+      }
+    }
+    for (; i < count; ++i)
+    {
+      bool in = true;
+      for (int p = 0; p < 6; ++p) {
+        in = in && (centreX[i] * planes[p].x + centreZ[i] * planes[p].z + planes[p].w >= -reach[p]);
+      }
+      visible[numVisible] = i;
+      numVisible += in;
+    }
+    return numVisible;
+  }
+
+  /*
+    The slope and foam filters below vectorise the interior of each row, where no neighbour wraps, at full resolution and at
+    half (the default heightmap's). At half, each sample's neighbours are the columns between the samples, so
+    twice WIDTH columns are loaded and deinterleaved into them.
+  */
+  template <class Isa>
+  typename Isa::Float LoadSamples(const float* row, int x, int stepX)
+  {
+    typename Isa::Float samples, between;
+    if (stepX == 1) {
+      return Isa::Load(row + x);
+    }
+    Isa::LoadInterleaved(row + x, &samples, &between);
+    return samples;
+  }
+
+  // Columns x - 1, x and x + 1 for WIDTH samples stepX apart from column x
+  template <class Isa>
+  void LoadColumns(const float* row, int x, int stepX, typename Isa::Float* left, typename Isa::Float* centre,
+    typename Isa::Float* right)
+  {
+    if (stepX == 1)
+    {
+      *left = Isa::Load(row + x - 1);
+      *centre = Isa::Load(row + x);
+      *right = Isa::Load(row + x + 1);
+    }
+    else
+    {
+      typename Isa::Float next;
+      Isa::LoadInterleaved(row + x - 1, left, centre);
+      Isa::LoadInterleaved(row + x + 1, right, &next);
+    }
+  }
+
+  // Store WIDTH samples stepX apart from column x, leaving the columns between them as they were
+  template <class Isa>
+  void StoreSamples(float* row, int x, int stepX, typename Isa::Float a)
+  {
+    typename Isa::Float samples, between;
+    if (stepX == 1) {
+      Isa::Store(row + x, a);
+    }
+    else
+    {
+      Isa::LoadInterleaved(row + x, &samples, &between);
+      Isa::StoreInterleaved(row + x, a, between);
+    }
+  }
+
+  // The Sobel filter's gradient at column x, scaled to slopes
+  inline void SobelSlope(const float* top, const float* row, const float* bottom, int left, int x, int right, float scaleX,
+    float scaleZ, float* slopeX, float* slopeZ)
+  {
+    slopeX[x] = scaleX * (-(top[left] + 2.0f * row[left] + bottom[left]) + (top[right] + 2.0f * row[right] + bottom[right]));
+    slopeZ[x] = scaleZ * (-(top[left] + 2.0f * top[x] + top[right]) + (bottom[left] + 2.0f * bottom[x] + bottom[right]));
+  }
+
+  template <class Isa, class Grid>
+  void SobelSlopes(const KernelGrid& kernelGrid, const float* heights, int stepX, int stepZ, float* slopeX, float* slopeZ)
+  {
+    typedef typename Isa::Float Float;
+    Grid grid(kernelGrid);
+
+    // Over a plane of slope s the filter sums to 8s times the spacing of the samples
+    float scaleX = grid.DimX() / (8.0f * kernelGrid.patchLengthX);
+    float scaleZ = grid.DimY() / (8.0f * kernelGrid.patchLengthY);
+
+    for (int z = 0; z < grid.DimY(); z += stepZ)
+    {
+      // Wrap the neighbouring rows once, leaving only the columns to wrap per sample
+      const float* top = heights + grid.WrapY(z - 1) * grid.DimX();
+      const float* row = heights + z * grid.DimX();
+      const float* bottom = heights + grid.WrapY(z + 1) * grid.DimX();
+      float* sx = slopeX + z * grid.DimX();
+      float* sz = slopeZ + z * grid.DimX();
+
+      int x = 0;
+      if (stepX <= 2)
+      {
+        SobelSlope(top, row, bottom, grid.WrapX(-1), 0, 1, scaleX, scaleZ, sx, sz);
+
+        for (x = stepX; x + stepX * Isa::WIDTH < grid.DimX(); x += stepX * Isa::WIDTH)
+        {
+          Float tl, t, tr, l, c, r, bl, b, br;
+          LoadColumns<Isa>(top, x, stepX, &tl, &t, &tr);
+          LoadColumns<Isa>(row, x, stepX, &l, &c, &r);
+          LoadColumns<Isa>(bottom, x, stepX, &bl, &b, &br);
+
+          Float two = Isa::Set(2.0f);
+          Float dx = Isa::Sub(Isa::Add(Isa::MulAdd(two, r, tr), br), Isa::Add(Isa::MulAdd(two, l, tl), bl));
+          Float dz = Isa::Sub(Isa::Add(Isa::MulAdd(two, b, bl), br), Isa::Add(Isa::MulAdd(two, t, tl), tr));
+          StoreSamples<Isa>(sx, x, stepX, Isa::Mul(dx, Isa::Set(scaleX)));
+          StoreSamples<Isa>(sz, x, stepX, Isa::Mul(dz, Isa::Set(scaleZ)));
+        }
+      }
+      for (; x < grid.DimX(); x += stepX) {
+        SobelSlope(top, row, bottom, grid.WrapX(x - 1), x, grid.WrapX(x + 1), scaleX, scaleZ, sx, sz);
+      }
+    }
+  }
+
+  // The rows above, at and below a row of a periodic plane
+  struct RowNeighbours
+  {
+    const float* top, * row, * bottom;
+  };
+
+  /*
+    The normal of P(x, z) = (x + Dx, h, z + Dz) is dP/dz x dP/dx, whose y is the Jacobian of the horizontal
+    displacement. Divided through by it, the normal's x and z are the slopes of a heightfield with the same
+    normal. Where the surface folds over the Jacobian goes to zero and below, so it's clamped to keep the
+    normal on the side that faces up.
+  */
+  const float FOLD_JACOBIAN = 0.05f;
+
+  inline void DisplacedSlope(const RowNeighbours& h, const RowNeighbours& Dx, const RowNeighbours& Dz, int left, int x,
+    int right, float scaleX, float scaleZ, float choppiness, float* slopeX, float* slopeZ)
+  {
+    float hx = scaleX * (h.row[right] - h.row[left]), hz = scaleZ * (h.bottom[x] - h.top[x]);
+    float dxx = choppiness * scaleX * (Dx.row[right] - Dx.row[left]), dxz = choppiness * scaleZ * (Dx.bottom[x] - Dx.top[x]);
+    float dzx = choppiness * scaleX * (Dz.row[right] - Dz.row[left]), dzz = choppiness * scaleZ * (Dz.bottom[x] - Dz.top[x]);
+
+    float jacobian = max((1.0f + dxx) * (1.0f + dzz) - dxz * dzx, FOLD_JACOBIAN);
+    slopeX[x] = ((1.0f + dzz) * hx - hz * dzx) / jacobian;
+    slopeZ[x] = ((1.0f + dxx) * hz - hx * dxz) / jacobian;
+  }
+
+  template <class Isa, class Grid>
+  void DisplacedSlopes(const KernelGrid& kernelGrid, const float* heights, const float* Dx, const float* Dz, float choppiness,
+    int stepX, int stepZ, float* slopeX, float* slopeZ)
+  {
+    typedef typename Isa::Float Float;
+    Grid grid(kernelGrid);
+
+    // Central differences span two samples
+    float scaleX = grid.DimX() / (2.0f * kernelGrid.patchLengthX);
+    float scaleZ = grid.DimY() / (2.0f * kernelGrid.patchLengthY);
+
+    for (int z = 0; z < grid.DimY(); z += stepZ)
+    {
+      int top = grid.WrapY(z - 1) * grid.DimX(), row = z * grid.DimX(), bottom = grid.WrapY(z + 1) * grid.DimX();
+      RowNeighbours h = { heights + top, heights + row, heights + bottom };
+      RowNeighbours x0 = { Dx + top, Dx + row, Dx + bottom };
+      RowNeighbours z0 = { Dz + top, Dz + row, Dz + bottom };
+      float* sx = slopeX + row;
+      float* sz = slopeZ + row;
+
+      int x = 0;
+      if (stepX <= 2)
+      {
+        DisplacedSlope(h, x0, z0, grid.WrapX(-1), 0, 1, scaleX, scaleZ, choppiness, sx, sz);
+
+        Float one = Isa::Set(1.0f);
+        Float hScaleX = Isa::Set(scaleX), hScaleZ = Isa::Set(scaleZ);
+        Float dScaleX = Isa::Set(choppiness * scaleX), dScaleZ = Isa::Set(choppiness * scaleZ);
+        for (x = stepX; x + stepX * Isa::WIDTH < grid.DimX(); x += stepX * Isa::WIDTH)
+        {
+          Float hl, hc, hr, xl, xc, xr, zl, zc, zr;
+          LoadColumns<Isa>(h.row, x, stepX, &hl, &hc, &hr);
+          LoadColumns<Isa>(x0.row, x, stepX, &xl, &xc, &xr);
+          LoadColumns<Isa>(z0.row, x, stepX, &zl, &zc, &zr);
+          Float ht = LoadSamples<Isa>(h.top, x, stepX), hb = LoadSamples<Isa>(h.bottom, x, stepX);
+          Float xt = LoadSamples<Isa>(x0.top, x, stepX), xb = LoadSamples<Isa>(x0.bottom, x, stepX);
+          Float zt = LoadSamples<Isa>(z0.top, x, stepX), zb = LoadSamples<Isa>(z0.bottom, x, stepX);
+
+          Float hx = Isa::Mul(Isa::Sub(hr, hl), hScaleX), hz = Isa::Mul(Isa::Sub(hb, ht), hScaleZ);
+          Float dxx = Isa::Mul(Isa::Sub(xr, xl), dScaleX), dxz = Isa::Mul(Isa::Sub(xb, xt), dScaleZ);
+          Float dzx = Isa::Mul(Isa::Sub(zr, zl), dScaleX), dzz = Isa::Mul(Isa::Sub(zb, zt), dScaleZ);
+
+          Float stretchX = Isa::Add(one, dxx), stretchZ = Isa::Add(one, dzz);
+          Float jacobian = Isa::Max(Isa::Sub(Isa::Mul(stretchX, stretchZ), Isa::Mul(dxz, dzx)), Isa::Set(FOLD_JACOBIAN));
+          Float inverseJacobian = Isa::Div(one, jacobian);
+          StoreSamples<Isa>(sx, x, stepX, Isa::Mul(Isa::Sub(Isa::Mul(stretchZ, hx), Isa::Mul(hz, dzx)), inverseJacobian));
+          StoreSamples<Isa>(sz, x, stepX, Isa::Mul(Isa::Sub(Isa::Mul(stretchX, hz), Isa::Mul(hx, dxz)), inverseJacobian));
+        }
+      }
+      for (; x < grid.DimX(); x += stepX) {
+        DisplacedSlope(h, x0, z0, grid.WrapX(x - 1), x, grid.WrapX(x + 1), scaleX, scaleZ, choppiness, sx, sz);
+      }
+    }
+  }
+
+  // The Jacobian of the horizontal displacement at column x, from central differences scaled by the choppiness
+  inline float DisplacementJacobian(const RowNeighbours& Dx, const RowNeighbours& Dz, int left, int x, int right, float scaleX,
+    float scaleZ)
+  {
+    float dxx = scaleX * (Dx.row[right] - Dx.row[left]), dxz = scaleZ * (Dx.bottom[x] - Dx.top[x]);
+    float dzx = scaleX * (Dz.row[right] - Dz.row[left]), dzz = scaleZ * (Dz.bottom[x] - Dz.top[x]);
+    return (1.0f + dxx) * (1.0f + dzz) - dxz * dzx;
+  }
+
+  inline void StoreFoam(float jacobian, float threshold, float decay, float* jacobianOut, float* foam)
+  {
+    *jacobianOut = jacobian;
+    *foam = max(*foam * decay, min(max((threshold - jacobian) / threshold, 0.0f), 1.0f));
+  }
+
+  template <class Isa, class Grid>
+  void Foam(const KernelGrid& kernelGrid, const float* Dx, const float* Dz, float choppiness, int stepX, int stepZ,
+    float threshold, float decay, float* jacobian, float* foam)
+  {
+    typedef typename Isa::Float Float;
+    Grid grid(kernelGrid);
+
+    float scaleX = choppiness * grid.DimX() / (2.0f * kernelGrid.patchLengthX);
+    float scaleZ = choppiness * grid.DimY() / (2.0f * kernelGrid.patchLengthY);
+    int outDimX = grid.DimX() / stepX;
+
+    for (int z = 0; z < grid.DimY(); z += stepZ)
+    {
+      int top = grid.WrapY(z - 1) * grid.DimX(), row = z * grid.DimX(), bottom = grid.WrapY(z + 1) * grid.DimX();
+      RowNeighbours x0 = { Dx + top, Dx + row, Dx + bottom };
+      RowNeighbours z0 = { Dz + top, Dz + row, Dz + bottom };
+      float* j = jacobian + (z / stepZ) * outDimX;
+      float* f = foam + (z / stepZ) * outDimX;
+
+      // Coverage rises from 0 at the threshold to 1 where the surface folds over, and the foam keeps the larger of it and what's left
+      int x = 0;
+      if (stepX <= 2)
+      {
+        StoreFoam(DisplacementJacobian(x0, z0, grid.WrapX(-1), 0, 1, scaleX, scaleZ), threshold, decay, j, f);
+
+        Float one = Isa::Set(1.0f), zero = Isa::Set(0.0f);
+        for (x = stepX; x + stepX * Isa::WIDTH < grid.DimX(); x += stepX * Isa::WIDTH)
+        {
+          Float xl, xc, xr, zl, zc, zr;
+          LoadColumns<Isa>(x0.row, x, stepX, &xl, &xc, &xr);
+          LoadColumns<Isa>(z0.row, x, stepX, &zl, &zc, &zr);
+          Float xt = LoadSamples<Isa>(x0.top, x, stepX), xb = LoadSamples<Isa>(x0.bottom, x, stepX);
+          Float zt = LoadSamples<Isa>(z0.top, x, stepX), zb = LoadSamples<Isa>(z0.bottom, x, stepX);
+
+          Float dxx = Isa::Mul(Isa::Sub(xr, xl), Isa::Set(scaleX)), dxz = Isa::Mul(Isa::Sub(xb, xt), Isa::Set(scaleZ));
+          Float dzx = Isa::Mul(Isa::Sub(zr, zl), Isa::Set(scaleX)), dzz = Isa::Mul(Isa::Sub(zb, zt), Isa::Set(scaleZ));
+          Float determinant = Isa::Sub(Isa::Mul(Isa::Add(one, dxx), Isa::Add(one, dzz)), Isa::Mul(dxz, dzx));
+
+          // The outputs are at the sampled resolution, so the samples are stored side by side
+          Float coverage = Isa::Mul(Isa::Sub(Isa::Set(threshold), determinant), Isa::Set(1.0f / threshold));
+          coverage = Isa::Min(Isa::Max(coverage, zero), one);
+          Isa::Store(j + x / stepX, determinant);
+          Isa::Store(f + x / stepX, Isa::Max(Isa::Mul(Isa::Load(f + x / stepX), Isa::Set(decay)), coverage));
+        }
+      }
+      for (; x < grid.DimX(); x += stepX)
+      {
+        StoreFoam(DisplacementJacobian(x0, z0, grid.WrapX(x - 1), x, grid.WrapX(x + 1), scaleX, scaleZ), threshold, decay,
+          j + x / stepX, f + x / stepX);
+      }
+    }
+  }
+
+  template <class Isa>
+  void WeightedSum(const float* const* sources, const float* weights, int numSources, int count, float* dst)
+  {
+    typedef typename Isa::Float Float;
+
+    int i = 0;
+    for (; i + Isa::WIDTH <= count; i += Isa::WIDTH)
+    {
+      Float sum = Isa::Mul(Isa::Load(sources[0] + i), Isa::Set(weights[0]));
+      for (int s = 1; s < numSources; ++s) {
+        sum = Isa::MulAdd(Isa::Load(sources[s] + i), Isa::Set(weights[s]), sum);
+      }
+      Isa::Store(dst + i, sum);
+    }
+    for (; i < count; ++i)
+    {
+      float sum = sources[0][i] * weights[0];
+      for (int s = 1; s < numSources; ++s) {
+        sum += sources[s][i] * weights[s];
+      }
+      dst[i] = sum;
+    }
+  }
+
+  template <class Isa>
+  void RowBounds(const float* const* lowerRows, const float* const* upperRows, int numRows, int count, float* lower,
+    float* upper)
+  {
+    typedef typename Isa::Float Float;
+
+    int i = 0;
+    for (; i + Isa::WIDTH <= count; i += Isa::WIDTH)
+    {
+      Float least = Isa::Load(lowerRows[0] + i), greatest = Isa::Load(upperRows[0] + i);
+      for (int r = 1; r < numRows; ++r)
+      {
+        least = Isa::Min(least, Isa::Load(lowerRows[r] + i));
+        greatest = Isa::Max(greatest, Isa::Load(upperRows[r] + i));
+      }
+      Isa::Store(lower + i, least);
+      Isa::Store(upper + i, greatest);
+    }
+    for (; i < count; ++i)
+    {
+      float least = lowerRows[0][i], greatest = upperRows[0][i];
+      for (int r = 1; r < numRows; ++r)
+      {
+        least = min(least, lowerRows[r][i]);
+        greatest = max(greatest, upperRows[r][i]);
+      }
+      lower[i] = least;
+      upper[i] = greatest;
+    }
+  }
+
+#define kernelsFor(isa, size, grid) \
+  { size, InitSpectrum<isa, grid>, EvolveSpectrum<isa, grid>, DeriveChannels<isa, grid>, WriteVertices<isa>, SobelSlopes<isa, grid>, \
+    DisplacedSlopes<isa, grid>, Foam<isa, grid>, PackVertices<isa>, ProjectRays<isa>, SampleHeightmap<isa>, SampleHeights<isa>, \
+    SampleDisplacedHeights<isa>, SampleVectors<isa>, TransformPoints<isa>, SubmergedVolume<isa>, CullTiles<isa>, WeightedSum<isa>, \
+    RowBounds<isa> }
+
+  // The kernels built with Isa, specialised on the sizes we ship
+  template <class Isa>
+  const OceanKernels& SelectKernels(int dimX, int dimY)
+  {
+    static const OceanKernels fixedKernels[] =
+    {
+      kernelsFor(Isa, 64, FixedGrid<64>),
+      kernelsFor(Isa, 128, FixedGrid<128>),
+      kernelsFor(Isa, 256, FixedGrid<256>),
+      kernelsFor(Isa, 512, FixedGrid<512>),
+      kernelsFor(Isa, 1024, FixedGrid<1024>),
+      kernelsFor(Isa, 2048, FixedGrid<2048>)
+    };
+    static const OceanKernels runtimeKernels = kernelsFor(Isa, 0, RuntimeGrid);
+
+    if (dimX == dimY)
+    {
+      for (int i = 0; i < ARRAYSIZE(fixedKernels); ++i)
+      {
+        if (fixedKernels[i].size == dimX) {
+          return fixedKernels[i];
+        }
+      }
+    }
+    return runtimeKernels;
+  }
+
+#undef kernelsFor
+}
+}
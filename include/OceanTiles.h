@@ -0,0 +1,76 @@
+/*!
+  @file OceanTiles.h @date 18/10/26 @brief Copies of the periodic ocean patch tiled out to the view distance.
+*/
+
+#pragma once
+
+#include <d3d11.h>
+#include <xnamath.h>
+
+#include "Frustum.h"
+#include "OceanKernels.h"
+#include "Utilities.h"
+
+namespace OceanWaves
+{
+  const int OCEAN_TILES_MAX_RADIUS = 32;
+
+  /*!
+    The simulated patch is periodic, so one simulation can cover as much sea as there are copies of it.
+    A square of tiles centred on the camera's tile is culled against the frustum every frame, and the
+    survivors drawn as instances of one patch mesh.
+
+    The heightmap mesh has a vertex per texel, so its last row and column stop a quad short of the next
+    copy's first. The tile patch has one more of each and samples the HeightmapTextures, which wrap, at
+    the texel centres instead.
+  */
+  class OceanTiles
+  {
+    struct PatchChunk
+    {
+      unsigned int numIndices;
+      int baseVertex;
+    };
+
+  public:
+    OceanTiles() : device_(NULL), immediateContext_(NULL), vertexShader_(NULL), vertexLayout_(NULL), vertexBuffer_(NULL),
+      indexBuffer_(NULL), instanceBuffer_(NULL), chunks_(NULL), numChunks_(0), radius_(0), numTiles_(0), numVisible_(0),
+      centreX_(NULL), centreZ_(NULL), visible_(NULL), offsets_(NULL), kernels_(NULL) {}
+    ~OceanTiles();
+
+    //! Tile the heightmap (dimX by dimY vertices, spacing apart) radius tiles out from the camera's in each direction
+    void Init(ID3D11Device* device, int dimX, int dimY, float spacing, int radius, const OceanKernels* kernels);
+
+    //! Centre the tiles on the camera and cull them against the frustum, both in the ocean's space, padding each tile
+    //! by how far the surface can be displaced along each axis. Returns the milliseconds taken.
+    float Cull(const XMFLOAT3& camera, const Frustum& frustum, const XMFLOAT3& bounds);
+    //! Draw the tiles that survived, with the pixel shader, constants and HeightmapTextures already bound
+    void Render();
+
+    int GetNumTiles() const { return numTiles_; }
+    int GetNumVisible() const { return numVisible_; }
+
+  private:
+    HRESULT InitShaders();
+    HRESULT InitBuffers(int dimX, int dimY, float spacing);
+
+  private:
+    int radius_, numTiles_, numVisible_;
+    float periodX_, periodZ_;
+    PatchChunk* chunks_; // Bands of rows that 16-bit indices can address, sharing the indices of the first
+    int numChunks_;
+    float* centreX_, * centreZ_; // Of every tile, rebuilt as the camera moves
+    int* visible_;
+    XMFLOAT2* offsets_; // Of the visible tiles, uploaded as instances
+    const OceanKernels* kernels_;
+    Timer timer_;
+
+    ID3D11Device* device_;
+    ID3D11DeviceContext* immediateContext_;
+    ID3D11VertexShader* vertexShader_;
+    ID3D11InputLayout* vertexLayout_;
+    ID3D11Buffer* vertexBuffer_;
+    ID3D11Buffer* indexBuffer_;
+    ID3D11Buffer* instanceBuffer_;
+  };
+}
@@ -0,0 +1,82 @@
+/*!
+  @file ProjectedGrid.h @date 18/10/26 @brief A screen-space grid projected onto the ocean.
+*/
+
+#pragma once
+
+#include <d3d11.h>
+#include <xnamath.h>
+
+#include "OceanKernels.h"
+#include "ThreadPool.h"
+#include "Vertices.h"
+
+namespace OceanWaves
+{
+  const int PROJECTED_GRID_MAX_SIZE = 256; // Vertices along a side that 16-bit indices can address
+
+  /*!
+    A grid evenly spaced across the screen, intersected with the ocean's plane and displaced by the
+    heightmap where it lands (after Johanson), so the vertices are dense near the camera and sparse
+    towards the horizon rather than evenly spread over the patch.
+
+    The projection and sampling run on the CPU, a row of rays at a time across the thread pool, and
+    need no device so that they can be measured headless. The vertices are drawn with the ocean's own
+    shaders, as a grid position and a VertexDispNor.
+  */
+  class ProjectedGrid
+  {
+  public:
+    ProjectedGrid() : device_(NULL), immediateContext_(NULL), positionBuffer_(NULL), sampleBuffer_(NULL),
+      indexBuffer_(NULL), kernels_(NULL), threadPool_(NULL), size_(0), margin_(0.0f), numIndices_(0),
+      positions_(NULL), samples_(NULL), heightmap_(NULL) {}
+    ~ProjectedGrid();
+
+    //! Allocate a grid of size by size vertices, reaching margin beyond the screen's edges in clip space
+    void Init(int size, float margin, const OceanKernels* kernels, ThreadPool* threadPool);
+    //! Create the buffers to draw the grid with
+    HRESULT InitBuffers(ID3D11Device* device);
+
+    //! Project the grid onto the plane y = 0 of the space inverseViewProjection maps clip space to, and sample the
+    //! heightmap (vertex (0, 0) at origin, spacing apart) where it lands
+    void Project(const XMFLOAT4X4& inverseViewProjection, const VertexDispNor* heightmap, int dimX, int dimY,
+      const XMFLOAT2& origin, float spacing);
+    //! Upload the last projection, returning the bytes uploaded
+    int Upload();
+    //! Draw with the input layout and shaders already bound
+    void Render();
+
+    int GetSize() const { return size_; }
+    const XMFLOAT2* GetPositions() const { return positions_; }
+    const VertexDispNor* GetSamples() const { return samples_; }
+
+  private:
+    static void ProjectRow(void* grid, int row);
+
+  private:
+    int size_;
+    float margin_;
+    unsigned int numIndices_;
+    XMFLOAT2* positions_;
+    VertexDispNor* samples_;
+    const OceanKernels* kernels_;
+    ThreadPool* threadPool_;
+
+    // The projection being run
+    XMFLOAT4X4 inverseViewProjection_;
+    const VertexDispNor* heightmap_;
+    int dimX_, dimY_;
+    XMFLOAT2 origin_;
+    float spacing_;
+
+    ID3D11Device* device_;
+    ID3D11DeviceContext* immediateContext_;
+    ID3D11Buffer* positionBuffer_;
+    ID3D11Buffer* sampleBuffer_;
+    ID3D11Buffer* indexBuffer_;
+  };
+
+  //! Time the projection on each instruction set the CPU supports, from a range of camera heights and pitches, and
+  //! report how the vertices spread over the sea, writing a CSV report
+  void WriteProjectedGridBenchmark(const char* fileName);
+}
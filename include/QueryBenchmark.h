@@ -0,0 +1,16 @@
+/*!
+  @file QueryBenchmark.h @date 18/10/26 @brief Throughput and accuracy of the batched ocean queries.
+*/
+
+#pragma once
+
+namespace OceanWaves
+{
+  //! Time the height queries, with and without normals, on one thread and across a thread pool for every instruction set
+  //! the CPU supports and a range of heightmap sizes, and check them against the per-vertex sampler, writing a CSV report
+  void WriteQueryBenchmark(const char* fileName);
+
+  //! Time the displaced surface's queries over a choppy heightmap for a range of choppiness and iteration counts on every
+  //! instruction set the CPU supports, with the steps they took, the residuals left and the heights' error, writing a CSV report
+  void WriteDisplacedQueryReport(const char* fileName);
+}
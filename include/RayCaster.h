@@ -0,0 +1,87 @@
+/*!
+  @file RayCaster.h @date 18/10/26 @brief Rays cast against the ocean surface.
+*/
+
+#pragma once
+
+#include <xnamath.h>
+
+#include "HeightPyramid.h"
+#include "ThreadPool.h"
+#include "Vertices.h"
+
+namespace OceanWaves
+{
+  const int RAY_BLOCK = 256; // Rays per task
+
+  /*!
+    Where a ray first meets the surface.
+  */
+  struct RayHit
+  {
+    XMFLOAT3 position; // In the ocean's space
+    XMFLOAT3 normal; // Unit, interpolated from the vertices' normals
+    float distance; // Along the ray, in units of its direction's length, or FLT_MAX where it misses
+  };
+
+  /*!
+    Rays against the displaced heightmap mesh, which tiles the plane. A ray is clipped to the height
+    bounds of the whole surface, then walked cell by cell across the level of the height pyramid whose
+    cells are as wide as the largest horizontal displacement. As the choppy waves move vertices into
+    neighbouring cells, each cell the ray crosses brings in the ring of cells around it, and each of
+    those is descended front to back, skipping any child whose bounds the ray misses or enters beyond
+    the nearest hit so far. The walk stops at the first cell the ray enters beyond that hit. The two
+    triangles of each quad reached are intersected exactly, split along the diagonal the mesh's indices
+    split that row of quads along, so a ray meets the surface that is drawn.
+
+    Each ray is traced on its own, and blocks of rays are spread over the thread pool.
+  */
+  class RayCaster
+  {
+  public:
+    RayCaster() : pyramid_(NULL), threadPool_(NULL), heightmap_(NULL), dimX_(0), dimY_(0), spacing_(0.0f), diagonals_(NULL), origins_(NULL),
+      directions_(NULL), count_(0), maxDistance_(0.0f), hits_(NULL)
+    {
+      ZeroMemory(&origin_, sizeof(origin_));
+    }
+
+    //! Against a heightmap of dimX x dimY vertices spacing apart, vertex (0, 0) lying at origin, bounded by pyramid, which must
+    //! be built from the heightmap the rays are cast against. Each row z of quads is split along diagonals[z], 0 from each
+    //! quad's (1, 0) corner to its (0, 1) one and 1 from (0, 0) to (1, 1), or alternately from the first row, as one strip
+    //! over the whole heightmap splits them, if diagonals is NULL. The rays are spread over threadPool, or cast on the
+    //! calling thread if it's NULL.
+    void Init(const HeightPyramid* pyramid, int dimX, int dimY, const XMFLOAT2& origin, float spacing, const BYTE* diagonals,
+      ThreadPool* threadPool);
+
+    //! The nearest hit of each of count rays, from origins along directions (which needn't be unit length) no further than
+    //! maxDistance of them
+    void Cast(const VertexDispNor* heightmap, const XMFLOAT3* origins, const XMFLOAT3* directions, int count, float maxDistance,
+      RayHit* hits);
+    //! The same for one ray, returning how many triangles it was tested against
+    int CastRay(const VertexDispNor* heightmap, const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance,
+      RayHit* hit) const;
+
+  private:
+    static void CastBlock(void* rayCaster, int block);
+
+  private:
+    int dimX_, dimY_;
+    XMFLOAT2 origin_;
+    float spacing_;
+    const BYTE* diagonals_;
+
+    const HeightPyramid* pyramid_;
+    ThreadPool* threadPool_;
+
+    // The rays being cast
+    const VertexDispNor* heightmap_;
+    const XMFLOAT3* origins_, * directions_;
+    int count_;
+    float maxDistance_;
+    RayHit* hits_;
+  };
+
+  //! Time casting steep and grazing rays at a range of heightmap sizes, on one thread and across the pool, and check their
+  //! hits against every triangle of the tiles they cross, writing a CSV report
+  void WriteRayReport(const char* fileName);
+}
@@ -23,7 +23,10 @@ namespace OceanWaves
   struct OceanSettings
   {
     std::string skyboxTexture;
-    int fftDim, heightmapDim, patchLength, wireframe;
+    int fftDimX, fftDimY, heightmapDimX, heightmapDimY, patchLengthX, patchLengthY, wireframe;
+    int displacementInterval, normalInterval, halfPrecision, packedVertices, chunkedMesh, indexCacheSize, clipmapLevels;
+    int projectedGridSize, cdlodLevels, tileRadius, uploadFrames, normalMethod, mipFilter, halfTextures, lodLevels;
+    int simdPath;
     float w, V, A, S, choppiness, wavePeriod, smallestWave;
   };
 
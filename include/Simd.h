@@ -0,0 +1,43 @@
+/*!
+  @file Simd.h @date 18/10/26 @brief CPU feature detection and SIMD helpers.
+*/
+
+#pragma once
+
+#include <windows.h>
+#include <xnamath.h>
+
+namespace OceanWaves
+{
+  /*!
+    Instruction set extensions of the CPU that's running the application.
+  */
+  struct CpuFeatures
+  {
+    bool sse41, sse42, avx, avx2, fma, f16c, avx512f;
+  };
+
+  /*!
+    Instruction sets the simulation kernels are built for, in order of preference.
+  */
+  enum SimdPath
+  {
+    SIMD_PATH_AUTO = 0,
+    SIMD_PATH_SSE2,
+    SIMD_PATH_SSE42,
+    SIMD_PATH_AVX2,
+    SIMD_PATH_AVX512,
+    SIMD_NUM_PATHS
+  };
+
+  // Detect the CPU features once and return them
+  const CpuFeatures& GetCpuFeatures();
+
+  // Return the best path the CPU supports, or the requested one, throwing if the CPU can't run it
+  SimdPath SelectSimdPath(SimdPath requested);
+  const char* GetSimdPathName(SimdPath path);
+
+  // Convert between single and half precision, using F16C when the CPU supports it
+  void FloatToHalf(HALF* dst, const float* src, unsigned int count);
+  void HalfToFloat(float* dst, const HALF* src, unsigned int count);
+}
@@ -0,0 +1,49 @@
+/*!
+  @file ThreadPool.h @date 18/10/26 @brief A pool of worker threads for data-parallel loops.
+*/
+
+#pragma once
+
+#include <windows.h>
+
+namespace OceanWaves
+{
+  /*!
+    Worker threads that sleep until a loop is handed to them. The loop's iterations are claimed one at
+    a time by the workers and the calling thread, so uneven iterations still balance.
+  */
+  class ThreadPool
+  {
+  public:
+    typedef void (*Task)(void* context, int index);
+
+    ThreadPool() : threads_(NULL), numThreads_(0), startSemaphore_(NULL), doneEvent_(NULL), task_(NULL),
+      context_(NULL), count_(0), next_(0), activeWorkers_(0), quit_(false) {}
+    ~ThreadPool();
+
+    //! Start numThreads workers, or one for each processor but the calling thread's if numThreads is 0
+    void Init(int numThreads);
+
+    //! Run task(context, i) for every i in [0, count), returning once they have all finished
+    void ParallelFor(int count, Task task, void* context);
+
+    //! The threads a loop is spread over, including the calling thread
+    int GetNumThreads() const { return numThreads_ + 1; }
+
+  private:
+    static DWORD WINAPI WorkerProc(LPVOID param);
+    void RunTasks();
+
+  private:
+    HANDLE* threads_;
+    int numThreads_;
+    HANDLE startSemaphore_, doneEvent_;
+
+    // The loop being run
+    Task task_;
+    void* context_;
+    int count_;
+    volatile LONG next_, activeWorkers_;
+    volatile bool quit_;
+  };
+}
@@ -0,0 +1,108 @@
+/*!
+  @file UploadRing.h @date 18/10/26 @brief A ring of per-frame regions of one buffer for streaming data to the GPU.
+*/
+
+#pragma once
+
+#include <d3d11.h>
+
+namespace OceanWaves
+{
+  const int UPLOAD_RING_MAX_FRAMES = 4;
+
+  /*!
+    What an UploadRing writes through: a buffer that can be mapped a region at a time, and fences
+    marking points in the command stream that the GPU can be asked whether it has passed.
+  */
+  class UploadBackend
+  {
+  public:
+    virtual ~UploadBackend() {}
+
+    //! Map offset...offset + size for writing. discard throws away the whole buffer; otherwise nothing in use is touched.
+    virtual void* Map(unsigned int offset, unsigned int size, bool discard) = 0;
+    virtual void Unmap() = 0;
+    //! Place fence after every command submitted so far
+    virtual void IssueFence(int fence) = 0;
+    virtual bool IsFenceComplete(int fence) = 0;
+  };
+
+  /*!
+    A dynamic buffer mapped without overwriting, fenced with event queries.
+  */
+  class D3D11UploadBackend : public UploadBackend
+  {
+  public:
+    D3D11UploadBackend() : device_(NULL), immediateContext_(NULL), buffer_(NULL), numFences_(0)
+    {
+      ZeroMemory(queries_, sizeof(queries_));
+    }
+    ~D3D11UploadBackend();
+
+    HRESULT Init(ID3D11Device* device, UINT bindFlags, unsigned int bytes, int numFences);
+
+    void* Map(unsigned int offset, unsigned int size, bool discard);
+    void Unmap();
+    void IssueFence(int fence);
+    bool IsFenceComplete(int fence);
+
+    ID3D11Buffer* GetBuffer() const { return buffer_; }
+
+  private:
+    int numFences_;
+
+    ID3D11Device* device_;
+    ID3D11DeviceContext* immediateContext_;
+    ID3D11Buffer* buffer_;
+    ID3D11Query* queries_[UPLOAD_RING_MAX_FRAMES];
+  };
+
+  /*!
+    How often the most recent frames waited for the GPU, since init.
+  */
+  struct UploadRingStats
+  {
+    int framesWritten, stalls, waitPolls;
+  };
+
+  /*!
+    numFrames equal regions of one buffer, written a frame at a time in turn, so the CPU can write the
+    next frame's data straight into the buffer while the GPU still draws from the last ones. Each
+    region is fenced once everything drawn from it has been submitted, i.e. when the next one is begun,
+    and is only mapped again once the GPU has passed that fence. With one frame that is every frame, so
+    the CPU waits for the GPU as UpdateSubresource can; with more it only waits when the GPU falls that
+    many frames behind.
+  */
+  class UploadRing
+  {
+  public:
+    UploadRing() : backend_(NULL), frameBytes_(0), numFrames_(0), current_(-1), writing_(-1)
+    {
+      ZeroMemory(&stats_, sizeof(stats_));
+      ZeroMemory(fenced_, sizeof(fenced_));
+    }
+
+    void Init(UploadBackend* backend, unsigned int frameBytes, int numFrames);
+
+    //! Issue the last frame's fence, wait for the GPU to finish with the next frame's region and map it for writing
+    void* Begin();
+    //! Unmap the frame, which is drawn from until the next one ends
+    void End();
+
+    //! Where the frame to draw from starts in the buffer
+    unsigned int GetOffset() const { return current_ < 0 ? 0 : current_ * frameBytes_; }
+    const UploadRingStats& GetStats() const { return stats_; }
+
+  private:
+    UploadBackend* backend_;
+    unsigned int frameBytes_;
+    int numFrames_;
+    int current_, writing_; // The most recently written frame, and the one mapped now or -1
+    bool fenced_[UPLOAD_RING_MAX_FRAMES]; // Whether each frame has been drawn from and fenced
+    UploadRingStats stats_;
+  };
+
+  //! Drive rings of 1...UPLOAD_RING_MAX_FRAMES frames against a mock GPU a number of frames behind, writing a
+  //! CSV report of how often each waits and whether any frame was written while the GPU could still read it
+  void WriteUploadRingReport(const char* fileName);
+}
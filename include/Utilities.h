@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <vector>
 #include <windows.h>
 #include <d3dx11.h>
 #include <dxerr.h>
@@ -20,12 +21,49 @@ namespace OceanWaves
   template < typename T > inline void SafeDeleteArray(T*& p) { delete[] p; p = NULL; }
   template < typename T > inline void SafeRelease(T*& p) { if (p) { p->Release(); } p = NULL; }
 
+  // A high-resolution timer for profiling, in milliseconds
+  class Timer
+  {
+  public:
+    Timer();
+
+    void Start();
+    float Stop();
+
+  private:
+    LARGE_INTEGER frequency_, start_;
+  };
+
   // Return a Gaussian random number with mean 0 and standard deviation 1
   float GaussRand();
+  // Return a uniform random number between lower and upper
+  float UniformRand(float lower, float upper);
+
+  // Generate indices for a heightmap
+  unsigned int GenerateIndices(WORD** indices, int dimensionsX, int dimensionsZ);
+
+  // Generate triangle list indices for a heightmap in vertical stripes, narrow enough that each row of a stripe is
+  // still in a post-transform cache of cacheSize vertices when the next row reuses it
+  unsigned int GenerateListIndices(WORD** indices, int dimensionsX, int dimensionsZ, int cacheSize);
+
+  // Fill a heightmap of dim x dim vertices spacing apart, vertex (0, 0) at origin, with a few Gerstner waves whose wavenumbers
+  // fit its period so that it tiles, displaced horizontally by choppiness, for the headless reports. The steepnesses sum to
+  // less than one, so the surface only folds for choppiness of over 1.25.
+  void GenerateWaveHeightmap(int dim, float spacing, const XMFLOAT2& origin, float choppiness, VertexDispNor* heightmap);
+
+  // The headless reports' patch of waves: a heightmap filled by GenerateWaveHeightmap, centred on the origin as the ocean's is
+  struct WavePatch
+  {
+    WavePatch(int dim, float spacing, float choppiness);
+
+    int dim;
+    float spacing, period;
+    XMFLOAT2 origin; // Of vertex (0, 0)
+    std::vector<VertexDispNor> heightmap;
+  };
 
-  // Generate vertices and indices for a heightmap
-  unsigned int GenerateVertices(VertexPosNor** vertices, int dimensions, float stride);
-  unsigned int GenerateIndices(WORD** indices, int dimensions);
+  // Open a headless report's CSV file and write its header row, or throw naming the report if it can't be opened
+  FILE* OpenReport(const char* fileName, const char* report, const char* header);
 
   // Helper function from the DirectX SDK for compiling a shader
   HRESULT CompileShaderFromFile(CHAR* fileName, LPCSTR entryPoint, LPCSTR shaderModel, ID3DBlob** blob);
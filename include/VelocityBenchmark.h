@@ -0,0 +1,12 @@
+/*!
+  @file VelocityBenchmark.h @date 18/10/26 @brief Cost and accuracy of the surface's spectral velocity and acceleration.
+*/
+
+#pragma once
+
+namespace OceanWaves
+{
+  //! Time evolving the spectrum with and without its velocity and acceleration on every instruction set the CPU supports
+  //! over a range of FFT sizes, and measure their error against central differences of the evolved spectrum, writing a CSV report
+  void WriteVelocityBenchmark(const char* fileName);
+}
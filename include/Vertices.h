@@ -50,6 +50,44 @@ namespace OceanWaves
       : Pos(p), Nor(n) {}
   };
 
+  /*
+    The per-frame part of an ocean vertex, added to its position on an immutable base grid. The normal
+    of a heightfield always points up, so only its x and z are streamed.
+  */
+  struct VertexDispNor
+  {
+    XMFLOAT3 Disp;
+    XMFLOAT2 Nor;
+  };
+
+  /*
+    Half precision VertexDispNor. The input layout reads the displacement and the normal's x from one
+    four-component element and the normal's z (and padding) from another.
+  */
+  struct VertexDispNorHalf
+  {
+    HALF Disp[3];
+    HALF Nor[2];
+    HALF Pad;
+  };
+
+  /*
+    VertexDispNor packed to SNORM16 fractions of a per-patch displacement scale, with the normal
+    octahedral encoded to two 16-bit components (laid out like VertexDispNorHalf) or two 8-bit ones.
+  */
+  struct VertexDispNorPacked16
+  {
+    SHORT Disp[3];
+    SHORT Nor[2];
+    SHORT Pad;
+  };
+
+  struct VertexDispNorPacked8
+  {
+    SHORT Disp[3];
+    CHAR Nor[2];
+  };
+
   struct VertexPosNorCol
   {
     XMFLOAT3 Pos;
@@ -0,0 +1,265 @@
+/*!
+  @file Buoyancy.cpp @date 18/10/26 @brief The buoyancy of rigid bodies floating on the ocean.
+*/
+
+#include <math.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <vector>
+
+#include "Buoyancy.h"
+#include "Utilities.h"
+
+namespace OceanWaves
+{
+  Buoyancy::~Buoyancy()
+  {
+    SafeDeleteArray(surface_);
+    SafeDeleteArray(worldY_);
+    SafeDeleteArray(worldXZ_);
+    SafeDeleteArray(radii_);
+    SafeDeleteArray(localZ_);
+    SafeDeleteArray(localY_);
+    SafeDeleteArray(localX_);
+    SafeDeleteArray(forces_);
+    SafeDeleteArray(poses_);
+    SafeDeleteArray(firstSamples_);
+  }
+
+  void Buoyancy::Init(int maxBodies, int maxSamples, int dimX, int dimY, const XMFLOAT2& origin, float spacing,
+    const OceanKernels* kernels, ThreadPool* threadPool)
+  {
+    maxBodies_ = maxBodies;
+    maxSamples_ = maxSamples;
+    dimX_ = dimX;
+    dimY_ = dimY;
+    origin_ = origin;
+    spacing_ = spacing;
+    kernels_ = kernels;
+    threadPool_ = threadPool;
+
+    firstSamples_ = new int[maxBodies_ + 1];
+    firstSamples_[0] = 0;
+    poses_ = new XMFLOAT4X4[maxBodies_];
+    forces_ = new BuoyancyForce[maxBodies_];
+    ZeroMemory(forces_, sizeof(BuoyancyForce) * maxBodies_);
+
+    localX_ = new float[maxSamples_];
+    localY_ = new float[maxSamples_];
+    localZ_ = new float[maxSamples_];
+    radii_ = new float[maxSamples_];
+    worldXZ_ = new XMFLOAT2[maxSamples_];
+    worldY_ = new float[maxSamples_];
+    surface_ = new float[maxSamples_];
+  }
+
+  int Buoyancy::AddBody(const XMFLOAT4* samples, int count)
+  {
+    if (numBodies_ == maxBodies_ || numSamples_ + count > maxSamples_) {
+      throw std::runtime_error("There's no room left for another floating body");
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+      localX_[numSamples_ + i] = samples[i].x;
+      localY_[numSamples_ + i] = samples[i].y;
+      localZ_[numSamples_ + i] = samples[i].z;
+      radii_[numSamples_ + i] = samples[i].w;
+    }
+    numSamples_ += count;
+
+    int body = numBodies_++;
+    firstSamples_[numBodies_] = numSamples_;
+    SetPose(body, XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+    return body;
+  }
+
+  void Buoyancy::SetPose(int body, const XMFLOAT3& position, const XMFLOAT4& orientation)
+  {
+    XMStoreFloat4x4(&poses_[body], XMMatrixRotationQuaternion(XMLoadFloat4(&orientation)));
+    poses_[body]._41 = position.x;
+    poses_[body]._42 = position.y;
+    poses_[body]._43 = position.z;
+  }
+
+  void Buoyancy::Update(const VertexDispNor* heightmap, int iterations)
+  {
+    heightmap_ = heightmap;
+    iterations_ = iterations;
+
+    int numBatches = (numBodies_ + BUOYANCY_BATCH - 1) / BUOYANCY_BATCH;
+    if (threadPool_) {
+      threadPool_->ParallelFor(numBatches, UpdateBatch, this);
+    }
+    else
+    {
+      for (int batch = 0; batch < numBatches; ++batch) {
+        UpdateBatch(this, batch);
+      }
+    }
+  }
+
+  void Buoyancy::UpdateBatch(void* buoyancy, int batch)
+  {
+    Buoyancy* b = static_cast<Buoyancy*>(buoyancy);
+
+    int firstBody = batch * BUOYANCY_BATCH;
+    int lastBody = min(firstBody + BUOYANCY_BATCH, b->numBodies_);
+    int first = b->firstSamples_[firstBody], count = b->firstSamples_[lastBody] - first;
+
+    // Where every sample of the batch is, then the surface above them all in one run
+    for (int body = firstBody; body < lastBody; ++body)
+    {
+      int s = b->firstSamples_[body], n = b->firstSamples_[body + 1] - s;
+      b->kernels_->transformPoints(b->localX_ + s, b->localY_ + s, b->localZ_ + s, n, b->poses_[body], b->worldXZ_ + s,
+        b->worldY_ + s);
+    }
+    if (b->iterations_)
+    {
+      b->kernels_->sampleDisplacedHeights(b->heightmap_, b->dimX_, b->dimY_, b->origin_, b->spacing_, b->worldXZ_ + first, count,
+        b->iterations_, BUOYANCY_TOLERANCE, b->surface_ + first, NULL, NULL, NULL);
+    }
+    else
+    {
+      b->kernels_->sampleHeights(b->heightmap_, b->dimX_, b->dimY_, b->origin_, b->spacing_, b->worldXZ_ + first, count,
+        b->surface_ + first, NULL);
+    }
+
+    // The buoyancy is the weight of the water displaced, pushing up through its centroid
+    for (int body = firstBody; body < lastBody; ++body)
+    {
+      int s = b->firstSamples_[body], n = b->firstSamples_[body + 1] - s;
+      BuoyancyForce& f = b->forces_[body];
+      f.volume = b->kernels_->submergedVolume(b->worldXZ_ + s, b->worldY_ + s, b->radii_ + s, b->surface_ + s, n, &f.centre);
+
+      float lift = BUOYANCY_WATER_DENSITY * BUOYANCY_GRAVITY * f.volume;
+      const XMFLOAT4X4& pose = b->poses_[body];
+      f.force = XMFLOAT3(0.0f, lift, 0.0f);
+      f.torque = (f.volume > 0.0f) ? XMFLOAT3(-(f.centre.z - pose._43) * lift, 0.0f, (f.centre.x - pose._41) * lift) :
+        XMFLOAT3(0.0f, 0.0f, 0.0f);
+    }
+  }
+
+  void WriteBuoyancyBenchmark(const char* fileName)
+  {
+    static const int bodyCounts[] = { 1000, 10000 };
+    static const int iterationCounts[] = { 0, 4 };
+    const int dim = 256, frames = 16, side = 4; // Each hull a 4 x 2 x 4 block of cubes, 2 x 1 x 2 metres
+    const float spacing = 0.2f, radius = 0.25f;
+
+    FILE* file = OpenReport(fileName, "buoyancy benchmark report",
+      "Path,Bodies,SamplesPerBody,Iterations,Threads,UsPerBodyFrame,MeanSubmerged,ForceError");
+
+    WavePatch patch(dim, spacing, 1.0f);
+
+    std::vector<XMFLOAT4> hull;
+    for (int y = 0; y < 2; ++y)
+    {
+      for (int z = 0; z < side; ++z)
+      {
+        for (int x = 0; x < side; ++x) {
+          hull.push_back(XMFLOAT4((2 * x + 1 - side) * radius, (2 * y - 1) * radius, (2 * z + 1 - side) * radius, radius));
+        }
+      }
+    }
+    int hullSamples = static_cast<int>(hull.size());
+    float hullVolume = hullSamples * 8.0f * radius * radius * radius;
+
+    ThreadPool threadPool;
+    threadPool.Init(0);
+
+    // Every path up to the best one the CPU supports
+    SimdPath best = SelectSimdPath(SIMD_PATH_AUTO);
+    for (int path = SIMD_PATH_SSE2; path <= best; ++path)
+    {
+      const OceanKernels& kernels = SelectOceanKernels(dim, dim, static_cast<SimdPath>(path));
+
+      for (int c = 0; c < ARRAYSIZE(bodyCounts); ++c)
+      {
+        int numBodies = bodyCounts[c];
+
+        // Bodies all over the patch, riding high and low and tipped every way
+        srand(0);
+        std::vector<XMFLOAT3> positions(numBodies);
+        std::vector<XMFLOAT4> orientations(numBodies);
+        for (int i = 0; i < numBodies; ++i)
+        {
+          positions[i] = XMFLOAT3(UniformRand(-0.5f, 0.5f) * patch.period, UniformRand(-0.8f, 0.8f),
+            UniformRand(-0.5f, 0.5f) * patch.period);
+          XMStoreFloat4(&orientations[i], XMQuaternionRotationRollPitchYaw(UniformRand(-0.3f, 0.3f),
+            UniformRand(-XM_PI, XM_PI), UniformRand(-0.3f, 0.3f)));
+        }
+
+        for (int t = 0; t < 2; ++t)
+        {
+          Buoyancy buoyancy;
+          buoyancy.Init(numBodies, numBodies * hullSamples, dim, dim, patch.origin, spacing, &kernels, t ? &threadPool : NULL);
+          for (int i = 0; i < numBodies; ++i)
+          {
+            buoyancy.AddBody(&hull[0], hullSamples);
+            buoyancy.SetPose(i, positions[i], orientations[i]);
+          }
+
+          for (int it = 0; it < ARRAYSIZE(iterationCounts); ++it)
+          {
+            Timer timer;
+            timer.Start();
+            for (int frame = 0; frame < frames; ++frame) {
+              buoyancy.Update(&patch.heightmap[0], iterationCounts[it]);
+            }
+            float time = timer.Stop();
+
+            // Checked against a scalar sum over the same surface heights, relative to the force on a body wholly under water
+            std::vector<XMFLOAT2> xz(hullSamples);
+            std::vector<float> surface(hullSamples);
+            double submerged = 0.0, worstError = 0.0;
+            for (int i = 0; i < numBodies; ++i)
+            {
+              XMFLOAT4X4 pose;
+              XMStoreFloat4x4(&pose, XMMatrixRotationQuaternion(XMLoadFloat4(&orientations[i])));
+              std::vector<float> y(hullSamples);
+              for (int s = 0; s < hullSamples; ++s)
+              {
+                const XMFLOAT4& p = hull[s];
+                xz[s] = XMFLOAT2(p.x * pose._11 + p.y * pose._21 + p.z * pose._31 + positions[i].x,
+                  p.x * pose._13 + p.y * pose._23 + p.z * pose._33 + positions[i].z);
+                y[s] = p.x * pose._12 + p.y * pose._22 + p.z * pose._32 + positions[i].y;
+              }
+              if (iterationCounts[it])
+              {
+                kernels.sampleDisplacedHeights(&patch.heightmap[0], dim, dim, patch.origin, spacing, &xz[0], hullSamples,
+                  iterationCounts[it], BUOYANCY_TOLERANCE, &surface[0], NULL, NULL, NULL);
+              }
+              else {
+                kernels.sampleHeights(&patch.heightmap[0], dim, dim, patch.origin, spacing, &xz[0], hullSamples, &surface[0],
+                  NULL);
+              }
+
+              double volume = 0.0, momentX = 0.0, momentZ = 0.0;
+              for (int s = 0; s < hullSamples; ++s)
+              {
+                double f = min(max((surface[s] - (y[s] - radius)) / (2.0 * radius), 0.0), 1.0);
+                double v = 8.0 * radius * radius * radius * f;
+                volume += v;
+                momentX += v * (xz[s].x - positions[i].x);
+                momentZ += v * (xz[s].y - positions[i].z);
+              }
+              double weight = BUOYANCY_WATER_DENSITY * BUOYANCY_GRAVITY;
+              const BuoyancyForce& force = buoyancy.GetForce(i);
+              worstError = max(worstError, fabs(force.force.y - weight * volume));
+              worstError = max(worstError, fabs(force.torque.x + weight * momentZ));
+              worstError = max(worstError, fabs(force.torque.z - weight * momentX));
+              submerged += volume / hullVolume;
+            }
+
+            fprintf(file, "%s,%d,%d,%d,%d,%.3f,%.3f,%g\n", GetSimdPathName(static_cast<SimdPath>(path)), numBodies, hullSamples,
+              iterationCounts[it], t ? threadPool.GetNumThreads() : 1, 1000.0f * time / (frames * numBodies), submerged / numBodies,
+              worstError / (BUOYANCY_WATER_DENSITY * BUOYANCY_GRAVITY * hullVolume));
+          }
+        }
+      }
+    }
+
+    fclose(file);
+  }
+}
@@ -0,0 +1,338 @@
+/*!
+  @file Cdlod.cpp @date 18/10/26 @brief Continuous distance-dependent level of detail for the ocean surface.
+*/
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdexcept>
+#include <vector>
+
+#include "Cdlod.h"
+#include "Utilities.h"
+
+namespace OceanWaves
+{
+  static const float CDLOD_RANGE_RATIO = 2.0f; // A level's range, in its nodes' sizes
+  static const float CDLOD_MORPH_START = 0.7f; // How far between the last range and its own a level starts to morph
+
+  // The nearest point of the box to p is within range of it
+  static bool BoxInRange(const XMFLOAT3& boxMin, const XMFLOAT3& boxMax, const XMFLOAT3& p, float range)
+  {
+    float dx = max(max(boxMin.x - p.x, 0.0f), p.x - boxMax.x);
+    float dy = max(max(boxMin.y - p.y, 0.0f), p.y - boxMax.y);
+    float dz = max(max(boxMin.z - p.z, 0.0f), p.z - boxMax.z);
+    return dx * dx + dy * dy + dz * dz < range * range;
+  }
+
+  Cdlod::~Cdlod()
+  {
+    SafeRelease(vsConstants_);
+    SafeRelease(instanceBuffer_);
+    SafeRelease(indexBuffer_);
+    SafeRelease(vertexBuffer_);
+    SafeRelease(vertexLayout_);
+    SafeRelease(vertexShader_);
+
+    SafeDeleteArray(selected_);
+  }
+
+  void Cdlod::Init(int numLevels, float spacing)
+  {
+    if (numLevels < 1 || numLevels > CDLOD_MAX_LEVELS) {
+      throw std::runtime_error("The CDLOD quadtree must have between 1 and 12 levels");
+    }
+    numLevels_ = numLevels;
+    spacing_ = spacing;
+    leafSize_ = CDLOD_PATCH_QUADS * spacing;
+
+    // Each level morphs over the far end of its range, which starts where the last one's ends
+    ZeroMemory(&constantData_, sizeof(constantData_));
+    float lastRange = 0.0f;
+    for (int level = 0; level < numLevels_; ++level)
+    {
+      ranges_[level] = CDLOD_RANGE_RATIO * leafSize_ * (1 << level);
+      float morphStart = lastRange + CDLOD_MORPH_START * (ranges_[level] - lastRange);
+      constantData_.morph[level] = XMFLOAT4(morphStart, 1.0f / (ranges_[level] - morphStart), spacing_ * (1 << level),
+        static_cast<float>(level));
+      lastRange = ranges_[level];
+    }
+    constantData_.params = XMFLOAT4(static_cast<float>(CDLOD_PATCH_QUADS), 0.0f, 0.0f, 0.0f);
+
+    // Allocated once, so selecting allocates nothing
+    selected_ = new XMFLOAT4[NUM_PARTS * CDLOD_MAX_NODES];
+  }
+
+  HRESULT Cdlod::InitBuffers(ID3D11Device* device)
+  {
+    HRESULT hr;
+
+    // Get device and immediate context
+    device_ = device;
+    assert(device_);
+    device_->GetImmediateContext(&immediateContext_);
+    assert(immediateContext_);
+
+    DXCALL(InitShaders());
+
+    // Generate the patch, with its indices a quadrant at a time so that each quadrant is a range of them
+    const int n = CDLOD_PATCH_QUADS, half = CDLOD_PATCH_QUADS / 2;
+    std::vector<XMFLOAT2> vertices;
+    for (int z = 0; z <= n; ++z)
+    {
+      for (int x = 0; x <= n; ++x) {
+        vertices.push_back(XMFLOAT2(static_cast<float>(x), static_cast<float>(z)));
+      }
+    }
+    std::vector<WORD> indices;
+    for (int part = PART_QUADRANT_00; part < NUM_PARTS; ++part)
+    {
+      int quadrant = part - PART_QUADRANT_00;
+      int startX = (quadrant & 1) * half, startZ = (quadrant >> 1) * half;
+
+      partStart_[part] = static_cast<unsigned int>(indices.size());
+      for (int z = startZ; z < startZ + half; ++z)
+      {
+        for (int x = startX; x < startX + half; ++x)
+        {
+          WORD topLeft = static_cast<WORD>(x + z * (n + 1));
+          WORD bottomLeft = static_cast<WORD>(topLeft + n + 1);
+          indices.push_back(topLeft);
+          indices.push_back(bottomLeft);
+          indices.push_back(topLeft + 1);
+          indices.push_back(topLeft + 1);
+          indices.push_back(bottomLeft);
+          indices.push_back(bottomLeft + 1);
+        }
+      }
+      partCount_[part] = static_cast<unsigned int>(indices.size()) - partStart_[part];
+    }
+    partStart_[PART_WHOLE] = 0;
+    partCount_[PART_WHOLE] = static_cast<unsigned int>(indices.size());
+
+    // Create vertex and index buffers
+    D3D11_BUFFER_DESC bd;
+    ZeroMemory(&bd, sizeof(bd));
+    bd.ByteWidth = static_cast<UINT>(sizeof(XMFLOAT2) * vertices.size());
+    bd.Usage = D3D11_USAGE_IMMUTABLE;
+    bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    bd.CPUAccessFlags = 0;
+    D3D11_SUBRESOURCE_DATA srd;
+    ZeroMemory(&srd, sizeof(srd));
+    srd.pSysMem = &vertices[0];
+    DXCALL(device_->CreateBuffer(&bd, &srd, &vertexBuffer_));
+
+    bd.ByteWidth = static_cast<UINT>(sizeof(WORD) * indices.size());
+    bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+    srd.pSysMem = &indices[0];
+    DXCALL(device_->CreateBuffer(&bd, &srd, &indexBuffer_));
+
+    // Create instance buffer, a segment of CDLOD_MAX_NODES per part, only the selected nodes of which are uploaded
+    bd.ByteWidth = sizeof(XMFLOAT4) * NUM_PARTS * CDLOD_MAX_NODES;
+    bd.Usage = D3D11_USAGE_DEFAULT;
+    DXCALL(device_->CreateBuffer(&bd, NULL, &instanceBuffer_));
+
+    // Create constant buffer
+    bd.ByteWidth = PAD16(sizeof(Constants));
+    bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    DXCALL(device_->CreateBuffer(&bd, NULL, &vsConstants_));
+
+    return S_OK;
+  }
+
+  HRESULT Cdlod::InitShaders()
+  {
+    HRESULT hr;
+
+    // Create vertex shader, which shares the ocean's pixel shaders
+    ID3DBlob* vsBlob = NULL;
+    DXCALL(CompileShaderFromFile("assets/shaders/OceanVSPS.hlsl", "OceanCdlodVS", "vs_4_0", &vsBlob));
+    DXCALL(device_->CreateVertexShader(vsBlob->GetBufferPointer(), vsBlob->GetBufferSize(),
+      NULL, &vertexShader_));
+
+    // Create input layout, the patch's vertices in slot 0 and the node each is drawn for in slot 1
+    D3D11_INPUT_ELEMENT_DESC layout[] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "INSTANCE", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+    };
+    DXCALL(device_->CreateInputLayout(layout, ARRAYSIZE(layout), vsBlob->GetBufferPointer(),
+      vsBlob->GetBufferSize(), &vertexLayout_));
+
+    SafeRelease(vsBlob);
+
+    return S_OK;
+  }
+
+  void Cdlod::Select(const XMFLOAT3& camera, const Frustum& frustum, const XMFLOAT3& bounds)
+  {
+    camera_ = camera;
+    frustum_ = &frustum;
+    bounds_ = bounds;
+    ZeroMemory(&stats_, sizeof(stats_));
+    ZeroMemory(numSelected_, sizeof(numSelected_));
+
+    // Every root on the lattice that the coarsest range reaches
+    float rootSize = leafSize_ * (1 << (numLevels_ - 1));
+    float range = ranges_[numLevels_ - 1] + max(bounds.x, bounds.z);
+    int firstX = static_cast<int>(floorf((camera.x - range) / rootSize));
+    int lastX = static_cast<int>(floorf((camera.x + range) / rootSize));
+    int firstZ = static_cast<int>(floorf((camera.z - range) / rootSize));
+    int lastZ = static_cast<int>(floorf((camera.z + range) / rootSize));
+    for (int z = firstZ; z <= lastZ; ++z)
+    {
+      for (int x = firstX; x <= lastX; ++x) {
+        SelectNode(x * rootSize, z * rootSize, numLevels_ - 1);
+      }
+    }
+
+    constantData_.camera = XMFLOAT4(camera.x, camera.y, camera.z, 1.0f);
+  }
+
+  /*
+    Returns whether the node's area is taken care of, either by being chosen (whole or in part) or by
+    being out of view. If it's out of range, its parent draws its area instead.
+  */
+  bool Cdlod::SelectNode(float x, float z, int level)
+  {
+    ++stats_.nodesVisited;
+
+    float size = leafSize_ * (1 << level);
+    XMFLOAT3 boxMin(x - bounds_.x, -bounds_.y, z - bounds_.z);
+    XMFLOAT3 boxMax(x + size + bounds_.x, bounds_.y, z + size + bounds_.z);
+
+    if (!BoxInRange(boxMin, boxMax, camera_, ranges_[level])) {
+      return false;
+    }
+    if (frustum_->TestBox(boxMin, boxMax) == Frustum::OUTSIDE) {
+      return true;
+    }
+    if (level == 0 || !BoxInRange(boxMin, boxMax, camera_, ranges_[level - 1]))
+    {
+      AddNode(PART_WHOLE, x, z, level);
+      return true;
+    }
+
+    // Whichever quadrants the children don't take are drawn at this level
+    float half = 0.5f * size;
+    bool taken[4];
+    for (int i = 0; i < 4; ++i) {
+      taken[i] = SelectNode(x + (i & 1) * half, z + (i >> 1) * half, level - 1);
+    }
+    if (!taken[0] && !taken[1] && !taken[2] && !taken[3])
+    {
+      AddNode(PART_WHOLE, x, z, level);
+      return true;
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+      if (!taken[i]) {
+        AddNode(static_cast<Part>(PART_QUADRANT_00 + i), x, z, level);
+      }
+    }
+    return true;
+  }
+
+  void Cdlod::AddNode(Part part, float x, float z, int level)
+  {
+    if (numSelected_[part] == CDLOD_MAX_NODES)
+    {
+      ++stats_.nodesDropped;
+      return;
+    }
+    selected_[part * CDLOD_MAX_NODES + numSelected_[part]++] = XMFLOAT4(x, z, leafSize_ * (1 << level),
+      static_cast<float>(level));
+    ++stats_.nodesSelected;
+  }
+
+  void Cdlod::Render()
+  {
+    immediateContext_->UpdateSubresource(vsConstants_, 0, NULL, &constantData_, 0, 0);
+
+    ID3D11Buffer* buffers[] = { vertexBuffer_, instanceBuffer_ };
+    UINT strides[] = { sizeof(XMFLOAT2), sizeof(XMFLOAT4) };
+    UINT offsets[] = { 0, 0 };
+
+    immediateContext_->IASetInputLayout(vertexLayout_);
+    immediateContext_->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+    immediateContext_->IASetIndexBuffer(indexBuffer_, DXGI_FORMAT_R16_UINT, 0);
+    immediateContext_->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+    immediateContext_->VSSetShader(vertexShader_, NULL, 0);
+    immediateContext_->VSSetConstantBuffers(4, 1, &vsConstants_);
+
+    for (int part = 0; part < NUM_PARTS; ++part)
+    {
+      if (!numSelected_[part]) {
+        continue;
+      }
+
+      // Only the part's selected nodes are uploaded, into its own segment
+      D3D11_BOX box = { part * CDLOD_MAX_NODES * sizeof(XMFLOAT4), 0, 0,
+        (part * CDLOD_MAX_NODES + numSelected_[part]) * sizeof(XMFLOAT4), 1, 1 };
+      immediateContext_->UpdateSubresource(instanceBuffer_, 0, &box, selected_ + part * CDLOD_MAX_NODES, 0, 0);
+      immediateContext_->DrawIndexedInstanced(partCount_[part], numSelected_[part], partStart_[part], 0,
+        part * CDLOD_MAX_NODES);
+    }
+  }
+
+  void WriteCdlodBenchmark(const char* fileName)
+  {
+    static const int levels[] = { 6, 8, 10, 12 };
+    static const char* pathNames[] = { "SeaLevel", "Altitude" };
+    static const float pathHeights[] = { 2.0f, 300.0f };
+    static const float pathPitches[] = { 5.0f, 45.0f }; // Degrees below the horizon
+    static const float pathSpeeds[] = { 1.0f, 10.0f }; // Metres per frame
+    const int frames = 600;
+    const XMFLOAT3 bounds(2.0f, 3.0f, 2.0f);
+
+    FILE* file = OpenReport(fileName, "CDLOD benchmark report",
+      "Path,Levels,Frames,MeanSelectMs,WorstSelectMs,MeanVisited,MeanSelected,WorstSelected,Dropped");
+
+    XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 20000.0f);
+    for (int p = 0; p < ARRAYSIZE(pathNames); ++p)
+    {
+      for (int l = 0; l < ARRAYSIZE(levels); ++l)
+      {
+        Cdlod cdlod;
+        cdlod.Init(levels[l], 0.2f);
+
+        Timer timer;
+        float totalTime = 0.0f, worstTime = 0.0f;
+        double totalVisited = 0.0, totalSelected = 0.0;
+        int worstSelected = 0, dropped = 0;
+
+        // Flying forwards while slowly turning, so nodes come in and out of range and view
+        for (int frame = 0; frame < frames; ++frame)
+        {
+          float yaw = 0.002f * frame, pitch = XMConvertToRadians(pathPitches[p]);
+          XMFLOAT3 camera(pathSpeeds[p] * frame, pathHeights[p], 0.25f * pathSpeeds[p] * frame);
+          XMVECTOR eye = XMLoadFloat3(&camera);
+          XMVECTOR look = XMVectorSet(sinf(yaw) * cosf(pitch), -sinf(pitch), cosf(yaw) * cosf(pitch), 0.0f);
+          XMFLOAT4X4 viewProjection;
+          XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(XMMatrixLookToLH(eye, look, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)),
+            projection));
+
+          Frustum frustum;
+          timer.Start();
+          frustum.Extract(viewProjection);
+          cdlod.Select(camera, frustum, bounds);
+          float time = timer.Stop();
+
+          const CdlodStats& stats = cdlod.GetStats();
+          totalTime += time;
+          worstTime = max(worstTime, time);
+          totalVisited += stats.nodesVisited;
+          totalSelected += stats.nodesSelected;
+          worstSelected = max(worstSelected, stats.nodesSelected);
+          dropped += stats.nodesDropped;
+        }
+
+        fprintf(file, "%s,%d,%d,%.4f,%.4f,%.1f,%.1f,%d,%d\n", pathNames[p], levels[l], frames, totalTime / frames, worstTime,
+          totalVisited / frames, totalSelected / frames, worstSelected, dropped);
+      }
+    }
+
+    fclose(file);
+  }
+}
@@ -0,0 +1,97 @@
+/*!
+  @file ChannelHistory.cpp @date 18/10/26 @brief History of an interpolated ocean channel.
+*/
+
+#include <utility>
+
+#include "ChannelHistory.h"
+#include "Simd.h"
+#include "Utilities.h"
+
+namespace OceanWaves
+{
+  ChannelHistory::~ChannelHistory()
+  {
+    SafeDeleteArray(halfCurr_);
+    SafeDeleteArray(halfPrev_);
+    SafeDeleteArray(curr_);
+    SafeDeleteArray(prev_);
+  }
+
+  void ChannelHistory::Init(unsigned int size, bool halfPrecision)
+  {
+    size_ = size;
+    halfPrecision_ = halfPrecision;
+
+    if (halfPrecision_)
+    {
+      halfPrev_ = new HALF[size_ * 2];
+      halfCurr_ = new HALF[size_ * 2];
+    }
+    else {
+      prev_ = new XMFLOAT2[size_];
+      curr_ = new XMFLOAT2[size_];
+    }
+  }
+
+  void ChannelHistory::Advance()
+  {
+    std::swap(prev_, curr_);
+    std::swap(halfPrev_, halfCurr_);
+  }
+
+  void ChannelHistory::Store(unsigned int offset, unsigned int count, const XMFLOAT2* values)
+  {
+    if (halfPrecision_) {
+      FloatToHalf(halfCurr_ + offset * 2, reinterpret_cast<const float*>(values), count * 2);
+    }
+    else {
+      memcpy(curr_ + offset, values, sizeof(XMFLOAT2) * count);
+    }
+  }
+
+  void ChannelHistory::Restart()
+  {
+    if (halfPrecision_) {
+      memcpy(halfPrev_, halfCurr_, sizeof(HALF) * size_ * 2);
+    }
+    else {
+      memcpy(prev_, curr_, sizeof(XMFLOAT2) * size_);
+    }
+  }
+
+  void ChannelHistory::Blend(unsigned int offset, unsigned int count, float alpha, XMFLOAT2* values) const
+  {
+    if (!halfPrecision_)
+    {
+      for (unsigned int i = 0; i < count; ++i)
+      {
+        const XMFLOAT2& p = prev_[offset + i];
+        const XMFLOAT2& c = curr_[offset + i];
+        values[i].x = p.x + (c.x - p.x) * alpha;
+        values[i].y = p.y + (c.y - p.y) * alpha;
+      }
+      return;
+    }
+
+    // Widen a block at a time, so that only the half precision history is streamed from memory
+    XMFLOAT2 p[BLOCK_SIZE], c[BLOCK_SIZE];
+    for (unsigned int block = 0; block < count; block += BLOCK_SIZE)
+    {
+      unsigned int n = min(BLOCK_SIZE, count - block);
+      HalfToFloat(reinterpret_cast<float*>(p), halfPrev_ + (offset + block) * 2, n * 2);
+      HalfToFloat(reinterpret_cast<float*>(c), halfCurr_ + (offset + block) * 2, n * 2);
+
+      for (unsigned int i = 0; i < n; ++i)
+      {
+        values[block + i].x = p[i].x + (c[i].x - p[i].x) * alpha;
+        values[block + i].y = p[i].y + (c[i].y - p[i].y) * alpha;
+      }
+    }
+  }
+
+  unsigned int ChannelHistory::GetBytes() const
+  {
+    return size_ * 2 * (halfPrecision_ ? sizeof(HALF) : sizeof(float));
+  }
+}
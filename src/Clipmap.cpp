@@ -0,0 +1,263 @@
+/*!
+  @file Clipmap.cpp @date 18/10/26 @brief Geometry clipmap rendering of the ocean surface.
+*/
+
+#include <assert.h>
+#include <math.h>
+#include <stdexcept>
+#include <vector>
+
+#include "Clipmap.h"
+#include "Utilities.h"
+
+namespace OceanWaves
+{
+  // Quads along a block's side, and along a level's: four blocks and a fix-up two quads wide
+  static const int M = CLIPMAP_BLOCK_SIZE - 1;
+  static const int LEVEL_QUADS = 4 * M + 2;
+
+  // Append a grid of w x h vertices at unit spacing, as a triangle list wound as the ocean mesh is
+  static void AppendGrid(int w, int h, std::vector<XMFLOAT2>& vertices, std::vector<WORD>& indices)
+  {
+    WORD first = static_cast<WORD>(vertices.size());
+    for (int z = 0; z < h; ++z)
+    {
+      for (int x = 0; x < w; ++x) {
+        vertices.push_back(XMFLOAT2(static_cast<float>(x), static_cast<float>(z)));
+      }
+    }
+    for (int z = 0; z < h - 1; ++z)
+    {
+      for (int x = 0; x < w - 1; ++x)
+      {
+        WORD topLeft = first + x + z * w;
+        WORD bottomLeft = topLeft + w;
+        indices.push_back(topLeft);
+        indices.push_back(bottomLeft);
+        indices.push_back(topLeft + 1);
+        indices.push_back(topLeft + 1);
+        indices.push_back(bottomLeft);
+        indices.push_back(bottomLeft + 1);
+      }
+    }
+  }
+
+  Clipmap::~Clipmap()
+  {
+    SafeRelease(vsConstants_);
+    SafeRelease(instanceBuffer_);
+    SafeRelease(indexBuffer_);
+    SafeRelease(vertexBuffer_);
+    SafeRelease(vertexLayout_);
+    SafeRelease(vertexShader_);
+
+    SafeDeleteArray(instances_);
+  }
+
+  void Clipmap::Init(ID3D11Device* device, int numLevels, float spacing)
+  {
+    // Get device and immediate context
+    device_ = device;
+    assert(device_);
+    device_->GetImmediateContext(&immediateContext_);
+    assert(immediateContext_);
+
+    if (numLevels < 1 || numLevels > CLIPMAP_MAX_LEVELS) {
+      throw std::runtime_error("The clipmap must have between 1 and 16 levels");
+    }
+    numLevels_ = numLevels;
+    spacing_ = spacing;
+
+    ZeroMemory(&levelConstants_, sizeof(levelConstants_));
+    levelConstants_.params = XMFLOAT4(static_cast<float>(LEVEL_QUADS), 0.0f, 0.0f, 0.0f);
+
+    InitShaders();
+    InitBuffers();
+    Update(XMFLOAT3(0.0f, 0.0f, 0.0f));
+  }
+
+  HRESULT Clipmap::InitShaders()
+  {
+    HRESULT hr;
+
+    // Create vertex shader, which shares the ocean's pixel shaders
+    ID3DBlob* vsBlob = NULL;
+    DXCALL(CompileShaderFromFile("assets/shaders/OceanVSPS.hlsl", "OceanClipmapVS", "vs_4_0", &vsBlob));
+    DXCALL(device_->CreateVertexShader(vsBlob->GetBufferPointer(), vsBlob->GetBufferSize(),
+      NULL, &vertexShader_));
+
+    // Create input layout, the pieces' vertices in slot 0 and where each is placed in slot 1
+    D3D11_INPUT_ELEMENT_DESC layout[] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "INSTANCE", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+    };
+    DXCALL(device_->CreateInputLayout(layout, ARRAYSIZE(layout), vsBlob->GetBufferPointer(),
+      vsBlob->GetBufferSize(), &vertexLayout_));
+
+    SafeRelease(vsBlob);
+
+    return S_OK;
+  }
+
+  HRESULT Clipmap::InitBuffers()
+  {
+    HRESULT hr;
+
+    // Generate each piece once
+    static const int pieceDims[NUM_PIECES][2] =
+    {
+      { M + 1, M + 1 }, { 3, M + 1 }, { M + 1, 3 }, { 2, 2 * M + 3 }, { 2 * M + 2, 2 }, { 3, 3 }
+    };
+    std::vector<XMFLOAT2> vertices;
+    std::vector<WORD> indices;
+    for (int i = 0; i < NUM_PIECES; ++i)
+    {
+      pieces_[i].baseVertex = static_cast<int>(vertices.size());
+      pieces_[i].startIndex = static_cast<unsigned int>(indices.size());
+
+      std::vector<XMFLOAT2> pieceVertices;
+      AppendGrid(pieceDims[i][0], pieceDims[i][1], pieceVertices, indices);
+      vertices.insert(vertices.end(), pieceVertices.begin(), pieceVertices.end());
+
+      pieces_[i].numIndices = static_cast<unsigned int>(indices.size()) - pieces_[i].startIndex;
+    }
+
+    // Place them in every level, in piece order. Blocks and fix-ups don't move within their level.
+    static const int blockOffsets[] = { 0, M, 2 * M + 2, 3 * M + 2 };
+    std::vector<XMFLOAT3> placed[NUM_PIECES];
+    for (int level = 0; level < numLevels_; ++level)
+    {
+      float l = static_cast<float>(level);
+      for (int z = 0; z < 4; ++z)
+      {
+        for (int x = 0; x < 4; ++x)
+        {
+          // The middle of every level but the finest is the next finer level
+          bool inner = (x == 1 || x == 2) && (z == 1 || z == 2);
+          if (!inner || level == 0) {
+            placed[PIECE_BLOCK].push_back(XMFLOAT3(static_cast<float>(blockOffsets[x]), static_cast<float>(blockOffsets[z]), l));
+          }
+        }
+      }
+      for (int i = 0; i < 4; ++i)
+      {
+        bool inner = (i == 1 || i == 2);
+        if (!inner || level == 0)
+        {
+          placed[PIECE_FIXUP_VERTICAL].push_back(XMFLOAT3(2.0f * M, static_cast<float>(blockOffsets[i]), l));
+          placed[PIECE_FIXUP_HORIZONTAL].push_back(XMFLOAT3(static_cast<float>(blockOffsets[i]), 2.0f * M, l));
+        }
+      }
+      if (level == 0) {
+        placed[PIECE_CENTRE].push_back(XMFLOAT3(2.0f * M, 2.0f * M, l));
+      }
+      else
+      {
+        // Moved to whichever sides the finer level leaves uncovered by Update
+        placed[PIECE_TRIM_VERTICAL].push_back(XMFLOAT3(0.0f, 0.0f, l));
+        placed[PIECE_TRIM_HORIZONTAL].push_back(XMFLOAT3(0.0f, 0.0f, l));
+      }
+    }
+    for (int i = 0; i < NUM_PIECES; ++i)
+    {
+      pieces_[i].firstInstance = numInstances_;
+      pieces_[i].numInstances = static_cast<unsigned int>(placed[i].size());
+      numInstances_ += pieces_[i].numInstances;
+    }
+    instances_ = new XMFLOAT3[numInstances_];
+    for (int i = 0; i < NUM_PIECES; ++i)
+    {
+      for (unsigned int j = 0; j < pieces_[i].numInstances; ++j) {
+        instances_[pieces_[i].firstInstance + j] = placed[i][j];
+      }
+    }
+
+    // Create vertex and index buffers
+    D3D11_BUFFER_DESC bd;
+    ZeroMemory(&bd, sizeof(bd));
+    bd.ByteWidth = static_cast<UINT>(sizeof(XMFLOAT2) * vertices.size());
+    bd.Usage = D3D11_USAGE_IMMUTABLE;
+    bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    bd.CPUAccessFlags = 0;
+    D3D11_SUBRESOURCE_DATA srd;
+    ZeroMemory(&srd, sizeof(srd));
+    srd.pSysMem = &vertices[0];
+    DXCALL(device_->CreateBuffer(&bd, &srd, &vertexBuffer_));
+
+    bd.ByteWidth = static_cast<UINT>(sizeof(WORD) * indices.size());
+    bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+    srd.pSysMem = &indices[0];
+    DXCALL(device_->CreateBuffer(&bd, &srd, &indexBuffer_));
+
+    // Create instance buffer, rewritten as the trims move
+    bd.ByteWidth = sizeof(XMFLOAT3) * numInstances_;
+    bd.Usage = D3D11_USAGE_DEFAULT;
+    bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    srd.pSysMem = instances_;
+    DXCALL(device_->CreateBuffer(&bd, &srd, &instanceBuffer_));
+
+    // Create constant buffer
+    bd.ByteWidth = PAD16(sizeof(Constants));
+    bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    DXCALL(device_->CreateBuffer(&bd, NULL, &vsConstants_));
+
+    return S_OK;
+  }
+
+  void Clipmap::Update(const XMFLOAT3& camera)
+  {
+    // Each level is snapped to the spacing of the next coarser one, so its vertices are a superset of that
+    // level's where they meet. The camera is then always within two quads of the middle of every level.
+    XMFLOAT2 origins[CLIPMAP_MAX_LEVELS];
+    for (int level = 0; level < numLevels_; ++level)
+    {
+      float spacing = spacing_ * (1 << level);
+      float snap = 2.0f * spacing;
+      origins[level].x = floorf(camera.x / snap) * snap - 2 * M * spacing;
+      origins[level].y = floorf(camera.z / snap) * snap - 2 * M * spacing;
+      levelConstants_.levels[level] = XMFLOAT4(origins[level].x, origins[level].y, spacing, static_cast<float>(level));
+    }
+
+    // The finer level sits one of two ways along each axis in the hole in the next, leaving a quad wide L to fill
+    for (int level = 1; level < numLevels_; ++level)
+    {
+      float spacing = levelConstants_.levels[level].z;
+      bool left = floorf((origins[level - 1].x - origins[level].x) / spacing + 0.5f) > M;
+      bool bottom = floorf((origins[level - 1].y - origins[level].y) / spacing + 0.5f) > M;
+
+      XMFLOAT3& vertical = instances_[pieces_[PIECE_TRIM_VERTICAL].firstInstance + level - 1];
+      XMFLOAT3& horizontal = instances_[pieces_[PIECE_TRIM_HORIZONTAL].firstInstance + level - 1];
+      vertical.x = left ? static_cast<float>(M) : 3.0f * M + 1.0f;
+      vertical.y = static_cast<float>(M);
+      horizontal.x = left ? M + 1.0f : static_cast<float>(M);
+      horizontal.y = bottom ? static_cast<float>(M) : 3.0f * M + 1.0f;
+    }
+
+    immediateContext_->UpdateSubresource(instanceBuffer_, 0, NULL, instances_, 0, 0);
+    immediateContext_->UpdateSubresource(vsConstants_, 0, NULL, &levelConstants_, 0, 0);
+  }
+
+  void Clipmap::Render()
+  {
+    ID3D11Buffer* buffers[] = { vertexBuffer_, instanceBuffer_ };
+    UINT strides[] = { sizeof(XMFLOAT2), sizeof(XMFLOAT3) };
+    UINT offsets[] = { 0, 0 };
+
+    immediateContext_->IASetInputLayout(vertexLayout_);
+    immediateContext_->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+    immediateContext_->IASetIndexBuffer(indexBuffer_, DXGI_FORMAT_R16_UINT, 0);
+    immediateContext_->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+    immediateContext_->VSSetShader(vertexShader_, NULL, 0);
+    immediateContext_->VSSetConstantBuffers(3, 1, &vsConstants_);
+
+    for (int i = 0; i < NUM_PIECES; ++i)
+    {
+      if (pieces_[i].numInstances) {
+        immediateContext_->DrawIndexedInstanced(pieces_[i].numIndices, pieces_[i].numInstances, pieces_[i].startIndex,
+          pieces_[i].baseVertex, pieces_[i].firstInstance);
+      }
+    }
+  }
+}
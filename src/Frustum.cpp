@@ -0,0 +1,56 @@
+/*!
+  @file Frustum.cpp @date 18/10/26 @brief A view frustum for culling bounding boxes.
+*/
+
+#include <math.h>
+
+#include "Frustum.h"
+
+namespace OceanWaves
+{
+  void Frustum::Extract(const XMFLOAT4X4& viewProjection)
+  {
+    const XMFLOAT4X4& m = viewProjection;
+
+    // Each plane is a sum or difference of the matrix's columns (Gribb and Hartmann)
+    planes_[0] = XMFLOAT4(m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41);
+    planes_[1] = XMFLOAT4(m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41);
+    planes_[2] = XMFLOAT4(m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42);
+    planes_[3] = XMFLOAT4(m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42);
+    planes_[4] = XMFLOAT4(m._13, m._23, m._33, m._43);
+    planes_[5] = XMFLOAT4(m._14 - m._13, m._24 - m._23, m._34 - m._33, m._44 - m._43);
+
+    for (int i = 0; i < 6; ++i)
+    {
+      XMFLOAT4& p = planes_[i];
+      float inverseLength = 1.0f / sqrtf(p.x * p.x + p.y * p.y + p.z * p.z);
+      p.x *= inverseLength;
+      p.y *= inverseLength;
+      p.z *= inverseLength;
+      p.w *= inverseLength;
+    }
+  }
+
+  Frustum::Containment Frustum::TestBox(const XMFLOAT3& boxMin, const XMFLOAT3& boxMax) const
+  {
+    Containment result = INSIDE;
+    for (int i = 0; i < 6; ++i)
+    {
+      const XMFLOAT4& p = planes_[i];
+
+      // The corner furthest along the normal is outside only if the whole box is
+      float furthest = p.x * (p.x > 0.0f ? boxMax.x : boxMin.x) + p.y * (p.y > 0.0f ? boxMax.y : boxMin.y) +
+        p.z * (p.z > 0.0f ? boxMax.z : boxMin.z) + p.w;
+      if (furthest < 0.0f) {
+        return OUTSIDE;
+      }
+
+      float nearest = p.x * (p.x > 0.0f ? boxMin.x : boxMax.x) + p.y * (p.y > 0.0f ? boxMin.y : boxMax.y) +
+        p.z * (p.z > 0.0f ? boxMin.z : boxMax.z) + p.w;
+      if (nearest < 0.0f) {
+        result = INTERSECTS;
+      }
+    }
+    return result;
+  }
+}
@@ -0,0 +1,281 @@
+/*!
+  @file HeightPyramid.cpp @date 18/10/26 @brief Hierarchical bounds of the ocean surface.
+*/
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <vector>
+
+#include "HeightPyramid.h"
+#include "Utilities.h"
+
+namespace OceanWaves
+{
+  namespace
+  {
+    const int VERTEX_FLOATS = sizeof(VertexDispNor) / sizeof(float);
+
+    // Widen accLower...accUpper to take in lower...upper
+    void Include(const VertexDispNor& lower, const VertexDispNor& upper, VertexDispNor* accLower, VertexDispNor* accUpper)
+    {
+      const float* l = &lower.Disp.x, * u = &upper.Disp.x;
+      float* al = &accLower->Disp.x, * au = &accUpper->Disp.x;
+      for (int i = 0; i < VERTEX_FLOATS; ++i)
+      {
+        al[i] = min(al[i], l[i]);
+        au[i] = max(au[i], u[i]);
+      }
+    }
+  }
+
+  HeightPyramid::~HeightPyramid()
+  {
+    SafeDeleteArray(scratch_);
+    SafeDeleteArray(upper_);
+    SafeDeleteArray(lower_);
+  }
+
+  void HeightPyramid::Init(int dimX, int dimY, const XMFLOAT2& origin, float spacing, const OceanKernels* kernels,
+    ThreadPool* threadPool)
+  {
+    dimX_ = dimX;
+    dimY_ = dimY;
+    origin_ = origin;
+    spacing_ = spacing;
+    kernels_ = kernels;
+    threadPool_ = threadPool;
+
+    // A level's cells are only whole blocks of the quads below while both dimensions halve exactly
+    numLevels_ = 1;
+    while (numLevels_ < HEIGHT_PYRAMID_MAX_LEVELS && ((dimX_ >> (numLevels_ - 1)) % 2) == 0 && ((dimY_ >> (numLevels_ - 1)) % 2) == 0) {
+      ++numLevels_;
+    }
+
+    levelOffsets_[0] = 0;
+    for (int level = 0; level < numLevels_; ++level) {
+      levelOffsets_[level + 1] = levelOffsets_[level] + (dimX_ >> level) * (dimY_ >> level);
+    }
+    lower_ = new VertexDispNor[levelOffsets_[numLevels_]];
+    upper_ = new VertexDispNor[levelOffsets_[numLevels_]];
+    ZeroMemory(lower_, sizeof(VertexDispNor) * levelOffsets_[numLevels_]);
+    ZeroMemory(upper_, sizeof(VertexDispNor) * levelOffsets_[numLevels_]);
+    scratch_ = new VertexDispNor[(dimY_ / 2) * 2 * dimX_];
+  }
+
+  void HeightPyramid::Build(const VertexDispNor* vertices)
+  {
+    vertices_ = vertices;
+    for (buildLevel_ = 0; buildLevel_ < numLevels_; ++buildLevel_) {
+      threadPool_->ParallelFor(dimY_ >> buildLevel_, ReduceRow, this);
+    }
+  }
+
+  void HeightPyramid::ReduceRow(void* pyramid, int row)
+  {
+    HeightPyramid* p = static_cast<HeightPyramid*>(pyramid);
+
+    int level = p->buildLevel_;
+    int w = p->dimX_ >> level;
+    float* lower = &p->lower_[p->levelOffsets_[level] + row * w].Disp.x;
+    float* upper = &p->upper_[p->levelOffsets_[level] + row * w].Disp.x;
+
+    // A quad's corners are its vertex, the next one along and the two below them, and the last quad's next vertex is the first
+    if (level == 0)
+    {
+      const float* r0 = &p->vertices_[row * w].Disp.x;
+      const float* r1 = &p->vertices_[((row + 1) % p->dimY_) * w].Disp.x;
+      const float* rows[] = { r0, r1, r0 + VERTEX_FLOATS, r1 + VERTEX_FLOATS };
+      p->kernels_->rowBounds(rows, rows, 4, VERTEX_FLOATS * (w - 1), lower, upper);
+
+      int last = VERTEX_FLOATS * (w - 1);
+      const float* lastRows[] = { r0 + last, r1 + last, r0, r1 };
+      p->kernels_->rowBounds(lastRows, lastRows, 4, VERTEX_FLOATS, lower + last, upper + last);
+      return;
+    }
+
+    // Every pair of neighbouring cells of the two rows below, of which the even pairs are this row's blocks
+    int srcW = 2 * w;
+    const float* l0 = &p->lower_[p->levelOffsets_[level - 1] + 2 * row * srcW].Disp.x, * l1 = l0 + VERTEX_FLOATS * srcW;
+    const float* u0 = &p->upper_[p->levelOffsets_[level - 1] + 2 * row * srcW].Disp.x, * u1 = u0 + VERTEX_FLOATS * srcW;
+    const float* lowerRows[] = { l0, l1, l0 + VERTEX_FLOATS, l1 + VERTEX_FLOATS };
+    const float* upperRows[] = { u0, u1, u0 + VERTEX_FLOATS, u1 + VERTEX_FLOATS };
+    VertexDispNor* pairLower = p->scratch_ + row * 2 * srcW, * pairUpper = pairLower + srcW;
+    p->kernels_->rowBounds(lowerRows, upperRows, 4, VERTEX_FLOATS * (srcW - 1), &pairLower[0].Disp.x, &pairUpper[0].Disp.x);
+
+    for (int x = 0; x < w; ++x)
+    {
+      reinterpret_cast<VertexDispNor*>(lower)[x] = pairLower[2 * x];
+      reinterpret_cast<VertexDispNor*>(upper)[x] = pairUpper[2 * x];
+    }
+  }
+
+  void HeightPyramid::GetCell(int level, int x, int z, VertexDispNor* lower, VertexDispNor* upper) const
+  {
+    int w = dimX_ >> level, h = dimY_ >> level;
+    int i = levelOffsets_[level] + ((z % h + h) % h) * w + (x % w + w) % w;
+    *lower = lower_[i];
+    *upper = upper_[i];
+  }
+
+  void HeightPyramid::GetBounds(VertexDispNor* lower, VertexDispNor* upper) const
+  {
+    int top = numLevels_ - 1;
+    *lower = lower_[levelOffsets_[top]];
+    *upper = upper_[levelOffsets_[top]];
+    for (int i = levelOffsets_[top] + 1; i < levelOffsets_[numLevels_]; ++i) {
+      Include(lower_[i], upper_[i], lower, upper);
+    }
+  }
+
+  int HeightPyramid::Query(const XMFLOAT2& regionMin, const XMFLOAT2& regionMax, VertexDispNor* lower, VertexDispNor* upper) const
+  {
+    // A vertex lands in the region if it starts there less its displacement, so the region is moved back by the most
+    // the surface is displaced either way and taken in quads, which hold the vertices at their corners
+    VertexDispNor wholeLower, wholeUpper;
+    GetBounds(&wholeLower, &wholeUpper);
+    float x0 = (regionMin.x - wholeUpper.Disp.x - origin_.x) / spacing_, x1 = (regionMax.x - wholeLower.Disp.x - origin_.x) / spacing_;
+    float z0 = (regionMin.y - wholeUpper.Disp.z - origin_.y) / spacing_, z1 = (regionMax.y - wholeLower.Disp.z - origin_.y) / spacing_;
+
+    // Brought into the patch, those wider than it cover all of it
+    int cellX0 = 0, cellX1 = dimX_ - 1, cellZ0 = 0, cellZ1 = dimY_ - 1;
+    if (x1 - x0 < dimX_ - 1)
+    {
+      float shift = floorf(x0 / dimX_) * dimX_;
+      cellX0 = static_cast<int>(floorf(x0 - shift));
+      cellX1 = static_cast<int>(floorf(x1 - shift));
+    }
+    if (z1 - z0 < dimY_ - 1)
+    {
+      float shift = floorf(z0 / dimY_) * dimY_;
+      cellZ0 = static_cast<int>(floorf(z0 - shift));
+      cellZ1 = static_cast<int>(floorf(z1 - shift));
+    }
+
+    // The finest level the region spans at most two cells of along each axis, unless the pyramid stops short of it
+    int level = 0;
+    while (level < numLevels_ - 1 && ((cellX1 >> level) - (cellX0 >> level) > 1 || (cellZ1 >> level) - (cellZ0 >> level) > 1)) {
+      ++level;
+    }
+
+    int w = dimX_ >> level, h = dimY_ >> level;
+    int countX = min((cellX1 >> level) - (cellX0 >> level) + 1, w), countZ = min((cellZ1 >> level) - (cellZ0 >> level) + 1, h);
+    GetCell(level, cellX0 >> level, cellZ0 >> level, lower, upper);
+    for (int z = 0; z < countZ; ++z)
+    {
+      for (int x = 0; x < countX; ++x)
+      {
+        VertexDispNor cellLower, cellUpper;
+        GetCell(level, (cellX0 >> level) + x, (cellZ0 >> level) + z, &cellLower, &cellUpper);
+        Include(cellLower, cellUpper, lower, upper);
+      }
+    }
+
+    return level;
+  }
+
+  void WriteHeightPyramidReport(const char* fileName)
+  {
+    static const int sizes[] = { 64, 128, 256, 512 };
+    const int frames = 16, queries = 256;
+    const float spacing = 0.2f, choppiness = 1.0f;
+
+    FILE* file = OpenReport(fileName, "height pyramid report",
+      "Path,Size,Levels,Threads,BuildMs,QueryUs,MeanQueryLevel,Violations,MeanHeightRange,MeanExactHeightRange");
+
+    ThreadPool threadPool;
+    threadPool.Init(0);
+
+    // Every path up to the best one the CPU supports
+    SimdPath best = SelectSimdPath(SIMD_PATH_AUTO);
+    for (int path = SIMD_PATH_SSE2; path <= best; ++path)
+    {
+      for (int s = 0; s < ARRAYSIZE(sizes); ++s)
+      {
+        int dim = sizes[s];
+        const OceanKernels& kernels = SelectOceanKernels(dim, dim, static_cast<SimdPath>(path));
+
+        WavePatch patch(dim, spacing, choppiness);
+        const VertexDispNor* heightmap = &patch.heightmap[0];
+        const XMFLOAT2& origin = patch.origin;
+        float period = patch.period;
+
+        HeightPyramid pyramid;
+        pyramid.Init(dim, dim, origin, spacing, &kernels, &threadPool);
+
+        Timer timer;
+        float buildTime = 0.0f;
+        for (int frame = 0; frame < frames; ++frame)
+        {
+          timer.Start();
+          pyramid.Build(heightmap);
+          buildTime += timer.Stop();
+        }
+
+        // Regions from a fraction of a quad to several patches across, anywhere on the tiled plane
+        srand(0);
+        std::vector<XMFLOAT2> regionMin(queries), regionMax(queries);
+        for (int q = 0; q < queries; ++q)
+        {
+          float width = period * powf(2.0f, UniformRand(-10.0f, 1.5f)), depth = period * powf(2.0f, UniformRand(-10.0f, 1.5f));
+          regionMin[q] = XMFLOAT2(UniformRand(-3.0f * period, 3.0f * period), UniformRand(-3.0f * period, 3.0f * period));
+          regionMax[q] = XMFLOAT2(regionMin[q].x + width, regionMin[q].y + depth);
+        }
+
+        std::vector<VertexDispNor> lower(queries), upper(queries);
+        int totalLevel = 0;
+        timer.Start();
+        for (int q = 0; q < queries; ++q) {
+          totalLevel += pyramid.Query(regionMin[q], regionMax[q], &lower[q], &upper[q]);
+        }
+        float queryTime = timer.Stop();
+
+        // Every vertex displaced into a region, or any copy of the patch's, must lie within its bounds
+        int violations = 0, nonEmpty = 0;
+        float totalRange = 0.0f, totalExactRange = 0.0f;
+        for (int q = 0; q < queries; ++q)
+        {
+          float exactLower = FLT_MAX, exactUpper = -FLT_MAX;
+          for (int z = 0; z < dim; ++z)
+          {
+            for (int x = 0; x < dim; ++x)
+            {
+              const VertexDispNor& v = heightmap[z * dim + x];
+              float px = origin.x + x * spacing + v.Disp.x, pz = origin.y + z * spacing + v.Disp.z;
+              if (floorf((regionMax[q].x - px) / period) < ceilf((regionMin[q].x - px) / period) ||
+                floorf((regionMax[q].y - pz) / period) < ceilf((regionMin[q].y - pz) / period)) {
+                continue;
+              }
+
+              const float* c = &v.Disp.x, * l = &lower[q].Disp.x, * u = &upper[q].Disp.x;
+              for (int i = 0; i < VERTEX_FLOATS; ++i)
+              {
+                if (c[i] < l[i] || c[i] > u[i])
+                {
+                  ++violations;
+                  break;
+                }
+              }
+              exactLower = min(exactLower, v.Disp.y);
+              exactUpper = max(exactUpper, v.Disp.y);
+            }
+          }
+          if (exactLower <= exactUpper)
+          {
+            totalRange += upper[q].Disp.y - lower[q].Disp.y;
+            totalExactRange += exactUpper - exactLower;
+            ++nonEmpty;
+          }
+        }
+
+        fprintf(file, "%s,%d,%d,%d,%.4f,%.3f,%.2f,%d,%.4f,%.4f\n", GetSimdPathName(static_cast<SimdPath>(path)), dim,
+          pyramid.GetNumLevels(), threadPool.GetNumThreads(), buildTime / frames, 1000.0f * queryTime / queries,
+          totalLevel / static_cast<float>(queries), violations, totalRange / max(nonEmpty, 1), totalExactRange / max(nonEmpty, 1));
+      }
+    }
+
+    fclose(file);
+  }
+}
@@ -0,0 +1,367 @@
+/*!
+  @file HeightmapTextures.cpp @date 18/10/26 @brief The heightmap's displacements and normals as textures.
+*/
+
+#include <assert.h>
+#include <math.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <vector>
+
+#include "HeightmapTextures.h"
+#include "Utilities.h"
+
+namespace OceanWaves
+{
+  namespace
+  {
+    // The Kaiser window's shape parameter, and its reach in source texels (so it has twice that many taps)
+    const float KAISER_BETA = 4.0f;
+    const int KAISER_RADIUS = 4;
+
+    // The modified Bessel function of the first kind of order 0, from its power series
+    float BesselI0(float x)
+    {
+      float sum = 1.0f, term = 1.0f;
+      for (int k = 1; k < 32; ++k)
+      {
+        term *= (0.5f * x / k) * (0.5f * x / k);
+        sum += term;
+      }
+      return sum;
+    }
+
+    // An index wrapped into [0, n), however far the taps reach out of it
+    inline int Wrap(int i, int n)
+    {
+      return (i % n + n) % n;
+    }
+  }
+
+  HeightmapTextures::~HeightmapTextures()
+  {
+    SafeRelease(constants_);
+    SafeRelease(sampler_);
+    SafeRelease(srv_);
+    SafeRelease(texture_);
+
+    SafeDeleteArray(scratch_);
+    SafeDeleteArray(halfTexels_);
+    SafeDeleteArray(texels_);
+  }
+
+  void HeightmapTextures::Init(int dimX, int dimY, float spacing, MipFilter filter, bool halfTexels,
+    const OceanKernels* kernels, ThreadPool* threadPool)
+  {
+    dimX_ = dimX;
+    dimY_ = dimY;
+    spacing_ = spacing;
+    filter_ = filter;
+    kernels_ = kernels;
+    threadPool_ = threadPool;
+
+    // GenerateMips takes the chain down to 1x1, rounding odd sizes down. The CPU stops where it can't halve both dimensions.
+    numLevels_ = 1;
+    numBuilt_ = 1;
+    for (int w = dimX_, h = dimY_; (w > 1 || h > 1) && numLevels_ < HEIGHTMAP_MAX_MIPS; w = max(w / 2, 1), h = max(h / 2, 1))
+    {
+      ++numLevels_;
+      if (filter_ != MIP_FILTER_GPU && numBuilt_ == numLevels_ - 1 && w % 2 == 0 && h % 2 == 0) {
+        ++numBuilt_;
+      }
+    }
+    if (filter_ != MIP_FILTER_GPU) {
+      numLevels_ = numBuilt_;
+    }
+
+    // Both slices of a level are stored together, so the rows of one are the rows of the other offset by its height
+    levelOffsets_[0] = 0;
+    for (int level = 0; level < numBuilt_; ++level) {
+      levelOffsets_[level + 1] = levelOffsets_[level] + 2 * (dimX_ >> level) * (dimY_ >> level);
+    }
+    int texels = levelOffsets_[numBuilt_];
+    texels_ = new XMFLOAT4[texels];
+    ZeroMemory(texels_, sizeof(XMFLOAT4) * texels);
+    if (halfTexels)
+    {
+      halfTexels_ = new HALF[4 * texels];
+      ZeroMemory(halfTexels_, sizeof(HALF) * 4 * texels);
+    }
+
+    if (filter_ != MIP_FILTER_GPU)
+    {
+      InitFilter();
+      scratch_ = new XMFLOAT4[dimY_ * (2 * dimX_ + 4 * padding_)];
+    }
+  }
+
+  void HeightmapTextures::InitFilter()
+  {
+    /*
+      A destination texel's centre lies between its first source texel and the next, so tap t lies
+      t - tapOffset_ - 0.5 source texels from it. The box averages the pair; the Kaiser filter weights
+      KAISER_RADIUS texels either side by a sinc cut off at the destination's Nyquist frequency, windowed
+      so that it falls to zero at its reach.
+    */
+    if (filter_ == MIP_FILTER_BOX)
+    {
+      numTaps_ = 2;
+      weights_[0] = weights_[1] = 0.5f;
+    }
+    else
+    {
+      numTaps_ = 2 * KAISER_RADIUS;
+      float sum = 0.0f;
+      for (int t = 0; t < numTaps_; ++t)
+      {
+        float d = t - (KAISER_RADIUS - 1) - 0.5f;
+        float sinc = sinf(XM_PIDIV2 * d) / (XM_PIDIV2 * d);
+        float r = d / KAISER_RADIUS;
+        weights_[t] = sinc * BesselI0(KAISER_BETA * sqrtf(max(1.0f - r * r, 0.0f))) / BesselI0(KAISER_BETA);
+        sum += weights_[t];
+      }
+      for (int t = 0; t < numTaps_; ++t) {
+        weights_[t] /= sum;
+      }
+    }
+    tapOffset_ = numTaps_ / 2 - 1;
+
+    // Source texel 2x + j is the even or odd texel x + floor(j / 2), so the taps reach that far past either end of the row
+    padding_ = (tapOffset_ + 1) / 2;
+  }
+
+  HRESULT HeightmapTextures::InitTextures(ID3D11Device* device)
+  {
+    HRESULT hr;
+
+    // Get device and immediate context
+    device_ = device;
+    assert(device_);
+    device_->GetImmediateContext(&immediateContext_);
+    assert(immediateContext_);
+
+    // Create texture array, whose mips are rendered to by GenerateMips or uploaded from the CPU
+    D3D11_TEXTURE2D_DESC td;
+    ZeroMemory(&td, sizeof(td));
+    td.Width = dimX_;
+    td.Height = dimY_;
+    td.MipLevels = numLevels_;
+    td.ArraySize = 2;
+    td.Format = halfTexels_ ? DXGI_FORMAT_R16G16B16A16_FLOAT : DXGI_FORMAT_R32G32B32A32_FLOAT;
+    td.SampleDesc.Count = 1;
+    td.Usage = D3D11_USAGE_DEFAULT;
+    td.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    if (filter_ == MIP_FILTER_GPU)
+    {
+      td.BindFlags |= D3D11_BIND_RENDER_TARGET;
+      td.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+    }
+    DXCALL(device_->CreateTexture2D(&td, NULL, &texture_));
+    DXCALL(device_->CreateShaderResourceView(texture_, NULL, &srv_));
+
+    // Create sampler, which wraps as the displacement does
+    D3D11_SAMPLER_DESC sd;
+    ZeroMemory(&sd, sizeof(sd));
+    sd.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+    sd.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+    sd.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+    sd.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+    sd.ComparisonFunc = D3D11_COMPARISON_NEVER;
+    sd.MinLOD = 0.0f;
+    sd.MaxLOD = D3D11_FLOAT32_MAX;
+    sd.MaxAnisotropy = 1;
+    sd.MipLODBias = 0.0f;
+    DXCALL(device_->CreateSamplerState(&sd, &sampler_));
+
+    // Create constant buffer, which maps vertex positions onto the texel centres
+    Constants constants;
+    constants.params = XMFLOAT4(1.0f / (dimX_ * spacing_), 1.0f / (dimY_ * spacing_), 0.5f / dimX_, 0.5f / dimY_);
+
+    D3D11_BUFFER_DESC bd;
+    ZeroMemory(&bd, sizeof(bd));
+    bd.ByteWidth = PAD16(sizeof(Constants));
+    bd.Usage = D3D11_USAGE_IMMUTABLE;
+    bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    D3D11_SUBRESOURCE_DATA srd;
+    ZeroMemory(&srd, sizeof(srd));
+    srd.pSysMem = &constants;
+    DXCALL(device_->CreateBuffer(&bd, &srd, &constants_));
+
+    return S_OK;
+  }
+
+  void HeightmapTextures::Build(const VertexDispNor* vertices)
+  {
+    int size = dimX_ * dimY_;
+    XMFLOAT4* disp = texels_, * normal = texels_ + size;
+    for (int i = 0; i < size; ++i)
+    {
+      disp[i] = XMFLOAT4(vertices[i].Disp.x, vertices[i].Disp.y, vertices[i].Disp.z, 0.0f);
+      normal[i] = XMFLOAT4(vertices[i].Nor.x, vertices[i].Nor.y, 0.0f, 0.0f);
+    }
+
+    // Each level's rows only read the level above, so the levels are filtered in turn and their rows in parallel
+    for (buildLevel_ = 1; buildLevel_ < numBuilt_; ++buildLevel_) {
+      threadPool_->ParallelFor(2 * (dimY_ >> buildLevel_), FilterRow, this);
+    }
+
+    if (halfTexels_) {
+      FloatToHalf(halfTexels_, &texels_[0].x, 4 * levelOffsets_[numBuilt_]);
+    }
+  }
+
+  void HeightmapTextures::FilterRow(void* textures, int row)
+  {
+    HeightmapTextures* t = static_cast<HeightmapTextures*>(textures);
+
+    int level = t->buildLevel_;
+    int srcW = t->dimX_ >> (level - 1), srcH = t->dimY_ >> (level - 1);
+    int dstW = srcW / 2, dstH = srcH / 2;
+    int slice = row / dstH, y = row % dstH;
+    const XMFLOAT4* src = t->texels_ + t->levelOffsets_[level - 1] + slice * srcW * srcH;
+    XMFLOAT4* dst = t->texels_ + t->levelOffsets_[level] + slice * dstW * dstH + y * dstW;
+
+    int phaseW = dstW + 2 * t->padding_;
+    XMFLOAT4* column = t->scratch_ + row * (srcW + 2 * phaseW);
+    XMFLOAT4* phases[] = { column + srcW, column + srcW + phaseW };
+
+    // Down the level above, wrapping at its top and bottom
+    const float* sources[2 * KAISER_RADIUS];
+    for (int tap = 0; tap < t->numTaps_; ++tap) {
+      sources[tap] = &src[Wrap(2 * y + tap - t->tapOffset_, srcH) * srcW].x;
+    }
+    t->kernels_->weightedSum(sources, t->weights_, t->numTaps_, 4 * srcW, &column[0].x);
+
+    // Then along it, the taps becoming shifted runs of its even or odd texels, which wrap at its ends
+    for (int x = -t->padding_; x < dstW + t->padding_; ++x)
+    {
+      phases[0][x + t->padding_] = column[Wrap(2 * x, srcW)];
+      phases[1][x + t->padding_] = column[Wrap(2 * x + 1, srcW)];
+    }
+    for (int tap = 0; tap < t->numTaps_; ++tap)
+    {
+      int j = tap - t->tapOffset_;
+      int phase = j & 1, shift = (j - phase) / 2;
+      sources[tap] = &phases[phase][t->padding_ + shift].x;
+    }
+    t->kernels_->weightedSum(sources, t->weights_, t->numTaps_, 4 * dstW, &dst[0].x);
+  }
+
+  int HeightmapTextures::Upload()
+  {
+    int bytes = 0;
+    int texelBytes = halfTexels_ ? 4 * sizeof(HALF) : sizeof(XMFLOAT4);
+    for (int level = 0; level < numBuilt_; ++level)
+    {
+      int w = dimX_ >> level, h = dimY_ >> level;
+      for (int slice = 0; slice < 2; ++slice)
+      {
+        int offset = levelOffsets_[level] + slice * w * h;
+        const void* data = halfTexels_ ? static_cast<const void*>(halfTexels_ + 4 * offset) : static_cast<const void*>(texels_ + offset);
+        immediateContext_->UpdateSubresource(texture_, D3D11CalcSubresource(level, slice, numLevels_), NULL, data, texelBytes * w, 0);
+        bytes += texelBytes * w * h;
+      }
+    }
+    if (filter_ == MIP_FILTER_GPU) {
+      immediateContext_->GenerateMips(srv_);
+    }
+
+    return bytes;
+  }
+
+  void HeightmapTextures::Bind()
+  {
+    immediateContext_->VSSetShaderResources(1, 1, &srv_);
+    immediateContext_->VSSetSamplers(1, 1, &sampler_);
+    immediateContext_->VSSetConstantBuffers(2, 1, &constants_);
+  }
+
+  const XMFLOAT4* HeightmapTextures::GetLevel(int level, int slice) const
+  {
+    assert(level < numBuilt_);
+    return texels_ + levelOffsets_[level] + slice * (dimX_ >> level) * (dimY_ >> level);
+  }
+
+  void WriteHeightmapMipBenchmark(const char* fileName)
+  {
+    static const int sizes[] = { 64, 128, 256, 512 };
+    static const char* filterNames[] = { "GPU", "Box", "Kaiser" };
+    const int frames = 16;
+
+    FILE* file = OpenReport(fileName, "heightmap mip benchmark report", "Path,Size,Filter,Half,Threads,Levels,MeanMs,ShiftError");
+
+    ThreadPool threadPool;
+    threadPool.Init(0);
+
+    // Every path up to the best one the CPU supports
+    SimdPath best = SelectSimdPath(SIMD_PATH_AUTO);
+    for (int path = SIMD_PATH_SSE2; path <= best; ++path)
+    {
+      for (int s = 0; s < ARRAYSIZE(sizes); ++s)
+      {
+        int dim = sizes[s], shift = dim / 2;
+        const OceanKernels& kernels = SelectOceanKernels(dim, dim, static_cast<SimdPath>(path));
+
+        // A noisy heightmap, which has every frequency the filters could let through, and it shifted by half its size
+        srand(0);
+        std::vector<VertexDispNor> heightmap(dim * dim), shifted(dim * dim);
+        for (int i = 0; i < dim * dim; ++i)
+        {
+          heightmap[i].Disp = XMFLOAT3(GaussRand(), GaussRand(), GaussRand());
+          heightmap[i].Nor = XMFLOAT2(GaussRand(), GaussRand());
+        }
+        for (int z = 0; z < dim; ++z)
+        {
+          for (int x = 0; x < dim; ++x) {
+            shifted[((z + shift) % dim) * dim + (x + shift) % dim] = heightmap[z * dim + x];
+          }
+        }
+
+        for (int filter = MIP_FILTER_BOX; filter < NUM_MIP_FILTERS; ++filter)
+        {
+          for (int half = 0; half < 2; ++half)
+          {
+            HeightmapTextures textures, shiftedTextures;
+            textures.Init(dim, dim, 1.0f, static_cast<MipFilter>(filter), half != 0, &kernels, &threadPool);
+            shiftedTextures.Init(dim, dim, 1.0f, static_cast<MipFilter>(filter), half != 0, &kernels, &threadPool);
+
+            Timer timer;
+            float totalTime = 0.0f;
+            for (int frame = 0; frame < frames; ++frame)
+            {
+              timer.Start();
+              textures.Build(&heightmap[0]);
+              totalTime += timer.Stop();
+            }
+
+            // Each level is shifted by a whole number of its texels until the last, so with the wrap respected the mips
+            // are the same texels moved
+            shiftedTextures.Build(&shifted[0]);
+            float shiftError = 0.0f;
+            for (int level = 0; level < textures.GetNumBuiltLevels() && (shift >> level) > 0; ++level)
+            {
+              int w = dim >> level, levelShift = shift >> level;
+              for (int slice = 0; slice < 2; ++slice)
+              {
+                const XMFLOAT4* a = textures.GetLevel(level, slice), * b = shiftedTextures.GetLevel(level, slice);
+                for (int z = 0; z < w; ++z)
+                {
+                  for (int x = 0; x < w; ++x)
+                  {
+                    const XMFLOAT4& p = a[z * w + x], & q = b[((z + levelShift) % w) * w + (x + levelShift) % w];
+                    shiftError = max(shiftError, max(max(fabsf(p.x - q.x), fabsf(p.y - q.y)), max(fabsf(p.z - q.z), fabsf(p.w - q.w))));
+                  }
+                }
+              }
+            }
+
+            fprintf(file, "%s,%d,%s,%d,%d,%d,%.4f,%g\n", GetSimdPathName(static_cast<SimdPath>(path)), dim, filterNames[filter],
+              half, threadPool.GetNumThreads(), textures.GetNumBuiltLevels(), totalTime / frames, shiftError);
+          }
+        }
+      }
+    }
+
+    fclose(file);
+  }
+}
@@ -0,0 +1,117 @@
+/*!
+  @file IndexAnalysis.cpp @date 18/10/26 @brief Post-transform vertex cache efficiency of index orderings.
+*/
+
+#include <stdio.h>
+#include <stdexcept>
+#include <vector>
+
+#include "IndexAnalysis.h"
+#include "Utilities.h"
+
+namespace OceanWaves
+{
+  VertexCacheStats SimulateVertexCache(const WORD* indices, unsigned int numIndices, bool strip, int cacheSize,
+    VertexCachePolicy policy)
+  {
+    VertexCacheStats stats;
+    ZeroMemory(&stats, sizeof(stats));
+
+    // Most recent first for LRU, and a ring (with next the oldest) for FIFO
+    std::vector<int> cache(cacheSize, -1);
+    std::vector<bool> seen(65536, false);
+    int next = 0;
+
+    for (unsigned int i = 0; i < numIndices; ++i)
+    {
+      int v = indices[i];
+      if (!seen[v])
+      {
+        seen[v] = true;
+        ++stats.vertices;
+      }
+
+      int slot = 0;
+      while (slot < cacheSize && cache[slot] != v) {
+        ++slot;
+      }
+
+      if (policy == VERTEX_CACHE_LRU)
+      {
+        if (slot == cacheSize)
+        {
+          ++stats.transforms;
+          slot = cacheSize - 1;
+        }
+        for (; slot > 0; --slot) {
+          cache[slot] = cache[slot - 1];
+        }
+        cache[0] = v;
+      }
+      else if (slot == cacheSize)
+      {
+        ++stats.transforms;
+        cache[next] = v;
+        next = (next + 1) % cacheSize;
+      }
+    }
+
+    // A strip's degenerate triangles cost transforms but aren't drawn
+    if (strip)
+    {
+      for (unsigned int i = 2; i < numIndices; ++i)
+      {
+        if (indices[i - 2] != indices[i - 1] && indices[i - 1] != indices[i] && indices[i - 2] != indices[i]) {
+          ++stats.triangles;
+        }
+      }
+    }
+    else {
+      stats.triangles = numIndices / 3;
+    }
+
+    stats.acmr = stats.transforms / static_cast<float>(max(1u, stats.triangles));
+    stats.atvr = stats.transforms / static_cast<float>(max(1u, stats.vertices));
+    return stats;
+  }
+
+  void WriteIndexAnalysis(const char* fileName)
+  {
+    static const int dimensions[] = { 64, 128, 256, 512, 1024 };
+    static const int cacheSizes[] = { 16, 24, 32, 64 };
+
+    // Triangle lists ordered for each of these cache sizes (0 is the strip), to see how each fares on the others
+    static const int orderings[] = { 0, 16, 32, 64 };
+
+    FILE* file = OpenReport(fileName, "index analysis report",
+      "Dimensions,Rows,Ordering,OrderedForCacheSize,Indices,Policy,CacheSize,ACMR,ATVR");
+
+    for (int d = 0; d < ARRAYSIZE(dimensions); ++d)
+    {
+      // Heightmaps over 65536 vertices are drawn in bands of rows, so a band is what's measured
+      int dim = dimensions[d];
+      int rows = min(dim, 65536 / dim);
+
+      for (int o = 0; o < ARRAYSIZE(orderings); ++o)
+      {
+        WORD* indices = NULL;
+        unsigned int numIndices = orderings[o] ? GenerateListIndices(&indices, dim, rows, orderings[o]) :
+          GenerateIndices(&indices, dim, rows);
+
+        for (int policy = VERTEX_CACHE_FIFO; policy <= VERTEX_CACHE_LRU; ++policy)
+        {
+          for (int c = 0; c < ARRAYSIZE(cacheSizes); ++c)
+          {
+            VertexCacheStats stats = SimulateVertexCache(indices, numIndices, orderings[o] == 0, cacheSizes[c],
+              static_cast<VertexCachePolicy>(policy));
+
+            fprintf(file, "%d,%d,%s,%d,%u,%s,%d,%.3f,%.3f\n", dim, rows, orderings[o] ? "List" : "Strip", orderings[o],
+              numIndices, policy == VERTEX_CACHE_LRU ? "LRU" : "FIFO", cacheSizes[c], stats.acmr, stats.atvr);
+          }
+        }
+        SafeDeleteArray(indices);
+      }
+    }
+    fclose(file);
+  }
+}
@@ -2,7 +2,57 @@
   @file Main.cpp @author Joel Barrett @date 11/03/12 @brief Main entry point of the application.
 */
 
+#include "Buoyancy.h"
+#include "Cdlod.h"
+#include "HeightmapTextures.h"
+#include "HeightPyramid.h"
+#include "IndexAnalysis.h"
+#include "NormalBenchmark.h"
+#include "ProjectedGrid.h"
+#include "QueryBenchmark.h"
+#include "RayCaster.h"
 #include "Scene.h"
+#include "UploadRing.h"
+#include "VelocityBenchmark.h"
+
+namespace
+{
+  // A report written without opening the window, when its flag is on the command line
+  struct HeadlessReport
+  {
+    const char* flag;
+    void (*write)(const char* fileName);
+    const char* fileName;
+  };
+
+  const HeadlessReport HEADLESS_REPORTS[] =
+  {
+    // Comparing the mesh index orderings on the vertex caches of different targets
+    { "-indexanalysis", OceanWaves::WriteIndexAnalysis, "IndexAnalysis.csv" },
+    // Timing the projected grid and seeing how it spreads its vertices from different viewpoints
+    { "-projectedgrid", OceanWaves::WriteProjectedGridBenchmark, "ProjectedGrid.csv" },
+    // Timing the CDLOD node selection along camera paths at sea level and at altitude
+    { "-cdlod", OceanWaves::WriteCdlodBenchmark, "Cdlod.csv" },
+    // Comparing the cost and accuracy of the FFT, Sobel and central difference normals
+    { "-normals", OceanWaves::WriteNormalBenchmark, "Normals.csv" },
+    // Timing the CPU mip filters and checking they wrap as the heightmap does
+    { "-heightmapmips", OceanWaves::WriteHeightmapMipBenchmark, "HeightmapMips.csv" },
+    // Timing the height pyramid and checking its bounds hold the surface in every region, wrapped or not
+    { "-heightpyramid", OceanWaves::WriteHeightPyramidReport, "HeightPyramid.csv" },
+    // Timing the batched height queries and checking them against the per-vertex sampler
+    { "-queries", OceanWaves::WriteQueryBenchmark, "Queries.csv" },
+    // Trading the displaced surface's queries' accuracy against their speed
+    { "-displacedqueries", OceanWaves::WriteDisplacedQueryReport, "DisplacedQueries.csv" },
+    // Checking the spectral velocity and acceleration against finite differences, and what they cost
+    { "-velocity", OceanWaves::WriteVelocityBenchmark, "Velocity.csv" },
+    // Timing the buoyancy of many bodies and checking its forces
+    { "-buoyancy", OceanWaves::WriteBuoyancyBenchmark, "Buoyancy.csv" },
+    // Timing rays cast against the surface and checking their hits against every triangle
+    { "-rays", OceanWaves::WriteRayReport, "Rays.csv" },
+    // Checking the upload ring never overwrites a frame the GPU could still read, and how often it waits
+    { "-uploadring", OceanWaves::WriteUploadRingReport, "UploadRing.csv" }
+  };
+}
 
 int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR cmdLine, int cmdShow)
 {
@@ -11,6 +61,22 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, LPSTR cmdLine, int cmdS
   _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
+  // Headless, writing a report and exiting
+  for (int i = 0; i < ARRAYSIZE(HEADLESS_REPORTS); ++i)
+  {
+    if (strstr(cmdLine, HEADLESS_REPORTS[i].flag))
+    {
+      try {
+        HEADLESS_REPORTS[i].write(HEADLESS_REPORTS[i].fileName);
+      }
+      catch (std::exception& e) {
+        MessageBox(NULL, e.what(), "An exception occurred!", MB_OK | MB_ICONERROR | MB_TASKMODAL);
+        return 1;
+      }
+      return 0;
+    }
+  }
+
   OceanWaves::Scene oceanWaves;
   try {
     oceanWaves.Init();
@@ -0,0 +1,225 @@
+/*!
+  @file NormalBenchmark.cpp @date 18/10/26 @brief Cost and accuracy of the ways of computing the ocean's normals.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdexcept>
+#include <vector>
+
+#include "NormalBenchmark.h"
+#include "OceanKernels.h"
+#include "Utilities.h"
+
+namespace OceanWaves
+{
+  namespace
+  {
+    /*
+      The exact partial derivatives of a periodic field along x and z, by multiplying its spectrum by ik.
+      The Nyquist frequencies have no sign, so they're dropped.
+    */
+    class SpectralDerivative
+    {
+    public:
+      SpectralDerivative(int dimX, int dimY, float lengthX, float lengthY) : dimX_(dimX), dimY_(dimY), lengthX_(lengthX),
+        lengthY_(lengthY), field_(dimX * dimY), spectrum_(dimY * (dimX / 2 + 1)), derivative_(dimY * (dimX / 2 + 1))
+      {
+        forward_ = fftwf_plan_dft_r2c_2d(dimY_, dimX_, &field_[0], reinterpret_cast<fftwf_complex*>(&spectrum_[0]), FFTW_ESTIMATE);
+        inverse_ = fftwf_plan_dft_c2r_2d(dimY_, dimX_, reinterpret_cast<fftwf_complex*>(&derivative_[0]), &field_[0],
+          FFTW_ESTIMATE);
+      }
+      ~SpectralDerivative()
+      {
+        fftwf_destroy_plan(inverse_);
+        fftwf_destroy_plan(forward_);
+      }
+
+      void Differentiate(const float* field, float* ddx, float* ddz)
+      {
+        field_.assign(field, field + dimX_ * dimY_);
+        fftwf_execute(forward_);
+
+        for (int axis = 0; axis < 2; ++axis)
+        {
+          float scale = XM_2PI / ((axis == 0) ? lengthX_ : lengthY_) / (dimX_ * dimY_);
+          for (int y = 0; y < dimY_; ++y)
+          {
+            for (int x = 0; x <= dimX_ / 2; ++x)
+            {
+              int frequency = (axis == 0) ? x : (y > dimY_ / 2 ? y - dimY_ : y);
+              bool nyquist = (axis == 0) ? (2 * x == dimX_) : (2 * y == dimY_);
+              float k = nyquist ? 0.0f : scale * frequency;
+
+              // ik (re + i im) = (-k im, k re)
+              const XMFLOAT2& s = spectrum_[y * (dimX_ / 2 + 1) + x];
+              derivative_[y * (dimX_ / 2 + 1) + x] = XMFLOAT2(-k * s.y, k * s.x);
+            }
+          }
+          fftwf_execute(inverse_);
+          float* out = (axis == 0) ? ddx : ddz;
+          for (int i = 0; i < dimX_ * dimY_; ++i) {
+            out[i] = field_[i];
+          }
+        }
+      }
+
+    private:
+      int dimX_, dimY_;
+      float lengthX_, lengthY_;
+      std::vector<float> field_;
+      std::vector<XMFLOAT2> spectrum_, derivative_;
+      fftwf_plan forward_, inverse_;
+    };
+
+    // The angle in degrees between the normals of two heightfields with the given slopes
+    float SlopeAngle(float ax, float az, float bx, float bz)
+    {
+      float cosine = (ax * bx + 1.0f + az * bz) / sqrtf((ax * ax + 1.0f + az * az) * (bx * bx + 1.0f + bz * bz));
+      return XMConvertToDegrees(acosf(min(1.0f, cosine)));
+    }
+  }
+
+  void WriteNormalBenchmark(const char* fileName)
+  {
+    static const int sizes[] = { 64, 128, 256, 512 };
+    static const float choppinesses[] = { 0.0f, 0.5f, 1.0f };
+    static const char* methodNames[] = { "FFT", "Sobel", "Differences" };
+    const int frames = 16, step = 2; // Sampled at half the FFT's resolution, as the default heightmap is
+    const float patchLength = 50.0f, windSpeed = 10.0f, gravity = 9.81f;
+
+    FILE* file = OpenReport(fileName, "normal benchmark report",
+      "Path,FFTSize,Choppiness,Method,MeanMs,MeanErrorDeg,WorstErrorDeg,Folded");
+
+    SpectrumParams params;
+    params.A = 0.0005f;
+    params.windX = cosf(XM_PIDIV4);
+    params.windZ = sinf(XM_PIDIV4);
+    params.S = 1.0f;
+    params.L = windSpeed * windSpeed / gravity;
+    params.l = params.L / 1000.0f;
+    params.gravity = gravity;
+
+    // Every path up to the best one the CPU supports
+    SimdPath best = SelectSimdPath(SIMD_PATH_AUTO);
+    for (int path = SIMD_PATH_SSE2; path <= best; ++path)
+    {
+      for (int s = 0; s < ARRAYSIZE(sizes); ++s)
+      {
+        int dim = sizes[s], spectrumDimX = dim / 2 + 1, fftSize = dim * dim, spectrumSize = spectrumDimX * dim;
+        const OceanKernels& kernels = SelectOceanKernels(dim, dim, static_cast<SimdPath>(path));
+
+        KernelGrid grid;
+        grid.dimX = grid.dimY = dim;
+        grid.spectrumDimX = spectrumDimX;
+        grid.patchLengthX = grid.patchLengthY = patchLength;
+
+        // The same spectrum for every path and size that shares it
+        srand(0);
+        std::vector<XMFLOAT2> gauss(fftSize), h0k(fftSize);
+        for (int i = 0; i < fftSize; ++i) {
+          gauss[i] = XMFLOAT2(GaussRand(), GaussRand());
+        }
+        std::vector<float> wk(spectrumSize), terms(4 * spectrumSize);
+        kernels.initSpectrum(grid, params, &gauss[0], &h0k[0], &wk[0], &terms[0]);
+
+        // One plane per transform, and its output
+        std::vector<XMFLOAT2> spectra(5 * spectrumSize);
+        fftwf_complex* in[5];
+        std::vector<float> outputs(5 * fftSize);
+        float* out[5];
+        fftwf_plan plans[5];
+        for (int i = 0; i < 5; ++i)
+        {
+          in[i] = reinterpret_cast<fftwf_complex*>(&spectra[i * spectrumSize]);
+          out[i] = &outputs[i * fftSize];
+          plans[i] = fftwf_plan_dft_c2r_2d(dim, dim, in[i], out[i], FFTW_MEASURE);
+        }
+        float* h = out[0], * Dx = out[1], * Dz = out[2];
+
+        // Slopes of each method, and the exact ones of h, Dx and Dz
+        std::vector<float> slopes(6 * fftSize, 0.0f), exact(6 * fftSize);
+        float* slopeX[] = { out[3], &slopes[2 * fftSize], &slopes[4 * fftSize] };
+        float* slopeZ[] = { out[4], &slopes[3 * fftSize], &slopes[5 * fftSize] };
+        SpectralDerivative derivative(dim, dim, patchLength, patchLength);
+
+        for (int c = 0; c < ARRAYSIZE(choppinesses); ++c)
+        {
+          float choppiness = choppinesses[c];
+          float totalTime[3] = { 0.0f, 0.0f, 0.0f }, totalError[3] = { 0.0f, 0.0f, 0.0f }, worstError[3] = { 0.0f, 0.0f, 0.0f };
+          int samples = 0, folded = 0;
+
+          Timer timer;
+          for (int frame = 0; frame < frames; ++frame)
+          {
+            kernels.evolveSpectrum(grid, &terms[0], &wk[0], 0.25f * frame, 1.0f, in[0], NULL, NULL);
+
+            // The transformed slopes are read from h(k,t), whose own transform overwrites it
+            timer.Start();
+            kernels.deriveChannels(grid, in[0], NULL, NULL, in[3], in[4]);
+            fftwf_execute(plans[3]);
+            fftwf_execute(plans[4]);
+            totalTime[0] += timer.Stop();
+
+            kernels.deriveChannels(grid, in[0], in[1], in[2], NULL, NULL);
+            for (int i = 0; i < 3; ++i) {
+              fftwf_execute(plans[i]);
+            }
+
+            timer.Start();
+            kernels.sobelSlopes(grid, h, step, step, slopeX[1], slopeZ[1]);
+            totalTime[1] += timer.Stop();
+
+            timer.Start();
+            kernels.displacedSlopes(grid, h, Dx, Dz, choppiness, step, step, slopeX[2], slopeZ[2]);
+            totalTime[2] += timer.Stop();
+
+            // The exact normal of the displaced surface, as slopes where it hasn't folded over
+            derivative.Differentiate(h, &exact[0], &exact[fftSize]);
+            derivative.Differentiate(Dx, &exact[2 * fftSize], &exact[3 * fftSize]);
+            derivative.Differentiate(Dz, &exact[4 * fftSize], &exact[5 * fftSize]);
+            for (int z = 0; z < dim; z += step)
+            {
+              for (int x = 0; x < dim; x += step)
+              {
+                int i = z * dim + x;
+                float hx = exact[i], hz = exact[fftSize + i];
+                float dxx = choppiness * exact[2 * fftSize + i], dxz = choppiness * exact[3 * fftSize + i];
+                float dzx = choppiness * exact[4 * fftSize + i], dzz = choppiness * exact[5 * fftSize + i];
+                float jacobian = (1.0f + dxx) * (1.0f + dzz) - dxz * dzx;
+                if (jacobian <= 0.0f)
+                {
+                  ++folded;
+                  continue;
+                }
+                float sx = ((1.0f + dzz) * hx - hz * dzx) / jacobian;
+                float sz = ((1.0f + dxx) * hz - hx * dxz) / jacobian;
+
+                for (int m = 0; m < 3; ++m)
+                {
+                  float error = SlopeAngle(slopeX[m][i], slopeZ[m][i], sx, sz);
+                  totalError[m] += error;
+                  worstError[m] = max(worstError[m], error);
+                }
+                ++samples;
+              }
+            }
+          }
+
+          for (int m = 0; m < 3; ++m)
+          {
+            fprintf(file, "%s,%d,%.2f,%s,%.4f,%.4f,%.4f,%.4f\n", GetSimdPathName(static_cast<SimdPath>(path)), dim, choppiness,
+              methodNames[m], totalTime[m] / frames, totalError[m] / max(samples, 1), worstError[m],
+              folded / static_cast<float>(folded + samples));
+          }
+        }
+
+        for (int i = 0; i < 5; ++i) {
+          fftwf_destroy_plan(plans[i]);
+        }
+      }
+    }
+
+    fclose(file);
+  }
+}
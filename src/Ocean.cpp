@@ -2,29 +2,68 @@
   @file Ocean.cpp @author Joel Barrett @date 01/01/12 @brief An ocean surface.
 */
 
+#include <utility>
+
 #include "Ocean.h"
+#include "Simd.h"
 
 namespace OceanWaves
 {
-// Convert from frequency domain to image domain (-pi...pi to N...M)
-#define freqToImage(p) ((XM_2PI * (p - settings_.fftDim * 0.5f)) / settings_.patchLength)
-
-// Return the height at point (z, x) for computing normals
-#define height(z, x) (hktOut_[(((z) + settings_.fftDim) % settings_.fftDim) + (settings_.fftDim) * (((x) + settings_.fftDim) % settings_.fftDim)])
+  // FFTW is fastest for sizes whose only prime factors are 2, 3 and 5 (e.g. 384 = 2^7 * 3)
+  static bool IsMixedRadix(int n)
+  {
+    static const int radices[] = { 2, 3, 5 };
+    if (n < 2) {
+      return false;
+    }
+    for (int i = 0; i < ARRAYSIZE(radices); ++i)
+    {
+      while (n % radices[i] == 0) {
+        n /= radices[i];
+      }
+    }
+    return n == 1;
+  }
 
   Ocean::~Ocean()
   {
     // Release COM objects
     SafeRelease(skyReflectionSampler_);
     SafeRelease(skyReflectionSRV_);
+    SafeRelease(streamConstants_);
     SafeRelease(vsConstants_);
     SafeRelease(indexBuffer_);
     SafeRelease(vertexBuffer_);
+    SafeRelease(gridBuffer_);
     SafeRelease(vertexLayout_);
     SafeRelease(wireframePixelShader_);
     SafeRelease(solidPixelShader_);
     SafeRelease(vertexShader_);
 
+    // Release LOD levels
+    for (int i = 0; lods_ && i < settings_.lodLevels; ++i)
+    {
+      fftwf_destroy_plan(lods_[i].plan);
+      SafeDeleteArray(lods_[i].out);
+      SafeDeleteArray(lods_[i].in);
+    }
+    SafeDeleteArray(lods_);
+
+    // Release the surface's derivatives
+    SurfaceDerivative* derivatives[] = { &velocity_, &acceleration_ };
+    for (int i = 0; i < ARRAYSIZE(derivatives); ++i)
+    {
+      for (int j = 0; j < 3; ++j)
+      {
+        if (derivatives[i]->plans[j]) {
+          fftwf_destroy_plan(derivatives[i]->plans[j]);
+        }
+        SafeDeleteArray(derivatives[i]->out[j]);
+        SafeDeleteArray(derivatives[i]->in[j]);
+      }
+      SafeDeleteArray(derivatives[i]->samples);
+    }
+
     // Release FFTW plans
     fftwf_destroy_plan(nzPlan_);
     fftwf_destroy_plan(nxPlan_);
@@ -47,10 +86,21 @@ namespace OceanWaves
     SafeDeleteArray(hktIn_);
 
     // Release arrays
+    SafeDeleteArray(foam_);
+    SafeDeleteArray(jacobian_);
+    SafeDeleteArray(rowSlope_);
+    SafeDeleteArray(rowDisp_);
+    SafeDeleteArray(streamPacked_);
+    SafeDeleteArray(rowHalf_);
+    SafeDeleteArray(streamHalf_);
+    SafeDeleteArray(stream_);
+    SafeDeleteArray(evolveTerms_);
     SafeDeleteArray(wk_);
     SafeDeleteArray(h0k_);
+    SafeDeleteArray(chunks_);
+    SafeDeleteArray(quadDiagonals_);
     SafeDeleteArray(indices_);
-    SafeDeleteArray(vertices_);
+    SafeDeleteArray(baseGrid_);
   }
 
   void Ocean::Init(ID3D11Device* device, const OceanSettings& settings)
@@ -63,12 +113,116 @@ namespace OceanWaves
 
     // Initialise ocean variables
     settings_ = settings;
-    fftSize_ = settings_.fftDim * settings_.fftDim;
-    h0k_ = new XMFLOAT2[fftSize_ * sizeof(XMFLOAT2)];
-    wk_ = new float[fftSize_ * sizeof(float)];
+    if (!IsMixedRadix(settings_.fftDimX) || !IsMixedRadix(settings_.fftDimY) ||
+      settings_.fftDimX % 2 != 0 || settings_.fftDimY % 2 != 0) {
+      throw std::runtime_error("The FFT dimensions must be even and have no prime factors other than 2, 3 and 5");
+    }
+    if (settings_.fftDimX % settings_.heightmapDimX != 0 || settings_.fftDimY % settings_.heightmapDimY != 0) {
+      throw std::runtime_error("The FFT dimensions must be multiples of the heightmap dimensions");
+    }
+    if ((settings_.fftDimX >> settings_.lodLevels) % 2 != 0 || (settings_.fftDimY >> settings_.lodLevels) % 2 != 0) {
+      throw std::runtime_error("The FFT dimensions must stay even at the coarsest LOD level");
+    }
+    if (settings_.heightmapDimX * settings_.heightmapDimY > 65536 && !settings_.chunkedMesh) {
+      throw std::runtime_error("The heightmap has too many vertices for 16-bit indices without ChunkedMesh");
+    }
+    if (settings_.heightmapDimX > 32768) {
+      throw std::runtime_error("The heightmap is too wide for 16-bit indices to address two of its rows");
+    }
+    channelDemand_[OCEAN_CONSUMER_RENDER] = OCEAN_CHANNEL_SURFACE;
+    fftSize_ = settings_.fftDimX * settings_.fftDimY;
+    spectrumDimX_ = settings_.fftDimX / 2 + 1;
+    spectrumSize_ = spectrumDimX_ * settings_.fftDimY;
+    h0k_ = new XMFLOAT2[fftSize_];
+
+    // Choose the kernels once, rather than testing the size and instruction set in every loop
+    simdPath_ = SelectSimdPath(static_cast<SimdPath>(settings_.simdPath));
+    kernels_ = &SelectOceanKernels(settings_.fftDimX, settings_.fftDimY, simdPath_);
+    kernelGrid_.dimX = settings_.fftDimX;
+    kernelGrid_.dimY = settings_.fftDimY;
+    kernelGrid_.spectrumDimX = spectrumDimX_;
+    kernelGrid_.patchLengthX = static_cast<float>(settings_.patchLengthX);
+    kernelGrid_.patchLengthY = static_cast<float>(settings_.patchLengthY);
+    wk_ = new float[spectrumSize_];
+    evolveTerms_ = new float[4 * spectrumSize_];
+
+    if (settings_.displacementInterval < 1 || settings_.normalInterval < 1) {
+      throw std::runtime_error("The displacement and normal update intervals must be at least one frame");
+    }
+    if (settings_.packedVertices != 0 && settings_.packedVertices != 8 && settings_.packedVertices != 16) {
+      throw std::runtime_error("Packed vertices must have 8 or 16-bit normals");
+    }
+    if (settings_.clipmapLevels < 0 || settings_.clipmapLevels > CLIPMAP_MAX_LEVELS) {
+      throw std::runtime_error("The clipmap must have between 0 and 16 levels");
+    }
+    if (settings_.cdlodLevels < 0 || settings_.cdlodLevels > CDLOD_MAX_LEVELS) {
+      throw std::runtime_error("The CDLOD quadtree must have between 0 and 12 levels");
+    }
+
+    // The clipmap, the projected grid, the quadtree and the tiles each draw their own vertices from the full precision
+    // heightmap, so only one can be used, and the options of the heightmap mesh's stream and indices don't apply to them
+    int renderingModes = (settings_.clipmapLevels != 0) + (settings_.projectedGridSize != 0) + (settings_.cdlodLevels != 0) +
+      (settings_.tileRadius != 0);
+    if (renderingModes > 1) {
+      throw std::runtime_error("Only one of the clipmap, projected grid, CDLOD quadtree and tiles can be used at once");
+    }
+    if (renderingModes && (settings_.halfPrecision || settings_.packedVertices || settings_.chunkedMesh || settings_.indexCacheSize)) {
+      throw std::runtime_error("Half, packed, chunked and list vertices are only for the heightmap mesh, not the other rendering modes");
+    }
+    if (settings_.normalMethod < 0 || settings_.normalMethod >= NUM_NORMAL_METHODS) {
+      throw std::runtime_error("The normal method must be 0 (FFT), 1 (Sobel) or 2 (central differences)");
+    }
+    if (settings_.uploadFrames < 0 || settings_.uploadFrames > UPLOAD_RING_MAX_FRAMES) {
+      throw std::runtime_error("The upload ring must have between 0 and 4 frames");
+    }
+    if (settings_.mipFilter < 0 || settings_.mipFilter >= NUM_MIP_FILTERS) {
+      throw std::runtime_error("The mip filter must be 0 (GPU box), 1 (CPU box) or 2 (CPU Kaiser)");
+    }
+
+    // The other rendering modes upload their own textures or vertices, so only the heightmap mesh is streamed through the ring
+    if (renderingModes) {
+      settings_.uploadFrames = 0;
+    }
 
+    // The heightmap and the base grid are centred on the origin, their vertices 0.2 apart
+    gridSpacing_ = 0.2f;
+    gridOrigin_ = XMFLOAT2(-(settings_.heightmapDimX - 1) * 0.5f * gridSpacing_, -(settings_.heightmapDimY - 1) * 0.5f * gridSpacing_);
+
+    threadPool_.Init(0);
+    heightPyramid_.Init(settings_.heightmapDimX, settings_.heightmapDimY, gridOrigin_, gridSpacing_, kernels_, &threadPool_);
     InitShaders();
     InitBuffers();
+    rayCaster_.Init(&heightPyramid_, settings_.heightmapDimX, settings_.heightmapDimY, gridOrigin_, gridSpacing_, quadDiagonals_,
+      &threadPool_);
+    if (settings_.clipmapLevels) {
+      clipmap_.Init(device_, settings_.clipmapLevels, gridSpacing_);
+    }
+    if (settings_.cdlodLevels)
+    {
+      cdlod_.Init(settings_.cdlodLevels, gridSpacing_);
+      cdlod_.InitBuffers(device_);
+    }
+    if (settings_.tileRadius) {
+      tiles_.Init(device_, settings_.heightmapDimX, settings_.heightmapDimY, gridSpacing_, settings_.tileRadius, kernels_);
+    }
+    if (settings_.projectedGridSize)
+    {
+      projectedGrid_.Init(settings_.projectedGridSize, 0.1f, kernels_, &threadPool_);
+      projectedGrid_.InitBuffers(device_);
+    }
+
+    // History for interpolating the channels that aren't updated every frame
+    if (settings_.displacementInterval > 1) {
+      dispHistory_.Init(numVertices_, settings_.halfPrecision != 0);
+    }
+    if (settings_.normalInterval > 1) {
+      slopeHistory_.Init(numVertices_, settings_.halfPrecision != 0);
+    }
+    rowDisp_ = new XMFLOAT2[settings_.heightmapDimX];
+    rowSlope_ = new XMFLOAT2[settings_.heightmapDimX];
+    jacobian_ = new float[numVertices_];
+    foam_ = new float[numVertices_];
+    ZeroMemory(foam_, sizeof(float) * numVertices_);
     InitHeightmap();
     InitFFTW();
     InitTextures();
@@ -78,9 +232,13 @@ namespace OceanWaves
   {
     HRESULT hr;
 
-    // Create vertex shader
+    // Create vertex shader, which decodes whichever format the vertices are streamed in
+    const char* vsEntry = settings_.halfPrecision ? "OceanHalfVS" : "OceanVS";
+    if (settings_.packedVertices) {
+      vsEntry = (settings_.packedVertices == 8) ? "OceanPacked8VS" : "OceanPacked16VS";
+    }
     ID3DBlob* vsBlob = NULL;
-    DXCALL(CompileShaderFromFile("assets/shaders/OceanVSPS.hlsl", "OceanVS", "vs_4_0", &vsBlob));
+    DXCALL(CompileShaderFromFile("assets/shaders/OceanVSPS.hlsl", vsEntry, "vs_4_0", &vsBlob));
     DXCALL(device_->CreateVertexShader(vsBlob->GetBufferPointer(), vsBlob->GetBufferSize(),
       NULL, &vertexShader_));
 
@@ -96,14 +254,48 @@ namespace OceanWaves
     DXCALL(device_->CreatePixelShader(wpsBlob->GetBufferPointer(), wpsBlob->GetBufferSize(),
       NULL, &wireframePixelShader_));
 
-    // Create input layout
+    // Create input layout, the base grid in slot 0 and the per-frame stream in slot 1
     D3D11_INPUT_ELEMENT_DESC layout[] =
     {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "DISPLACEMENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "NORMAL", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+    };
+    D3D11_INPUT_ELEMENT_DESC halfLayout[] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "DISPLACEMENT", 0, DXGI_FORMAT_R16G16B16A16_FLOAT, 1, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "NORMAL", 0, DXGI_FORMAT_R16G16_FLOAT, 1, 8, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+    };
+    D3D11_INPUT_ELEMENT_DESC packed16Layout[] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "DISPLACEMENT", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 1, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 1, 8, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+    };
+    D3D11_INPUT_ELEMENT_DESC packed8Layout[] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "DISPLACEMENT", 0, DXGI_FORMAT_R16G16_SNORM, 1, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "DISPLACEMENT", 1, DXGI_FORMAT_R16_SNORM, 1, 4, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "NORMAL", 0, DXGI_FORMAT_R8G8_SNORM, 1, 6, D3D11_INPUT_PER_VERTEX_DATA, 0 },
     };
-    DXCALL(device_->CreateInputLayout(layout, ARRAYSIZE(layout), vsBlob->GetBufferPointer(),
-      vsBlob->GetBufferSize(), &vertexLayout_));
+    if (settings_.packedVertices == 16) {
+      DXCALL(device_->CreateInputLayout(packed16Layout, ARRAYSIZE(packed16Layout), vsBlob->GetBufferPointer(),
+        vsBlob->GetBufferSize(), &vertexLayout_));
+    }
+    else if (settings_.packedVertices == 8) {
+      DXCALL(device_->CreateInputLayout(packed8Layout, ARRAYSIZE(packed8Layout), vsBlob->GetBufferPointer(),
+        vsBlob->GetBufferSize(), &vertexLayout_));
+    }
+    else if (settings_.halfPrecision) {
+      DXCALL(device_->CreateInputLayout(halfLayout, ARRAYSIZE(halfLayout), vsBlob->GetBufferPointer(),
+        vsBlob->GetBufferSize(), &vertexLayout_));
+    }
+    else {
+      DXCALL(device_->CreateInputLayout(layout, ARRAYSIZE(layout), vsBlob->GetBufferPointer(),
+        vsBlob->GetBufferSize(), &vertexLayout_));
+    }
 
     SafeRelease(vsBlob);
     SafeRelease(spsBlob);
@@ -116,21 +308,78 @@ namespace OceanWaves
   {
     HRESULT hr;
 
-    // Create vertex buffer
+    // Split the mesh into bands of rows that 16-bit indices can address, each sharing its last row with the next
+    int chunkRows = settings_.heightmapDimY;
+    if (settings_.chunkedMesh) {
+      chunkRows = min(chunkRows, 65536 / settings_.heightmapDimX);
+    }
+    numChunks_ = (settings_.heightmapDimY - 2) / (chunkRows - 1) + 1;
+    chunks_ = new MeshChunk[numChunks_];
+    for (int i = 0; i < numChunks_; ++i)
+    {
+      MeshChunk& chunk = chunks_[i];
+      chunk.firstRow = i * (chunkRows - 1);
+      chunk.numRows = min(chunkRows, settings_.heightmapDimY - chunk.firstRow);
+      chunk.baseVertex = chunk.firstRow * settings_.heightmapDimX;
+    }
+
+    // Create the base grid buffer, which never changes
+    numVertices_ = settings_.heightmapDimX * settings_.heightmapDimY;
+    baseGrid_ = new XMFLOAT2[numVertices_];
+    threadPool_.ParallelFor(numChunks_, GenerateChunk, this);
+
     D3D11_BUFFER_DESC bd;
     ZeroMemory(&bd, sizeof(bd));
-    numVertices_ = GenerateVertices(&vertices_, settings_.heightmapDim, 0.2f);
-    bd.ByteWidth = sizeof(VertexPosNor) * numVertices_;
-    bd.Usage = D3D11_USAGE_DEFAULT;
+    bd.ByteWidth = sizeof(XMFLOAT2) * numVertices_;
+    bd.Usage = D3D11_USAGE_IMMUTABLE;
     bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
     bd.CPUAccessFlags = 0;
     D3D11_SUBRESOURCE_DATA srd;
     ZeroMemory(&srd, sizeof(srd));
-    srd.pSysMem = vertices_;
-    DXCALL(device_->CreateBuffer(&bd, &srd, &vertexBuffer_));
+    srd.pSysMem = baseGrid_;
+    DXCALL(device_->CreateBuffer(&bd, &srd, &gridBuffer_));
+
+    // Create the per-frame displacement and normal buffer, starting flat
+    stream_ = new VertexDispNor[numVertices_];
+    ZeroMemory(stream_, sizeof(VertexDispNor) * numVertices_);
+    streamStride_ = sizeof(VertexDispNor);
+    streamTarget_ = reinterpret_cast<BYTE*>(stream_);
+    if (settings_.packedVertices)
+    {
+      // The float stream stays on the CPU too, and all zeros is still flat whatever the scale
+      streamStride_ = (settings_.packedVertices == 8) ? sizeof(VertexDispNorPacked8) : sizeof(VertexDispNorPacked16);
+      streamPacked_ = new BYTE[streamStride_ * numVertices_];
+      ZeroMemory(streamPacked_, streamStride_ * numVertices_);
+      packScale_ = packMax_ = XMFLOAT3(0.0f, 0.0f, 0.0f);
+      streamTarget_ = streamPacked_;
+    }
+    else if (settings_.halfPrecision)
+    {
+      // The float stream stays on the CPU, for the interpolation and the error measurement
+      streamHalf_ = new VertexDispNorHalf[numVertices_];
+      ZeroMemory(streamHalf_, sizeof(VertexDispNorHalf) * numVertices_);
+      rowHalf_ = new HALF[settings_.heightmapDimX * 5];
+      streamStride_ = sizeof(VertexDispNorHalf);
+      streamTarget_ = reinterpret_cast<BYTE*>(streamHalf_);
+    }
+    srd.pSysMem = streamTarget_;
+    bd.ByteWidth = streamStride_ * numVertices_;
+    if (settings_.uploadFrames)
+    {
+      // Streamed through a dynamic buffer with a frame of the stream for each frame in flight, the first of them flat
+      DXCALL(uploadBackend_.Init(device_, D3D11_BIND_VERTEX_BUFFER, bd.ByteWidth * settings_.uploadFrames, settings_.uploadFrames));
+      uploadRing_.Init(&uploadBackend_, bd.ByteWidth, settings_.uploadFrames);
+      memcpy(uploadRing_.Begin(), streamTarget_, bd.ByteWidth);
+      uploadRing_.End();
+    }
+    else
+    {
+      bd.Usage = D3D11_USAGE_DEFAULT;
+      DXCALL(device_->CreateBuffer(&bd, &srd, &vertexBuffer_));
+    }
 
     // Create index buffer
-    numIndices_ = GenerateIndices(&indices_, settings_.heightmapDim);
+    InitIndices(chunkRows);
     bd.ByteWidth = sizeof(WORD) * numIndices_;
     bd.Usage = D3D11_USAGE_DEFAULT;
     bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
@@ -145,30 +394,139 @@ namespace OceanWaves
     bd.CPUAccessFlags = 0;
     DXCALL(device_->CreateBuffer(&bd, NULL, &vsConstants_));
 
+    // The scale of a packed stream changes with it, so it has its own constant buffer
+    if (streamPacked_)
+    {
+      bd.ByteWidth = PAD16(sizeof(StreamConstants));
+      DXCALL(device_->CreateBuffer(&bd, NULL, &streamConstants_));
+    }
+
     return S_OK;
   }
 
-  void Ocean::InitFFTW()
+  void Ocean::InitIndices(int chunkRows)
   {
-    hktIn_ = new fftwf_complex[fftSize_ * sizeof(fftwf_complex)];
-    hktOut_ = new float[fftSize_ * sizeof(float)];
-    hktPlan_ = fftwf_plan_dft_c2r_2d(settings_.fftDim, settings_.fftDim, hktIn_, hktOut_, FFTW_PATIENT);
+    MeshChunk& last = chunks_[numChunks_ - 1];
 
-    DxtIn_ = new fftwf_complex[fftSize_ * sizeof(fftwf_complex)];
-    DxtOut_ = new float[fftSize_ * sizeof(float)];
-    DxtPlan_ = fftwf_plan_dft_c2r_2d(settings_.fftDim, settings_.fftDim, DxtIn_, DxtOut_, FFTW_PATIENT);
+    // Each chunk's indices start from an even row, so its diagonals alternate from its own first row, the last chunk's
+    // carrying on into the row of quads that joins the heightmap's last row to its first, as the ray caster tiles it
+    quadDiagonals_ = new BYTE[settings_.heightmapDimY];
+    for (int i = 0; i < numChunks_; ++i)
+    {
+      int lastRow = (i == numChunks_ - 1) ? settings_.heightmapDimY : chunks_[i].firstRow + chunks_[i].numRows - 1;
+      for (int z = chunks_[i].firstRow; z < lastRow; ++z) {
+        quadDiagonals_[z] = static_cast<BYTE>((z - chunks_[i].firstRow) & 1);
+      }
+    }
 
-    DztIn_ = new fftwf_complex[fftSize_ * sizeof(fftwf_complex)];
-    DztOut_ = new float[fftSize_ * sizeof(float)];
-    DztPlan_ = fftwf_plan_dft_c2r_2d(settings_.fftDim, settings_.fftDim, DztIn_, DztOut_, FFTW_PATIENT);
+    if (!settings_.indexCacheSize)
+    {
+      // A strip over fewer rows is a prefix of the strip over a whole chunk
+      numIndices_ = GenerateIndices(&indices_, settings_.heightmapDimX, chunkRows);
+      for (int i = 0; i < numChunks_; ++i)
+      {
+        chunks_[i].startIndex = 0;
+        chunks_[i].numIndices = (settings_.heightmapDimX * 2) * (chunks_[i].numRows - 1) + (chunks_[i].numRows - 2);
+      }
+      return;
+    }
 
-    nxIn_ = new fftwf_complex[fftSize_ * sizeof(fftwf_complex)];
-    nxOut_ = new float[fftSize_ * sizeof(float)];
-    nxPlan_ = fftwf_plan_dft_c2r_2d(settings_.fftDim, settings_.fftDim, nxIn_, nxOut_, FFTW_PATIENT);
+    // A list is ordered in stripes down the whole chunk, so a shorter last chunk needs its own
+    numIndices_ = GenerateListIndices(&indices_, settings_.heightmapDimX, chunkRows, settings_.indexCacheSize);
+    for (int i = 0; i < numChunks_; ++i)
+    {
+      chunks_[i].startIndex = 0;
+      chunks_[i].numIndices = numIndices_;
+    }
+    if (last.numRows < chunkRows)
+    {
+      WORD* lastIndices = NULL;
+      last.startIndex = numIndices_;
+      last.numIndices = GenerateListIndices(&lastIndices, settings_.heightmapDimX, last.numRows, settings_.indexCacheSize);
+
+      WORD* indices = new WORD[numIndices_ + last.numIndices];
+      memcpy(indices, indices_, sizeof(WORD) * numIndices_);
+      memcpy(indices + numIndices_, lastIndices, sizeof(WORD) * last.numIndices);
+      SafeDeleteArray(indices_);
+      SafeDeleteArray(lastIndices);
+      indices_ = indices;
+      numIndices_ += last.numIndices;
+    }
+  }
+
+  void Ocean::GenerateChunk(void* ocean, int chunk)
+  {
+    Ocean* o = static_cast<Ocean*>(ocean);
+    const MeshChunk& c = o->chunks_[chunk];
+
+    // The row shared with the next chunk is left to it
+    int lastRow = (chunk == o->numChunks_ - 1) ? c.firstRow + c.numRows : c.firstRow + c.numRows - 1;
+
+    for (int z = c.firstRow; z < lastRow; ++z)
+    {
+      XMFLOAT2* row = o->baseGrid_ + z * o->settings_.heightmapDimX;
+      for (int x = 0; x < o->settings_.heightmapDimX; ++x) {
+        row[x] = XMFLOAT2(o->gridOrigin_.x + x * o->gridSpacing_, o->gridOrigin_.y + z * o->gridSpacing_);
+      }
+    }
+  }
+
+  void Ocean::InitFFTW()
+  {
+    // Complex-to-real transforms take the non-redundant half of a Hermitian spectrum, fftDimY x (fftDimX / 2 + 1)
+    hktIn_ = new fftwf_complex[spectrumSize_];
+    hktOut_ = new float[fftSize_];
+    hktPlan_ = fftwf_plan_dft_c2r_2d(settings_.fftDimY, settings_.fftDimX, hktIn_, hktOut_, FFTW_PATIENT);
+
+    DxtIn_ = new fftwf_complex[spectrumSize_];
+    DxtOut_ = new float[fftSize_];
+    DxtPlan_ = fftwf_plan_dft_c2r_2d(settings_.fftDimY, settings_.fftDimX, DxtIn_, DxtOut_, FFTW_PATIENT);
+
+    DztIn_ = new fftwf_complex[spectrumSize_];
+    DztOut_ = new float[fftSize_];
+    DztPlan_ = fftwf_plan_dft_c2r_2d(settings_.fftDimY, settings_.fftDimX, DztIn_, DztOut_, FFTW_PATIENT);
+
+    // The normals' central differences and the foam read the displacement even when there's no choppiness to transform it for, so it starts flat
+    ZeroMemory(DxtOut_, sizeof(float) * fftSize_);
+    ZeroMemory(DztOut_, sizeof(float) * fftSize_);
+
+    nxIn_ = new fftwf_complex[spectrumSize_];
+    nxOut_ = new float[fftSize_];
+    nxPlan_ = fftwf_plan_dft_c2r_2d(settings_.fftDimY, settings_.fftDimX, nxIn_, nxOut_, FFTW_PATIENT);
+
+    nzIn_ = new fftwf_complex[spectrumSize_];
+    nzOut_ = new float[fftSize_];
+    nzPlan_ = fftwf_plan_dft_c2r_2d(settings_.fftDimY, settings_.fftDimX, nzIn_, nzOut_, FFTW_PATIENT);
+
+    // Each LOD level halves the resolution of the last
+    lods_ = new SpectralLod[settings_.lodLevels];
+    for (int i = 0; i < settings_.lodLevels; ++i)
+    {
+      SpectralLod& lod = lods_[i];
+      lod.dimX = settings_.fftDimX >> (i + 1);
+      lod.dimY = settings_.fftDimY >> (i + 1);
+      lod.spectrumDimX = lod.dimX / 2 + 1;
+      lod.in = new fftwf_complex[lod.spectrumDimX * lod.dimY];
+      lod.out = new float[lod.dimX * lod.dimY];
+      lod.plan = fftwf_plan_dft_c2r_2d(lod.dimY, lod.dimX, lod.in, lod.out, FFTW_PATIENT);
+    }
+  }
+
+  void Ocean::InitDerivative(SurfaceDerivative& derivative)
+  {
+    for (int i = 0; i < 3; ++i)
+    {
+      derivative.in[i] = new fftwf_complex[spectrumSize_];
+      derivative.out[i] = new float[fftSize_];
+      derivative.plans[i] = fftwf_plan_dft_c2r_2d(settings_.fftDimY, settings_.fftDimX, derivative.in[i], derivative.out[i],
+        FFTW_PATIENT);
+    }
 
-    nzIn_ = new fftwf_complex[fftSize_ * sizeof(fftwf_complex)];
-    nzOut_ = new float[fftSize_ * sizeof(float)];
-    nzPlan_ = fftwf_plan_dft_c2r_2d(settings_.fftDim, settings_.fftDim, nzIn_, nzOut_, FFTW_PATIENT);
+    // Without choppiness the horizontal derivatives are never transformed, so they stay flat
+    ZeroMemory(derivative.out[0], sizeof(float) * fftSize_);
+    ZeroMemory(derivative.out[2], sizeof(float) * fftSize_);
+    derivative.samples = new XMFLOAT3[numVertices_];
+    ZeroMemory(derivative.samples, sizeof(XMFLOAT3) * numVertices_);
   }
 
   HRESULT Ocean::InitTextures()
@@ -197,57 +555,33 @@ namespace OceanWaves
     return S_OK;
   }
 
-  float Ocean::Phillips(const XMFLOAT2& k)
-  {
-    if (k.x == 0.0f && k.y == 0.0f) {
-      return 0.0f;
-    }
-    // Largest possible wave from constant wind speed V
-    float L = (settings_.V * settings_.V) / gravity_;
-
-    // Smallest possible wave from constant wind speed V
-    float l = L / settings_.smallestWave;
-
-    float ksqr = k.x * k.x + k.y * k.y;
-    float hcosf = k.x * cosf(settings_.w) + k.y * sinf(settings_.w);
-    float retval = settings_.A * (expf(-1.0f / (ksqr * L * L)) / (ksqr * ksqr * ksqr)) * (hcosf * hcosf);
-
-    // Filter out waves moving opposite to wind
-    if (hcosf < 0.0f) {
-      retval *= settings_.S;
-    }
-    return retval * expf(-ksqr * l * l);
-  }
-
   void Ocean::InitHeightmap()
   {
-    static const float invSqrt2 = 0.7071068f;
     settings_.w = XMConvertToRadians(settings_.w);
 
     // Seed random number generator
     srand(0);
 
-    XMFLOAT2 k;
-
-    for (int y = 0; y < settings_.fftDim; ++y)
+    // Draw the Gaussian pairs up front, in the same order as always, so the kernel can be vectorised
+    XMFLOAT2* gauss = new XMFLOAT2[fftSize_];
+    for (unsigned int i = 0; i < fftSize_; ++i)
     {
-      k.y = freqToImage(y);
-
-      for (int x = 0; x < settings_.fftDim; ++x)
-      {
-        k.x = freqToImage(x);
-
-        float sqrtPhk = sqrtf(Phillips(k));
-        float Er = GaussRand(), Ei = GaussRand();
-
-        // ~h0(k)
-        h0k_[y * settings_.fftDim + x].x = invSqrt2 * Er * sqrtPhk;
-        h0k_[y * settings_.fftDim + x].y = invSqrt2 * Ei * sqrtPhk;
-
-        // omega(k)
-        wk_[y * settings_.fftDim + x] = sqrtf(gravity_ * sqrtf(k.x * k.x + k.y * k.y));
-      }
+      gauss[i].x = GaussRand();
+      gauss[i].y = GaussRand();
     }
+
+    SpectrumParams params;
+    params.A = settings_.A;
+    params.windX = cosf(settings_.w);
+    params.windZ = sinf(settings_.w);
+    params.S = settings_.S;
+    params.L = (settings_.V * settings_.V) / gravity_; // Largest possible wave from constant wind speed V
+    params.l = params.L / settings_.smallestWave; // Smallest possible wave from constant wind speed V
+    params.gravity = gravity_;
+
+    // ~h0(k), omega(k) and the terms the evolution reads
+    kernels_->initSpectrum(kernelGrid_, params, gauss, h0k_, wk_, evolveTerms_);
+    SafeDeleteArray(gauss);
   }
 
   void Ocean::Update(const XMFLOAT4X4& world, const XMFLOAT4X4& worldViewProjection, const XMFLOAT3& cp, const XMFLOAT3& cv)
@@ -261,178 +595,778 @@ namespace OceanWaves
     vsc.camView = cv;
 
     immediateContext_->UpdateSubresource(vsConstants_, 0, NULL, &vsc, 0, 0);
+
+    // The projected grid is cast from the camera into the ocean's space
+    XMVECTOR determinant;
+    XMStoreFloat4x4(&inverseWorldViewProjection_, XMMatrixInverse(&determinant, XMLoadFloat4x4(&worldViewProjection)));
+
+    // The clipmap and the quadtree follow the camera across the ocean's plane
+    XMMATRIX inverseWorld = XMMatrixInverse(&determinant, XMLoadFloat4x4(&world));
+    XMFLOAT3 camera;
+    XMStoreFloat3(&camera, XMVector3TransformCoord(XMLoadFloat3(&cp), inverseWorld));
+    if (settings_.clipmapLevels) {
+      clipmap_.Update(camera);
+    }
+    frustum_.Extract(worldViewProjection);
+    if (settings_.cdlodLevels) {
+      cdlod_.Select(camera, frustum_, dispBounds_);
+    }
+    if (settings_.tileRadius)
+    {
+      stats_.cullTime = tiles_.Cull(camera, frustum_, dispBounds_);
+      stats_.tilesDrawn = tiles_.GetNumVisible();
+      stats_.tilesCulled = tiles_.GetNumTiles() - tiles_.GetNumVisible();
+    }
   }
 
-  void Ocean::UpdateHeightmap(float elapsedTime)
+  unsigned int Ocean::GetRequiredChannels() const
   {
-    // h0(k) -> h(k,t)
-    for (int y = 0; y < settings_.fftDim; ++y)
-    {
-      for (int x = 0; x < settings_.fftDim; ++x)
-      {
-        XMFLOAT2 h0k = h0k_[y * settings_.fftDim + x];
-        XMFLOAT2 h0cmk = h0k_[y * settings_.fftDim + x];
+    unsigned int channels = 0;
+    for (int i = 0; i < OCEAN_NUM_CONSUMERS; ++i) {
+      channels |= channelDemand_[i];
+    }
+    // The clipmap, the quadtree and the tiles draw the atlas rather than the mesh, which packs the whole surface
+    if ((channels & OCEAN_CHANNEL_SURFACE) && (settings_.clipmapLevels || settings_.cdlodLevels || settings_.tileRadius)) {
+      channels |= OCEAN_CHANNEL_TEXTURES;
+    }
+    if (channels & OCEAN_CHANNEL_TEXTURES) {
+      channels |= OCEAN_CHANNEL_SURFACE;
+    }
 
-        float sin = sinf(wk_[y * settings_.fftDim + x] * elapsedTime * settings_.wavePeriod);
-        float cos = cosf(wk_[y * settings_.fftDim + x] * elapsedTime * settings_.wavePeriod);
+    // Without choppiness the horizontal displacement contributes nothing
+    if (settings_.choppiness == 0.0f) {
+      channels &= ~OCEAN_CHANNEL_DISPLACEMENT;
+    }
+    return channels;
+  }
+
+  unsigned int Ocean::ScheduleChannels(unsigned int channels) const
+  {
+    // Height, the LODs, the derivatives and the atlas are updated every frame, and the foam with the displacement it needs, so
+    // it never forces the displacement's transforms between their updates. Normals are offset by a frame from the displacement
+    // so that with equal intervals their transforms never land on the same frame.
+    unsigned int scheduled = channels & (OCEAN_CHANNEL_HEIGHT | OCEAN_CHANNEL_LOD | OCEAN_CHANNEL_VELOCITY |
+      OCEAN_CHANNEL_ACCELERATION | OCEAN_CHANNEL_TEXTURES);
+    if (frame_ % settings_.displacementInterval == 0) {
+      scheduled |= channels & (OCEAN_CHANNEL_DISPLACEMENT | OCEAN_CHANNEL_FOAM);
+    }
+    if ((frame_ + 1) % settings_.normalInterval == 0) {
+      scheduled |= channels & OCEAN_CHANNEL_NORMALS;
+    }
+    return scheduled;
+  }
 
-        hktIn_[y * settings_.fftDim + x][0] = (h0k.x + h0cmk.x) * cos - (h0k.y + h0cmk.y) * sin;
-        hktIn_[y * settings_.fftDim + x][1] = (h0k.x - h0cmk.x) * sin + (h0k.y - h0cmk.y) * cos;
+  unsigned int Ocean::AddSourceChannels(unsigned int channels) const
+  {
+    // Normals filtered from the height need it transformed, and those of the displaced surface need the displacement too
+    if ((channels & OCEAN_CHANNEL_NORMALS) && settings_.normalMethod != NORMAL_METHOD_FFT)
+    {
+      channels |= OCEAN_CHANNEL_HEIGHT;
+      if (settings_.normalMethod == NORMAL_METHOD_DIFFERENCES && settings_.choppiness != 0.0f) {
+        channels |= OCEAN_CHANNEL_DISPLACEMENT;
       }
     }
 
-    XMFLOAT2 k, l;
+    // As does the foam, which is none at all without choppiness
+    if ((channels & OCEAN_CHANNEL_FOAM) && settings_.choppiness != 0.0f) {
+      channels |= OCEAN_CHANNEL_DISPLACEMENT;
+    }
+    return channels;
+  }
+
+  int Ocean::CountFFTs(unsigned int channels) const
+  {
+    bool transformNormals = (channels & OCEAN_CHANNEL_NORMALS) && settings_.normalMethod == NORMAL_METHOD_FFT;
+    channels = AddSourceChannels(channels);
+    int derivativeFFTs = (settings_.choppiness != 0.0f) ? 3 : 1;
+    return ((channels & OCEAN_CHANNEL_HEIGHT) ? 1 : 0) + ((channels & OCEAN_CHANNEL_DISPLACEMENT) ? 2 : 0) +
+      (transformNormals ? 2 : 0) + ((channels & OCEAN_CHANNEL_LOD) ? settings_.lodLevels : 0) +
+      ((channels & OCEAN_CHANNEL_VELOCITY) ? derivativeFFTs : 0) + ((channels & OCEAN_CHANNEL_ACCELERATION) ? derivativeFFTs : 0);
+  }
+
+  void Ocean::UpdateHeightmap(float elapsedTime)
+  {
+    timer_.Start();
+
+    unsigned int channels = GetRequiredChannels();
 
-    // h(k,t) -> Dx(k,t), Dz(k,t)
-    for (int y = 0; y < settings_.fftDim; ++y)
+    // Nothing to do if time hasn't moved on (i.e. paused) and every demanded channel is still valid
+    if (elapsedTime == lastTime_ && (channels & ~validChannels_) == 0)
     {
-      k.y = l.y = freqToImage(y);
+      stats_.channelsComputed = stats_.channelsInterpolated = stats_.fftsExecuted = 0;
+      stats_.channelsSkipped = OCEAN_NUM_CHANNELS;
+      stats_.fftsSkipped = CountFFTs(OCEAN_CHANNEL_ALL);
+      stats_.lodTime = stats_.foamTime = stats_.mipTime = stats_.boundsTime = stats_.velocityTime = 0.0f;
+      stats_.updateSkipped = true;
+      RecordFrameTime(timer_.Stop());
+      return;
+    }
 
-      for (int x = 0; x < settings_.fftDim; ++x)
+    // Newly demanded channels are computed straight away, restarting their history. Otherwise only
+    // the channels due this frame are computed, and nothing else is written if time hasn't moved on.
+    unsigned int restarted = channels & ~validChannels_;
+    unsigned int scheduled = restarted;
+    unsigned int written = restarted;
+    if (elapsedTime != lastTime_)
+    {
+      ++frame_;
+      scheduled |= ScheduleChannels(channels);
+      written = channels;
+    }
+
+    ComputeChannels(elapsedTime, scheduled);
+    stats_.foamTime = 0.0f;
+    if (scheduled & OCEAN_CHANNEL_FOAM) {
+      ComputeFoam(elapsedTime, (restarted & OCEAN_CHANNEL_FOAM) != 0);
+    }
+    StoreHistory(scheduled, restarted);
+
+    // The mesh's stream is written straight into the next frame of the ring, except on the frames its
+    // error is measured, which reads it back from the CPU copy
+    BYTE* cpuStream = streamPacked_ ? streamPacked_ : streamHalf_ ? reinterpret_cast<BYTE*>(streamHalf_) : reinterpret_cast<BYTE*>(stream_);
+    bool measured = (streamHalf_ || streamPacked_) && frame_ % OCEAN_STATS_WINDOW == 0;
+    BYTE* ringFrame = (written && settings_.uploadFrames) ? static_cast<BYTE*>(uploadRing_.Begin()) : NULL;
+    streamTarget_ = (ringFrame && !measured) ? ringFrame : cpuStream;
+    WriteVertices(written);
+
+    // The pyramid is only rebuilt once something asks for bounds of the new heightmap
+    stats_.boundsTime = 0.0f;
+    heightPyramidDirty_ = heightPyramidDirty_ || written != 0;
+
+    stats_.uploadBytes = 0;
+    stats_.mipTime = 0.0f;
+    if (written & OCEAN_CHANNEL_TEXTURES)
+    {
+      // The atlas takes a texture array and, with the CPU filters, a copy of every level, so it's only made once demanded
+      if (!heightmapTextures_.GetNumLevels())
+      {
+        heightmapTextures_.Init(settings_.heightmapDimX, settings_.heightmapDimY, gridSpacing_,
+          static_cast<MipFilter>(settings_.mipFilter), settings_.halfTextures != 0, kernels_, &threadPool_);
+        heightmapTextures_.InitTextures(device_);
+      }
+
+      Timer mipTimer;
+      mipTimer.Start();
+      heightmapTextures_.Build(stream_);
+      stats_.mipTime = mipTimer.Stop();
+      stats_.uploadBytes = heightmapTextures_.Upload();
+    }
+    if (written && !settings_.projectedGridSize)
+    {
+      if (settings_.clipmapLevels || settings_.cdlodLevels || settings_.tileRadius)
       {
-        k.x = l.x = freqToImage(x);
+        // The quadtree's nodes and the tiles are padded by the largest displacement, with headroom for it to grow by next frame
+        if (settings_.cdlodLevels || settings_.tileRadius)
+        {
+          VertexDispNor lower, upper;
+          BuildHeightPyramid();
+          heightPyramid_.GetBounds(&lower, &upper);
+          XMFLOAT3 largest(max(-lower.Disp.x, upper.Disp.x), max(-lower.Disp.y, upper.Disp.y), max(-lower.Disp.z, upper.Disp.z));
+          dispBounds_ = XMFLOAT3(1.25f * largest.x, 1.25f * largest.y, 1.25f * largest.z);
+        }
+      }
+      else
+      {
+        if (streamPacked_)
+        {
+          StreamConstants sc;
+          sc.dispScale = XMFLOAT4(packScale_.x, packScale_.y, packScale_.z, 0.0f);
+          immediateContext_->UpdateSubresource(streamConstants_, 0, NULL, &sc, 0, 0);
+          stats_.uploadBytes += sizeof(StreamConstants);
+        }
+        if (ringFrame)
+        {
+          if (streamTarget_ != ringFrame) {
+            memcpy(ringFrame, streamTarget_, streamStride_ * numVertices_);
+          }
+          uploadRing_.End();
+          stats_.uploadStalls = uploadRing_.GetStats().stalls;
+        }
+        else {
+          immediateContext_->UpdateSubresource(vertexBuffer_, 0, NULL, streamTarget_, 0, 0);
+        }
+        stats_.uploadBytes += streamStride_ * numVertices_;
+      }
+    }
+
+    // The camera can move while the heightmap doesn't, so the grid is projected every frame
+    if (settings_.projectedGridSize)
+    {
+      projectedGrid_.Project(inverseWorldViewProjection_, stream_, settings_.heightmapDimX, settings_.heightmapDimY, gridOrigin_,
+        gridSpacing_);
+      stats_.uploadBytes += projectedGrid_.Upload();
+    }
+    if ((streamHalf_ || streamPacked_) && frame_ % OCEAN_STATS_WINDOW == 0) {
+      MeasureStreamError();
+    }
 
-        float ksqr = k.x * k.x + k.y * k.y;
-        float krsqr = (ksqr > 1e-12f) ? 1.0f / sqrt(ksqr) : 0.0f;
+    // Channels computed at an earlier time are stale now
+    validChannels_ = (elapsedTime == lastTime_) ? (validChannels_ | channels) : channels;
+    lastTime_ = elapsedTime;
+
+    stats_.channelsComputed = 0;
+    for (int i = 0; i < OCEAN_NUM_CHANNELS; ++i) {
+      stats_.channelsComputed += (scheduled >> i) & 1;
+    }
+    stats_.channelsSkipped = OCEAN_NUM_CHANNELS - stats_.channelsComputed;
+    stats_.channelsInterpolated = ((written & OCEAN_CHANNEL_DISPLACEMENT) && dispHistory_.IsEnabled()) +
+      ((written & OCEAN_CHANNEL_NORMALS) && slopeHistory_.IsEnabled());
+    stats_.historyBytes = dispHistory_.GetBytes() + slopeHistory_.GetBytes();
+    stats_.fftsExecuted = CountFFTs(scheduled);
+    stats_.fftsSkipped = CountFFTs(OCEAN_CHANNEL_ALL) - stats_.fftsExecuted;
+    stats_.updateSkipped = false;
+    RecordFrameTime(timer_.Stop());
+  }
 
-        k.x *= krsqr;
-        k.y *= krsqr;
+  void Ocean::ComputeChannels(float elapsedTime, unsigned int channels)
+  {
+    bool computeNormals = (channels & OCEAN_CHANNEL_NORMALS) != 0;
+    bool transformNormals = computeNormals && settings_.normalMethod == NORMAL_METHOD_FFT;
+    channels = AddSourceChannels(channels);
+    bool computeHeight = (channels & OCEAN_CHANNEL_HEIGHT) != 0;
+    bool computeDisplacement = (channels & OCEAN_CHANNEL_DISPLACEMENT) != 0;
+    bool computeVelocity = (channels & OCEAN_CHANNEL_VELOCITY) != 0;
+    bool computeAcceleration = (channels & OCEAN_CHANNEL_ACCELERATION) != 0;
+
+    // The velocity and acceleration take three patient plans and full-size buffers each, so they're only made once demanded
+    if (computeVelocity && !velocity_.samples) {
+      InitDerivative(velocity_);
+    }
+    if (computeAcceleration && !acceleration_.samples) {
+      InitDerivative(acceleration_);
+    }
 
-        DxtIn_[y * settings_.fftDim + x][0] = k.x * hktIn_[y * settings_.fftDim + x][1];
-        DxtIn_[y * settings_.fftDim + x][1] = k.x * -hktIn_[y * settings_.fftDim + x][0];
+    // The wave period scales time, so the derivatives with respect to real time are scaled by it too
+    if (channels)
+    {
+      kernels_->evolveSpectrum(kernelGrid_, evolveTerms_, wk_, elapsedTime * settings_.wavePeriod, settings_.wavePeriod, hktIn_,
+        computeVelocity ? velocity_.in[1] : NULL, computeAcceleration ? acceleration_.in[1] : NULL);
+    }
 
-        DztIn_[y * settings_.fftDim + x][0] = k.y * hktIn_[y * settings_.fftDim + x][1];
-        DztIn_[y * settings_.fftDim + x][1] = k.y * -hktIn_[y * settings_.fftDim + x][0];
+    // h(k,t) -> Dx(k,t), Dz(k,t) and the slopes
+    if (computeDisplacement || transformNormals)
+    {
+      kernels_->deriveChannels(kernelGrid_, hktIn_, computeDisplacement ? DxtIn_ : NULL, computeDisplacement ? DztIn_ : NULL,
+        transformNormals ? nxIn_ : NULL, transformNormals ? nzIn_ : NULL);
+    }
 
-        nxIn_[y * settings_.fftDim + x][0] = l.x * -hktIn_[y * settings_.fftDim + x][1];
-        nxIn_[y * settings_.fftDim + x][1] = l.x * hktIn_[y * settings_.fftDim + x][0];
+    // The LOD spectra are cropped from h(k,t) too, so this must also happen before its plan overwrites it
+    stats_.lodTime = 0.0f;
+    if (channels & OCEAN_CHANNEL_LOD) {
+      ComputeLods();
+    }
 
-        nzIn_[y * settings_.fftDim + x][0] = l.y * -hktIn_[y * settings_.fftDim + x][1];
-        nzIn_[y * settings_.fftDim + x][1] = l.y * hktIn_[y * settings_.fftDim + x][0];
+    // The derived channels are read from h(k,t) above, so its plan (which overwrites its input) can run in any order
+    if (computeDisplacement)
+    {
+      fftwf_execute(DxtPlan_);
+      fftwf_execute(DztPlan_);
+    }
+    if (computeHeight) {
+      fftwf_execute(hktPlan_);
+    }
+    if (transformNormals)
+    {
+      fftwf_execute(nxPlan_);
+      fftwf_execute(nzPlan_);
+    }
+    else if (computeNormals)
+    {
+      // Otherwise the slopes are filtered from the transformed channels, at just the samples the heightmap reads
+      int stepX = settings_.fftDimX / settings_.heightmapDimX;
+      int stepZ = settings_.fftDimY / settings_.heightmapDimY;
+      if (settings_.normalMethod == NORMAL_METHOD_SOBEL) {
+        kernels_->sobelSlopes(kernelGrid_, hktOut_, stepX, stepZ, nxOut_, nzOut_);
+      }
+      else {
+        kernels_->displacedSlopes(kernelGrid_, hktOut_, DxtOut_, DztOut_, settings_.choppiness, stepX, stepZ, nxOut_, nzOut_);
       }
     }
 
-    fftwf_execute(DxtPlan_);
-    fftwf_execute(hktPlan_);
-    fftwf_execute(DztPlan_);
-    fftwf_execute(nxPlan_);
-    fftwf_execute(nzPlan_);
+    stats_.velocityTime = 0.0f;
+    if (computeVelocity || computeAcceleration)
+    {
+      Timer timer;
+      timer.Start();
+      if (computeVelocity) {
+        ComputeDerivative(velocity_);
+      }
+      if (computeAcceleration) {
+        ComputeDerivative(acceleration_);
+      }
+      stats_.velocityTime = timer.Stop();
+    }
+  }
 
-    XMFLOAT3 n;
+  void Ocean::ComputeDerivative(SurfaceDerivative& derivative)
+  {
+    // The horizontal displacement's derivatives are derived from the height's as the displacement is from the height
+    if (settings_.choppiness != 0.0f)
+    {
+      kernels_->deriveChannels(kernelGrid_, derivative.in[1], derivative.in[0], derivative.in[2], NULL, NULL);
+      fftwf_execute(derivative.plans[0]);
+      fftwf_execute(derivative.plans[2]);
+    }
+    fftwf_execute(derivative.plans[1]);
 
-    for (int z = 0; z < settings_.fftDim; z += 2)
+    // Sampled where the heightmap's vertices are
+    int stepX = settings_.fftDimX / settings_.heightmapDimX;
+    int stepZ = settings_.fftDimY / settings_.heightmapDimY;
+    for (int z = 0; z < settings_.heightmapDimY; ++z)
     {
-      for (int x = 0; x < settings_.fftDim; x += 2)
+      int row = (z * stepZ) * settings_.fftDimX;
+      XMFLOAT3* samples = derivative.samples + z * settings_.heightmapDimX;
+      for (int x = 0; x < settings_.heightmapDimX; ++x)
       {
-        vertices_[(z / 2) * settings_.heightmapDim + (x / 2)].Pos.x += settings_.choppiness * DxtOut_[z * settings_.fftDim + x];
-        vertices_[(z / 2) * settings_.heightmapDim + (x / 2)].Pos.y = hktOut_[z * settings_.fftDim + x];
-        vertices_[(z / 2) * settings_.heightmapDim + (x / 2)].Pos.z += settings_.choppiness * DztOut_[z * settings_.fftDim + x];
+        int i = row + x * stepX;
+        samples[x] = XMFLOAT3(settings_.choppiness * derivative.out[0][i], derivative.out[1][i],
+          settings_.choppiness * derivative.out[2][i]);
+      }
+    }
+  }
+
+  void Ocean::ComputeFoam(float elapsedTime, bool restart)
+  {
+    Timer timer;
+    timer.Start();
+
+    // Foam left from before the channel was demanded is stale, and otherwise fades with the time since it was last updated
+    if (restart) {
+      ZeroMemory(foam_, sizeof(float) * numVertices_);
+    }
+    float decay = expf(-max(elapsedTime - lastFoamTime_, 0.0f) / OCEAN_FOAM_LIFETIME);
+    lastFoamTime_ = elapsedTime;
+
+    int stepX = settings_.fftDimX / settings_.heightmapDimX;
+    int stepZ = settings_.fftDimY / settings_.heightmapDimY;
+    kernels_->foam(kernelGrid_, DxtOut_, DztOut_, settings_.choppiness, stepX, stepZ, OCEAN_FOAM_THRESHOLD, decay, jacobian_,
+      foam_);
 
-        n.x = nxOut_[z * settings_.fftDim + x];
-        n.z = nzOut_[z * settings_.fftDim + x];
+    stats_.foamTime = timer.Stop();
+  }
+
+  void Ocean::ComputeLods()
+  {
+    Timer timer;
+    timer.Start();
 
-        float length = sqrt(n.x * n.x + 1.0f + n.z * n.z);
+    for (int i = 0; i < settings_.lodLevels; ++i)
+    {
+      SpectralLod& lod = lods_[i];
 
-        vertices_[(z / 2) * settings_.heightmapDim + (x / 2)].Nor.x = n.x / length;
-        vertices_[(z / 2) * settings_.heightmapDim + (x / 2)].Nor.y = 1.0f / length;
-        vertices_[(z / 2) * settings_.heightmapDim + (x / 2)].Nor.z = n.z / length;
+      // Keep the wavenumbers that the coarser grid can represent, at the same (unnormalised) amplitudes,
+      // so that the LOD is the full resolution surface band-limited to its Nyquist frequency
+      for (int y = 0; y < lod.dimY; ++y)
+      {
+        int ky = (y <= lod.dimY / 2) ? y : y - lod.dimY;
+        int sy = (ky >= 0) ? ky : settings_.fftDimY + ky;
+
+        for (int x = 0; x < lod.spectrumDimX; ++x)
+        {
+          fftwf_complex& c = lod.in[y * lod.spectrumDimX + x];
+
+          // The Nyquist bins alias the positive and negative frequency, so they're dropped
+          if (y == lod.dimY / 2 || x == lod.dimX / 2)
+          {
+            c[0] = c[1] = 0.0f;
+            continue;
+          }
+          c[0] = hktIn_[sy * spectrumDimX_ + x][0];
+          c[1] = hktIn_[sy * spectrumDimX_ + x][1];
+        }
       }
+      fftwf_execute(lod.plan);
     }
+    stats_.lodTime = timer.Stop();
+  }
+
+  const float* Ocean::GetLodHeightmap(int level, int* dimX, int* dimY) const
+  {
+    assert(level >= 1 && level <= settings_.lodLevels);
+
+    const SpectralLod& lod = lods_[level - 1];
+    *dimX = lod.dimX;
+    *dimY = lod.dimY;
+    return lod.out;
+  }
+
+  const VertexDispNor* Ocean::GetHeightmap(int* dimX, int* dimY, XMFLOAT2* origin, float* spacing) const
+  {
+    *dimX = settings_.heightmapDimX;
+    *dimY = settings_.heightmapDimY;
+    *origin = gridOrigin_;
+    *spacing = gridSpacing_;
+    return stream_;
+  }
+
+  void Ocean::QueryHeights(const XMFLOAT2* positions, int count, float* heights, XMFLOAT3* normals) const
+  {
+    // Vertex (0, 0) lies at gridOrigin_, as the base grid's first vertex does
+    kernels_->sampleHeights(stream_, settings_.heightmapDimX, settings_.heightmapDimY, gridOrigin_, gridSpacing_, positions, count,
+      heights, normals);
+  }
+
+  void Ocean::QueryHeightsParallel(const XMFLOAT2* positions, int count, float* heights, XMFLOAT3* normals)
+  {
+    HeightQuery query = { this, positions, count, heights, normals, 0, 0.0f, NULL, NULL };
+    threadPool_.ParallelFor((count + OCEAN_QUERY_BLOCK - 1) / OCEAN_QUERY_BLOCK, QueryHeightBlock, &query);
+  }
+
+  void Ocean::QueryHeightBlock(void* query, int block)
+  {
+    const HeightQuery* q = static_cast<const HeightQuery*>(query);
+
+    int first = block * OCEAN_QUERY_BLOCK;
+    int count = min(OCEAN_QUERY_BLOCK, q->count - first);
+    q->ocean->QueryHeights(q->positions + first, count, q->heights + first, q->normals ? q->normals + first : NULL);
+  }
 
-    immediateContext_->UpdateSubresource(vertexBuffer_, 0, NULL, vertices_, 0, 0);
+  void Ocean::QueryDisplacedHeights(const XMFLOAT2* positions, int count, int maxIterations, float tolerance, float* heights,
+    XMFLOAT3* normals, int* iterations, float* residuals) const
+  {
+    kernels_->sampleDisplacedHeights(stream_, settings_.heightmapDimX, settings_.heightmapDimY, gridOrigin_, gridSpacing_, positions,
+      count, maxIterations, tolerance, heights, normals, iterations, residuals);
   }
 
-  void Ocean::ComputeNormalsFFT()
+  void Ocean::QueryDisplacedHeightsParallel(const XMFLOAT2* positions, int count, int maxIterations, float tolerance,
+    float* heights, XMFLOAT3* normals, int* iterations, float* residuals)
   {
-    XMFLOAT2 k;
-    XMFLOAT3 n;
+    HeightQuery query = { this, positions, count, heights, normals, maxIterations, tolerance, iterations, residuals };
+    threadPool_.ParallelFor((count + OCEAN_QUERY_BLOCK - 1) / OCEAN_QUERY_BLOCK, QueryDisplacedHeightBlock, &query);
+  }
+
+  void Ocean::QueryDisplacedHeightBlock(void* query, int block)
+  {
+    const HeightQuery* q = static_cast<const HeightQuery*>(query);
+
+    int first = block * OCEAN_QUERY_BLOCK;
+    int count = min(OCEAN_QUERY_BLOCK, q->count - first);
+    q->ocean->QueryDisplacedHeights(q->positions + first, count, q->maxIterations, q->tolerance, q->heights + first,
+      q->normals ? q->normals + first : NULL, q->iterations ? q->iterations + first : NULL,
+      q->residuals ? q->residuals + first : NULL);
+  }
 
-    for (int y = 0; y < settings_.fftDim; ++y)
+  void Ocean::QueryVelocities(const XMFLOAT2* positions, int count, XMFLOAT3* velocities, XMFLOAT3* accelerations) const
+  {
+    // Still, if they've never been demanded
+    if (velocities && !velocity_.samples) {
+      ZeroMemory(velocities, sizeof(XMFLOAT3) * count);
+    }
+    else if (velocities)
+    {
+      kernels_->sampleVectors(velocity_.samples, settings_.heightmapDimX, settings_.heightmapDimY, gridOrigin_, gridSpacing_,
+        positions, count, velocities);
+    }
+    if (accelerations && !acceleration_.samples) {
+      ZeroMemory(accelerations, sizeof(XMFLOAT3) * count);
+    }
+    else if (accelerations)
     {
-      k.y = freqToImage(y);
+      kernels_->sampleVectors(acceleration_.samples, settings_.heightmapDimX, settings_.heightmapDimY, gridOrigin_,
+        gridSpacing_, positions, count, accelerations);
+    }
+  }
 
-      for (int x = 0; x < settings_.fftDim; ++x)
-      {
-        k.x = freqToImage(x);
+  const HeightPyramid& Ocean::GetHeightPyramid()
+  {
+    BuildHeightPyramid();
+    return heightPyramid_;
+  }
+
+  void Ocean::BuildHeightPyramid()
+  {
+    if (!heightPyramidDirty_) {
+      return;
+    }
+
+    Timer timer;
+    timer.Start();
+    heightPyramid_.Build(stream_);
+    stats_.boundsTime += timer.Stop();
+    heightPyramidDirty_ = false;
+  }
+
+  void Ocean::CastRays(const XMFLOAT3* origins, const XMFLOAT3* directions, int count, float maxDistance, RayHit* hits)
+  {
+    BuildHeightPyramid();
+    rayCaster_.Cast(stream_, origins, directions, count, maxDistance, hits);
+  }
+
+  void Ocean::StoreHistory(unsigned int channels, unsigned int restarted)
+  {
+    int stepX = settings_.fftDimX / settings_.heightmapDimX;
+    int stepZ = settings_.fftDimY / settings_.heightmapDimY;
+
+    bool storeDisplacement = (channels & OCEAN_CHANNEL_DISPLACEMENT) && dispHistory_.IsEnabled();
+    bool storeNormals = (channels & OCEAN_CHANNEL_NORMALS) && slopeHistory_.IsEnabled();
+
+    if (storeDisplacement) {
+      dispHistory_.Advance();
+    }
+    if (storeNormals) {
+      slopeHistory_.Advance();
+    }
 
-        nxIn_[y * settings_.fftDim + x][0] = k.x * -hktIn_[y * settings_.fftDim + x][1];
-        nxIn_[y * settings_.fftDim + x][1] = k.x * hktIn_[y * settings_.fftDim + x][0];
+    // Sample a row at a time into the history
+    for (int z = 0; z < settings_.heightmapDimY; ++z)
+    {
+      const float* Dx = DxtOut_ + (z * stepZ) * settings_.fftDimX;
+      const float* Dz = DztOut_ + (z * stepZ) * settings_.fftDimX;
+      const float* nx = nxOut_ + (z * stepZ) * settings_.fftDimX;
+      const float* nz = nzOut_ + (z * stepZ) * settings_.fftDimX;
+
+      if (storeDisplacement)
+      {
+        for (int x = 0; x < settings_.heightmapDimX; ++x)
+        {
+          rowDisp_[x].x = Dx[x * stepX];
+          rowDisp_[x].y = Dz[x * stepX];
+        }
+        dispHistory_.Store(z * settings_.heightmapDimX, settings_.heightmapDimX, rowDisp_);
+      }
+      if (storeNormals)
+      {
+        for (int x = 0; x < settings_.heightmapDimX; ++x)
+        {
+          rowSlope_[x].x = nx[x * stepX];
+          rowSlope_[x].y = nz[x * stepX];
+        }
+        slopeHistory_.Store(z * settings_.heightmapDimX, settings_.heightmapDimX, rowSlope_);
+      }
+    }
 
-        nzIn_[y * settings_.fftDim + x][0] = k.y * -hktIn_[y * settings_.fftDim + x][1];
-        nzIn_[y * settings_.fftDim + x][1] = k.y * hktIn_[y * settings_.fftDim + x][0];
+    if (storeDisplacement)
+    {
+      if (restarted & OCEAN_CHANNEL_DISPLACEMENT) {
+        dispHistory_.Restart();
+      }
+      lastUpdateFrame_[1] = frame_;
+    }
+    if (storeNormals)
+    {
+      if (restarted & OCEAN_CHANNEL_NORMALS) {
+        slopeHistory_.Restart();
       }
+      lastUpdateFrame_[2] = frame_;
+    }
+  }
+
+  void Ocean::WriteVertices(unsigned int channels)
+  {
+    bool writeHeight = (channels & OCEAN_CHANNEL_HEIGHT) != 0;
+    bool writeDisplacement = (channels & OCEAN_CHANNEL_DISPLACEMENT) != 0;
+    bool writeNormals = (channels & OCEAN_CHANNEL_NORMALS) != 0;
+
+    if (!channels) {
+      return;
     }
 
-    fftwf_execute(nxPlan_);
-    fftwf_execute(nzPlan_);
+    int stepX = settings_.fftDimX / settings_.heightmapDimX;
+    int stepZ = settings_.fftDimY / settings_.heightmapDimY;
+
+    // How far the interpolated channels are from their previous towards their current result
+    float dispAlpha = min(1.0f, (frame_ - lastUpdateFrame_[1] + 1) / static_cast<float>(settings_.displacementInterval));
+    float slopeAlpha = min(1.0f, (frame_ - lastUpdateFrame_[2] + 1) / static_cast<float>(settings_.normalInterval));
+
+    // Pack to the largest displacement of the last frame, with room for it to grow
+    if (streamPacked_)
+    {
+      packScale_ = XMFLOAT3(max(1.25f * packMax_.x, 0.001f), max(1.25f * packMax_.y, 0.001f), max(1.25f * packMax_.z, 0.001f));
+      packMax_ = XMFLOAT3(0.0f, 0.0f, 0.0f);
+    }
 
-    for (int z = 0; z < settings_.fftDim; z += 2)
+    for (int z = 0; z < settings_.heightmapDimY; ++z)
     {
-      for (int x = 0; x < settings_.fftDim; x += 2)
+      int row = z * settings_.heightmapDimX;
+      int j = (z * stepZ) * settings_.fftDimX;
+
+      // Gather each channel's row, from the history or straight from the transforms
+      if (writeDisplacement)
+      {
+        if (dispHistory_.IsEnabled()) {
+          dispHistory_.Blend(row, settings_.heightmapDimX, dispAlpha, rowDisp_);
+        }
+        else
+        {
+          for (int x = 0; x < settings_.heightmapDimX; ++x)
+          {
+            rowDisp_[x].x = DxtOut_[j + x * stepX];
+            rowDisp_[x].y = DztOut_[j + x * stepX];
+          }
+        }
+      }
+      if (writeNormals)
       {
-        n.x = nxOut_[z * settings_.fftDim + x];
-        n.z = nzOut_[z * settings_.fftDim + x];
+        if (slopeHistory_.IsEnabled()) {
+          slopeHistory_.Blend(row, settings_.heightmapDimX, slopeAlpha, rowSlope_);
+        }
+        else
+        {
+          for (int x = 0; x < settings_.heightmapDimX; ++x)
+          {
+            rowSlope_[x].x = nxOut_[j + x * stepX];
+            rowSlope_[x].y = nzOut_[j + x * stepX];
+          }
+        }
+      }
 
-        float length = sqrt(n.x * n.x + 1.0f + n.z * n.z);
+      kernels_->writeVertices(writeHeight ? hktOut_ + j : NULL, stepX, writeDisplacement ? rowDisp_ : NULL,
+        writeNormals ? rowSlope_ : NULL, settings_.heightmapDimX, settings_.choppiness, stream_ + row);
 
-        vertices_[(z / 2) * settings_.heightmapDim + (x / 2)].Nor.x = n.x / length;
-        vertices_[(z / 2) * settings_.heightmapDim + (x / 2)].Nor.y = 1.0f / length;
-        vertices_[(z / 2) * settings_.heightmapDim + (x / 2)].Nor.z = n.z / length;
+      // Narrow the row while it's still in the cache, then spread it out to the padded half layout
+      if (streamPacked_) {
+        PackVertices(row, settings_.heightmapDimX);
       }
+      else if (streamHalf_)
+      {
+        VertexDispNorHalf* streamHalf = reinterpret_cast<VertexDispNorHalf*>(streamTarget_);
+        FloatToHalf(rowHalf_, reinterpret_cast<const float*>(stream_ + row), settings_.heightmapDimX * 5);
+        for (int x = 0; x < settings_.heightmapDimX; ++x) {
+          memcpy(&streamHalf[row + x], rowHalf_ + x * 5, sizeof(HALF) * 5);
+        }
+      }
+      else if (streamTarget_ != reinterpret_cast<BYTE*>(stream_))
+      {
+        // The channels not written this frame carry over, so the float stream stays on the CPU and
+        // each row is copied into the ring while it's still in the cache
+        memcpy(streamTarget_ + row * streamStride_, stream_ + row, streamStride_ * settings_.heightmapDimX);
+      }
+    }
+
+    // Displacement that outgrew the scale was clamped, so the whole stream is packed again to fit it
+    if (streamPacked_ && (packMax_.x > packScale_.x || packMax_.y > packScale_.y || packMax_.z > packScale_.z))
+    {
+      packScale_ = XMFLOAT3(1.25f * packMax_.x, 1.25f * packMax_.y, 1.25f * packMax_.z);
+      PackVertices(0, numVertices_);
     }
   }
 
-  void Ocean::ComputeNormalsSobel()
+  void Ocean::PackVertices(int row, int count)
   {
-    static float damp = 0.4f;
+    XMFLOAT3 inverseScale(1.0f / packScale_.x, 1.0f / packScale_.y, 1.0f / packScale_.z);
+    kernels_->packVertices(stream_ + row, count, inverseScale, settings_.packedVertices, streamTarget_ + row * streamStride_,
+      &packMax_);
+  }
+
+  void Ocean::MeasureStreamError()
+  {
+    float disp[3], normal[2];
+
+    stats_.streamPositionError = 0.0f;
+    float minCosine = 1.0f;
 
-    for (int z = 0; z < settings_.fftDim; z += 2)
+    for (unsigned int i = 0; i < numVertices_; ++i)
     {
-      for (int x = 0; x < settings_.fftDim; x += 2)
+      if (streamPacked_)
       {
-        // Orthogonal neighbours
-        float l = damp * height(z - 1, x); // Left
-        float t = damp * height(z, x - 1); // Top
-        float r = damp * height(z + 1, x); // Right
-        float b = damp * height(z, x + 1); // Bottom
-
-        // Diagonal neighbours
-        float tl = damp * height(z - 1, x - 1); // Top left
-        float tr = damp * height(z + 1, x - 1); // Top right
-        float br = damp * height(z + 1, x + 1); // Bottom right
-        float bl = damp * height(z - 1, x + 1); // Bottom left
-
-        // Compute dx and dy using Sobel filter
-        float dx = -(tl + 2.0f * l + bl) + (tr + 2.0f * r + br);
-        float dy = -(tl + 2.0f * t + tr) + (bl + 2.0f * b + br);
-
-        float length = sqrt(dx * dx + dy * dy + 1.0f);
-
-        vertices_[(z / 2) * settings_.heightmapDim + (x / 2)].Nor.x = -dx / length;
-        vertices_[(z / 2) * settings_.heightmapDim + (x / 2)].Nor.y = 1.0f / length;
-        vertices_[(z / 2) * settings_.heightmapDim + (x / 2)].Nor.z = dy / length;
+        // Decode the way the vertex shader does
+        const SHORT* packedDisp;
+        float u, w;
+        if (settings_.packedVertices == 8)
+        {
+          const VertexDispNorPacked8& p = reinterpret_cast<const VertexDispNorPacked8*>(streamPacked_)[i];
+          packedDisp = p.Disp;
+          u = p.Nor[0] / 127.0f;
+          w = p.Nor[1] / 127.0f;
+        }
+        else
+        {
+          const VertexDispNorPacked16& p = reinterpret_cast<const VertexDispNorPacked16*>(streamPacked_)[i];
+          packedDisp = p.Disp;
+          u = p.Nor[0] / 32767.0f;
+          w = p.Nor[1] / 32767.0f;
+        }
+        disp[0] = packedDisp[0] / 32767.0f * packScale_.x;
+        disp[1] = packedDisp[1] / 32767.0f * packScale_.y;
+        disp[2] = packedDisp[2] / 32767.0f * packScale_.z;
+
+        float x = 0.5f * (u + w), z = 0.5f * (u - w);
+        float y = 1.0f - fabsf(x) - fabsf(z);
+        float length = sqrtf(x * x + y * y + z * z);
+        normal[0] = x / length;
+        normal[1] = z / length;
       }
+      else
+      {
+        HalfToFloat(disp, streamHalf_[i].Disp, 3);
+        HalfToFloat(normal, streamHalf_[i].Nor, 2);
+      }
+
+      const VertexDispNor& v = stream_[i];
+      stats_.streamPositionError = max(stats_.streamPositionError, fabsf(disp[0] - v.Disp.x));
+      stats_.streamPositionError = max(stats_.streamPositionError, fabsf(disp[1] - v.Disp.y));
+      stats_.streamPositionError = max(stats_.streamPositionError, fabsf(disp[2] - v.Disp.z));
+
+      // Both normals get their y back the way the vertex shader does
+      float streamY = sqrtf(max(0.0f, 1.0f - normal[0] * normal[0] - normal[1] * normal[1]));
+      float floatY = sqrtf(max(0.0f, 1.0f - v.Nor.x * v.Nor.x - v.Nor.y * v.Nor.y));
+      float length = sqrtf(normal[0] * normal[0] + streamY * streamY + normal[1] * normal[1]);
+      float cosine = (normal[0] * v.Nor.x + streamY * floatY + normal[1] * v.Nor.y) / length;
+      minCosine = min(minCosine, cosine);
     }
+    stats_.streamNormalError = XMConvertToDegrees(acosf(max(-1.0f, minCosine)));
   }
 
-  void Ocean::Render(bool wireframe)
+  void Ocean::RecordFrameTime(float time)
   {
-    static UINT stride = sizeof(VertexPosNor);
-    static UINT offset = 0;
+    frameTimes_[frameTimeIndex_] = time;
+    frameTimeIndex_ = (frameTimeIndex_ + 1) % OCEAN_STATS_WINDOW;
 
-    immediateContext_->IASetInputLayout(vertexLayout_);
-    immediateContext_->IASetVertexBuffers(0, 1, &vertexBuffer_, &stride, &offset);
-    immediateContext_->IASetIndexBuffer(indexBuffer_, DXGI_FORMAT_R16_UINT, 0);
-    immediateContext_->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+    stats_.updateTime = time;
+    stats_.worstUpdateTime = 0.0f;
+    for (int i = 0; i < OCEAN_STATS_WINDOW; ++i) {
+      stats_.worstUpdateTime = max(stats_.worstUpdateTime, frameTimes_[i]);
+    }
+  }
 
-    immediateContext_->VSSetShader(vertexShader_, NULL, 0);
+  void Ocean::Render(bool wireframe)
+  {
     immediateContext_->VSSetConstantBuffers(0, 1, &vsConstants_);
-
     immediateContext_->PSSetShader(wireframe ? wireframePixelShader_ : solidPixelShader_, NULL, 0);
     immediateContext_->PSSetConstantBuffers(0, 1, &vsConstants_);
     immediateContext_->PSSetShaderResources(0, 1, &skyReflectionSRV_);
     immediateContext_->PSSetSamplers(0, 1, &skyReflectionSampler_);
 
-    immediateContext_->DrawIndexed(numIndices_, 0, 0);
+    if (settings_.clipmapLevels || settings_.cdlodLevels || settings_.tileRadius)
+    {
+      heightmapTextures_.Bind();
+      if (settings_.clipmapLevels) {
+        clipmap_.Render();
+      }
+      else if (settings_.cdlodLevels) {
+        cdlod_.Render();
+      }
+      else {
+        tiles_.Render();
+      }
+      return;
+    }
+
+    // The ring's latest frame is drawn from until the next one is written
+    ID3D11Buffer* buffers[] = { gridBuffer_, settings_.uploadFrames ? uploadBackend_.GetBuffer() : vertexBuffer_ };
+    UINT strides[] = { sizeof(XMFLOAT2), streamStride_ };
+    UINT offsets[] = { 0, uploadRing_.GetOffset() };
+
+    immediateContext_->IASetInputLayout(vertexLayout_);
+    immediateContext_->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+    immediateContext_->IASetIndexBuffer(indexBuffer_, DXGI_FORMAT_R16_UINT, 0);
+    immediateContext_->IASetPrimitiveTopology(settings_.indexCacheSize ? D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST :
+      D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+
+    immediateContext_->VSSetShader(vertexShader_, NULL, 0);
+    if (streamConstants_) {
+      immediateContext_->VSSetConstantBuffers(1, 1, &streamConstants_);
+    }
+
+    // Its vertices are the same format as the heightmap mesh's, just in their own buffers
+    if (settings_.projectedGridSize)
+    {
+      projectedGrid_.Render();
+      return;
+    }
+
+    for (int i = 0; i < numChunks_; ++i) {
+      immediateContext_->DrawIndexed(chunks_[i].numIndices, chunks_[i].startIndex, chunks_[i].baseVertex);
+    }
   }
 }
@@ -0,0 +1,29 @@
+/*!
+  @file OceanKernels.cpp @date 18/10/26 @brief Simulation kernels specialised on the FFT size and instruction set.
+*/
+
+#include "OceanKernels.h"
+
+namespace OceanWaves
+{
+  // Each built in its own file, compiled for its instruction set
+  const OceanKernels& SelectOceanKernelsSse2(int dimX, int dimY);
+  const OceanKernels& SelectOceanKernelsSse42(int dimX, int dimY);
+  const OceanKernels& SelectOceanKernelsAvx2(int dimX, int dimY);
+  const OceanKernels& SelectOceanKernelsAvx512(int dimX, int dimY);
+
+  const OceanKernels& SelectOceanKernels(int dimX, int dimY, SimdPath path)
+  {
+    switch (path)
+    {
+    case SIMD_PATH_AVX512:
+      return SelectOceanKernelsAvx512(dimX, dimY);
+    case SIMD_PATH_AVX2:
+      return SelectOceanKernelsAvx2(dimX, dimY);
+    case SIMD_PATH_SSE42:
+      return SelectOceanKernelsSse42(dimX, dimY);
+    default:
+      return SelectOceanKernelsSse2(dimX, dimY);
+    }
+  }
+}
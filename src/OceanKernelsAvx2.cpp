@@ -0,0 +1,74 @@
+/*!
+  @file OceanKernelsAvx2.cpp @date 18/10/26 @brief Simulation kernels built for AVX2 and FMA.
+*/
+
+#include <immintrin.h>
+
+#include "OceanKernelsImpl.h"
+
+namespace OceanWaves
+{
+namespace
+{
+  /*
+    Eight lanes, with fused multiply-add.
+  */
+  struct IsaAvx2
+  {
+    typedef __m256 Float;
+    typedef __m256 Mask;
+    enum { WIDTH = 8 };
+
+    static Float Load(const float* p) { return _mm256_loadu_ps(p); }
+    static void Store(float* p, Float a) { _mm256_storeu_ps(p, a); }
+    static Float Set(float a) { return _mm256_set1_ps(a); }
+
+    static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+    static Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+    static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    static Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+    static Float MulAdd(Float a, Float b, Float c) { return _mm256_fmadd_ps(a, b, c); }
+    static Float Sqrt(Float a) { return _mm256_sqrt_ps(a); }
+    static Float Min(Float a, Float b) { return _mm256_min_ps(a, b); }
+    static Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+
+    static Float Round(Float a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static Float Pow2(Float n)
+    {
+      return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23));
+    }
+
+    static Mask Less(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static Float Select(Mask m, Float a, Float b) { return _mm256_blendv_ps(b, a, m); }
+
+    static Float SwapPairs(Float a) { return _mm256_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1)); }
+
+    // The unpacks work within each 128-bit half, so the halves are put back in order afterwards
+    static void StoreInterleaved(float* p, Float a, Float b)
+    {
+      Float lo = _mm256_unpacklo_ps(a, b);
+      Float hi = _mm256_unpackhi_ps(a, b);
+      _mm256_storeu_ps(p, _mm256_permute2f128_ps(lo, hi, 0x20));
+      _mm256_storeu_ps(p + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    static void LoadInterleaved(const float* p, Float* a, Float* b)
+    {
+      Float lo = _mm256_loadu_ps(p), hi = _mm256_loadu_ps(p + 8);
+      Float even = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+      Float odd = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+      *a = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(even), _MM_SHUFFLE(3, 1, 2, 0)));
+      *b = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(odd), _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+
+    static Float Gather(const float* base, Float index, int stride)
+    {
+      return _mm256_i32gather_ps(base, _mm256_mullo_epi32(_mm256_cvttps_epi32(index), _mm256_set1_epi32(stride)), 4);
+    }
+  };
+}
+
+  const OceanKernels& SelectOceanKernelsAvx2(int dimX, int dimY)
+  {
+    return SelectKernels<IsaAvx2>(dimX, dimY);
+  }
+}
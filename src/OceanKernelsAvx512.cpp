@@ -0,0 +1,75 @@
+/*!
+  @file OceanKernelsAvx512.cpp @date 18/10/26 @brief Simulation kernels built for AVX-512F.
+*/
+
+#include <immintrin.h>
+
+#include "OceanKernelsImpl.h"
+
+namespace OceanWaves
+{
+namespace
+{
+  /*
+    Sixteen lanes, comparisons giving a mask register rather than a vector.
+  */
+  struct IsaAvx512
+  {
+    typedef __m512 Float;
+    typedef __mmask16 Mask;
+    enum { WIDTH = 16 };
+
+    static Float Load(const float* p) { return _mm512_loadu_ps(p); }
+    static void Store(float* p, Float a) { _mm512_storeu_ps(p, a); }
+    static Float Set(float a) { return _mm512_set1_ps(a); }
+
+    static Float Add(Float a, Float b) { return _mm512_add_ps(a, b); }
+    static Float Sub(Float a, Float b) { return _mm512_sub_ps(a, b); }
+    static Float Mul(Float a, Float b) { return _mm512_mul_ps(a, b); }
+    static Float Div(Float a, Float b) { return _mm512_div_ps(a, b); }
+    static Float MulAdd(Float a, Float b, Float c) { return _mm512_fmadd_ps(a, b, c); }
+    static Float Sqrt(Float a) { return _mm512_sqrt_ps(a); }
+    static Float Min(Float a, Float b) { return _mm512_min_ps(a, b); }
+    static Float Max(Float a, Float b) { return _mm512_max_ps(a, b); }
+
+    static Float Round(Float a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static Float Pow2(Float n)
+    {
+      return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(_mm512_cvtps_epi32(n), _mm512_set1_epi32(127)), 23));
+    }
+
+    static Mask Less(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static Float Select(Mask m, Float a, Float b) { return _mm512_mask_blend_ps(m, b, a); }
+
+    static Float SwapPairs(Float a) { return _mm512_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1)); }
+
+    // The unpacks work within each 128-bit quarter; gather the quarters of each output, then put them in order
+    static void StoreInterleaved(float* p, Float a, Float b)
+    {
+      Float lo = _mm512_unpacklo_ps(a, b);
+      Float hi = _mm512_unpackhi_ps(a, b);
+      Float first = _mm512_shuffle_f32x4(lo, hi, _MM_SHUFFLE(1, 0, 1, 0));
+      Float second = _mm512_shuffle_f32x4(lo, hi, _MM_SHUFFLE(3, 2, 3, 2));
+      _mm512_storeu_ps(p, _mm512_shuffle_f32x4(first, first, _MM_SHUFFLE(3, 1, 2, 0)));
+      _mm512_storeu_ps(p + 16, _mm512_shuffle_f32x4(second, second, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    static void LoadInterleaved(const float* p, Float* a, Float* b)
+    {
+      Float lo = _mm512_loadu_ps(p), hi = _mm512_loadu_ps(p + 16);
+      __m512i even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+      *a = _mm512_permutex2var_ps(lo, even, hi);
+      *b = _mm512_permutex2var_ps(lo, _mm512_add_epi32(even, _mm512_set1_epi32(1)), hi);
+    }
+
+    static Float Gather(const float* base, Float index, int stride)
+    {
+      return _mm512_i32gather_ps(_mm512_mullo_epi32(_mm512_cvttps_epi32(index), _mm512_set1_epi32(stride)), base, 4);
+    }
+  };
+}
+
+  const OceanKernels& SelectOceanKernelsAvx512(int dimX, int dimY)
+  {
+    return SelectKernels<IsaAvx512>(dimX, dimY);
+  }
+}
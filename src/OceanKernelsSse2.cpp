@@ -0,0 +1,13 @@
+/*!
+  @file OceanKernelsSse2.cpp @date 18/10/26 @brief Simulation kernels built for SSE2.
+*/
+
+#include "OceanKernelsImpl.h"
+
+namespace OceanWaves
+{
+  const OceanKernels& SelectOceanKernelsSse2(int dimX, int dimY)
+  {
+    return SelectKernels<IsaSse2>(dimX, dimY);
+  }
+}
@@ -0,0 +1,27 @@
+/*!
+  @file OceanKernelsSse42.cpp @date 18/10/26 @brief Simulation kernels built for SSE4.2.
+*/
+
+#include <smmintrin.h>
+
+#include "OceanKernelsImpl.h"
+
+namespace OceanWaves
+{
+namespace
+{
+  /*
+    SSE2 with SSE4.1's rounding and blending, which replace a conversion round trip and three logic operations.
+  */
+  struct IsaSse42 : IsaSse2
+  {
+    static Float Round(Float a) { return _mm_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static Float Select(Mask m, Float a, Float b) { return _mm_blendv_ps(b, a, m); }
+  };
+}
+
+  const OceanKernels& SelectOceanKernelsSse42(int dimX, int dimY)
+  {
+    return SelectKernels<IsaSse42>(dimX, dimY);
+  }
+}
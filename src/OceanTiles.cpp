@@ -0,0 +1,191 @@
+/*!
+  @file OceanTiles.cpp @date 18/10/26 @brief Copies of the periodic ocean patch tiled out to the view distance.
+*/
+
+#include <assert.h>
+#include <math.h>
+#include <stdexcept>
+
+#include "OceanTiles.h"
+
+namespace OceanWaves
+{
+  OceanTiles::~OceanTiles()
+  {
+    SafeRelease(instanceBuffer_);
+    SafeRelease(indexBuffer_);
+    SafeRelease(vertexBuffer_);
+    SafeRelease(vertexLayout_);
+    SafeRelease(vertexShader_);
+
+    SafeDeleteArray(offsets_);
+    SafeDeleteArray(visible_);
+    SafeDeleteArray(centreZ_);
+    SafeDeleteArray(centreX_);
+    SafeDeleteArray(chunks_);
+  }
+
+  void OceanTiles::Init(ID3D11Device* device, int dimX, int dimY, float spacing, int radius, const OceanKernels* kernels)
+  {
+    // Get device and immediate context
+    device_ = device;
+    assert(device_);
+    device_->GetImmediateContext(&immediateContext_);
+    assert(immediateContext_);
+
+    if (radius < 0 || radius > OCEAN_TILES_MAX_RADIUS) {
+      throw std::runtime_error("The ocean can be tiled at most 32 tiles out from the camera");
+    }
+    radius_ = radius;
+    numTiles_ = (2 * radius_ + 1) * (2 * radius_ + 1);
+    periodX_ = dimX * spacing;
+    periodZ_ = dimY * spacing;
+    kernels_ = kernels;
+
+    centreX_ = new float[numTiles_];
+    centreZ_ = new float[numTiles_];
+    visible_ = new int[numTiles_];
+    offsets_ = new XMFLOAT2[numTiles_];
+
+    InitShaders();
+    InitBuffers(dimX, dimY, spacing);
+  }
+
+  HRESULT OceanTiles::InitShaders()
+  {
+    HRESULT hr;
+
+    // Create vertex shader, which shares the ocean's pixel shaders
+    ID3DBlob* vsBlob = NULL;
+    DXCALL(CompileShaderFromFile("assets/shaders/OceanVSPS.hlsl", "OceanTileVS", "vs_4_0", &vsBlob));
+    DXCALL(device_->CreateVertexShader(vsBlob->GetBufferPointer(), vsBlob->GetBufferSize(),
+      NULL, &vertexShader_));
+
+    // Create input layout, the patch's vertices in slot 0 and each tile's offset in slot 1
+    D3D11_INPUT_ELEMENT_DESC layout[] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "INSTANCE", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+    };
+    DXCALL(device_->CreateInputLayout(layout, ARRAYSIZE(layout), vsBlob->GetBufferPointer(),
+      vsBlob->GetBufferSize(), &vertexLayout_));
+
+    SafeRelease(vsBlob);
+
+    return S_OK;
+  }
+
+  HRESULT OceanTiles::InitBuffers(int dimX, int dimY, float spacing)
+  {
+    HRESULT hr;
+
+    // A vertex on every texel and on the first of the next copy, centred on the tile so that each samples a texel centre
+    int verticesX = dimX + 1, verticesZ = dimY + 1;
+    XMFLOAT2* vertices = new XMFLOAT2[verticesX * verticesZ];
+    for (int z = 0; z < verticesZ; ++z)
+    {
+      for (int x = 0; x < verticesX; ++x) {
+        vertices[x + z * verticesX] = XMFLOAT2((x - dimX / 2) * spacing, (z - dimY / 2) * spacing);
+      }
+    }
+
+    // Split into bands of rows as the heightmap mesh is, the strip over a shorter last band being a prefix of the first's
+    int chunkRows = min(verticesZ, 65536 / verticesX);
+    numChunks_ = (verticesZ - 2) / (chunkRows - 1) + 1;
+    chunks_ = new PatchChunk[numChunks_];
+    for (int i = 0; i < numChunks_; ++i)
+    {
+      int firstRow = i * (chunkRows - 1);
+      int numRows = min(chunkRows, verticesZ - firstRow);
+      chunks_[i].numIndices = (verticesX * 2) * (numRows - 1) + (numRows - 2);
+      chunks_[i].baseVertex = firstRow * verticesX;
+    }
+
+    // Create vertex buffer
+    D3D11_BUFFER_DESC bd;
+    ZeroMemory(&bd, sizeof(bd));
+    bd.ByteWidth = sizeof(XMFLOAT2) * verticesX * verticesZ;
+    bd.Usage = D3D11_USAGE_IMMUTABLE;
+    bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    bd.CPUAccessFlags = 0;
+    D3D11_SUBRESOURCE_DATA srd;
+    ZeroMemory(&srd, sizeof(srd));
+    srd.pSysMem = vertices;
+    hr = device_->CreateBuffer(&bd, &srd, &vertexBuffer_);
+    SafeDeleteArray(vertices);
+    DXCALL(hr);
+
+    // Create index buffer
+    WORD* indices = NULL;
+    unsigned int numIndices = GenerateIndices(&indices, verticesX, chunkRows);
+    bd.ByteWidth = sizeof(WORD) * numIndices;
+    bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+    srd.pSysMem = indices;
+    hr = device_->CreateBuffer(&bd, &srd, &indexBuffer_);
+    SafeDeleteArray(indices);
+    DXCALL(hr);
+
+    // Create instance buffer, only the visible tiles of which are uploaded
+    bd.ByteWidth = sizeof(XMFLOAT2) * numTiles_;
+    bd.Usage = D3D11_USAGE_DEFAULT;
+    bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    DXCALL(device_->CreateBuffer(&bd, NULL, &instanceBuffer_));
+
+    return S_OK;
+  }
+
+  float OceanTiles::Cull(const XMFLOAT3& camera, const Frustum& frustum, const XMFLOAT3& bounds)
+  {
+    timer_.Start();
+
+    // Tiles sit on a lattice of whole periods, so moving between them doesn't change what's drawn
+    float cameraTileX = floorf(camera.x / periodX_ + 0.5f), cameraTileZ = floorf(camera.z / periodZ_ + 0.5f);
+    int side = 2 * radius_ + 1;
+    for (int z = 0; z < side; ++z)
+    {
+      for (int x = 0; x < side; ++x)
+      {
+        centreX_[x + z * side] = (cameraTileX + x - radius_) * periodX_;
+        centreZ_[x + z * side] = (cameraTileZ + z - radius_) * periodZ_;
+      }
+    }
+
+    XMFLOAT4 planes[6];
+    for (int i = 0; i < 6; ++i) {
+      planes[i] = frustum.GetPlane(i);
+    }
+    XMFLOAT3 halfExtent(0.5f * periodX_ + bounds.x, bounds.y, 0.5f * periodZ_ + bounds.z);
+    numVisible_ = kernels_->cullTiles(planes, centreX_, centreZ_, numTiles_, halfExtent, visible_);
+
+    for (int i = 0; i < numVisible_; ++i) {
+      offsets_[i] = XMFLOAT2(centreX_[visible_[i]], centreZ_[visible_[i]]);
+    }
+
+    return timer_.Stop();
+  }
+
+  void OceanTiles::Render()
+  {
+    if (!numVisible_) {
+      return;
+    }
+
+    D3D11_BOX box = { 0, 0, 0, numVisible_ * sizeof(XMFLOAT2), 1, 1 };
+    immediateContext_->UpdateSubresource(instanceBuffer_, 0, &box, offsets_, 0, 0);
+
+    ID3D11Buffer* buffers[] = { vertexBuffer_, instanceBuffer_ };
+    UINT strides[] = { sizeof(XMFLOAT2), sizeof(XMFLOAT2) };
+    UINT offsets[] = { 0, 0 };
+
+    immediateContext_->IASetInputLayout(vertexLayout_);
+    immediateContext_->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+    immediateContext_->IASetIndexBuffer(indexBuffer_, DXGI_FORMAT_R16_UINT, 0);
+    immediateContext_->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+
+    immediateContext_->VSSetShader(vertexShader_, NULL, 0);
+
+    for (int i = 0; i < numChunks_; ++i) {
+      immediateContext_->DrawIndexedInstanced(chunks_[i].numIndices, numVisible_, 0, chunks_[i].baseVertex, 0);
+    }
+  }
+}
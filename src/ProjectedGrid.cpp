@@ -0,0 +1,224 @@
+/*!
+  @file ProjectedGrid.cpp @date 18/10/26 @brief A screen-space grid projected onto the ocean.
+*/
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdexcept>
+
+#include "ProjectedGrid.h"
+#include "Simd.h"
+#include "Utilities.h"
+
+namespace OceanWaves
+{
+  ProjectedGrid::~ProjectedGrid()
+  {
+    SafeRelease(indexBuffer_);
+    SafeRelease(sampleBuffer_);
+    SafeRelease(positionBuffer_);
+
+    SafeDeleteArray(samples_);
+    SafeDeleteArray(positions_);
+  }
+
+  void ProjectedGrid::Init(int size, float margin, const OceanKernels* kernels, ThreadPool* threadPool)
+  {
+    if (size < 2 || size > PROJECTED_GRID_MAX_SIZE) {
+      throw std::runtime_error("The projected grid must have between 2 and 256 vertices along a side");
+    }
+    size_ = size;
+    margin_ = margin;
+    kernels_ = kernels;
+    threadPool_ = threadPool;
+
+    positions_ = new XMFLOAT2[size_ * size_];
+    samples_ = new VertexDispNor[size_ * size_];
+    ZeroMemory(positions_, sizeof(XMFLOAT2) * size_ * size_);
+    ZeroMemory(samples_, sizeof(VertexDispNor) * size_ * size_);
+  }
+
+  HRESULT ProjectedGrid::InitBuffers(ID3D11Device* device)
+  {
+    HRESULT hr;
+
+    // Get device and immediate context
+    device_ = device;
+    assert(device_);
+    device_->GetImmediateContext(&immediateContext_);
+    assert(immediateContext_);
+
+    // Create the position and sample buffers, both rewritten every frame
+    D3D11_BUFFER_DESC bd;
+    ZeroMemory(&bd, sizeof(bd));
+    bd.ByteWidth = sizeof(XMFLOAT2) * size_ * size_;
+    bd.Usage = D3D11_USAGE_DEFAULT;
+    bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    bd.CPUAccessFlags = 0;
+    D3D11_SUBRESOURCE_DATA srd;
+    ZeroMemory(&srd, sizeof(srd));
+    srd.pSysMem = positions_;
+    DXCALL(device_->CreateBuffer(&bd, &srd, &positionBuffer_));
+
+    bd.ByteWidth = sizeof(VertexDispNor) * size_ * size_;
+    srd.pSysMem = samples_;
+    DXCALL(device_->CreateBuffer(&bd, &srd, &sampleBuffer_));
+
+    // Create index buffer, the screen grid's connectivity never changing
+    WORD* indices = NULL;
+    numIndices_ = GenerateIndices(&indices, size_, size_);
+    bd.ByteWidth = sizeof(WORD) * numIndices_;
+    bd.Usage = D3D11_USAGE_IMMUTABLE;
+    bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+    srd.pSysMem = indices;
+    hr = device_->CreateBuffer(&bd, &srd, &indexBuffer_);
+    SafeDeleteArray(indices);
+    DXCALL(hr);
+
+    return S_OK;
+  }
+
+  void ProjectedGrid::Project(const XMFLOAT4X4& inverseViewProjection, const VertexDispNor* heightmap, int dimX, int dimY,
+    const XMFLOAT2& origin, float spacing)
+  {
+    inverseViewProjection_ = inverseViewProjection;
+    heightmap_ = heightmap;
+    dimX_ = dimX;
+    dimY_ = dimY;
+    origin_ = origin;
+    spacing_ = spacing;
+
+    threadPool_->ParallelFor(size_, ProjectRow, this);
+  }
+
+  void ProjectedGrid::ProjectRow(void* grid, int row)
+  {
+    ProjectedGrid* g = static_cast<ProjectedGrid*>(grid);
+
+    // The rays' ends are linear in clip space x before the divide by w, so a row is its first ray and a step
+    float extent = 1.0f + g->margin_;
+    float step = 2.0f * extent / (g->size_ - 1);
+    float y = -extent + row * step;
+
+    XMMATRIX m = XMLoadFloat4x4(&g->inverseViewProjection_);
+    XMFLOAT4 nearStart, nearStep, farStart, farStep;
+    XMStoreFloat4(&nearStart, XMVector4Transform(XMVectorSet(-extent, y, 0.0f, 1.0f), m));
+    XMStoreFloat4(&farStart, XMVector4Transform(XMVectorSet(-extent, y, 1.0f, 1.0f), m));
+    XMStoreFloat4(&nearStep, XMVector4Transform(XMVectorSet(step, 0.0f, 0.0f, 0.0f), m));
+    farStep = nearStep;
+
+    XMFLOAT2* positions = g->positions_ + row * g->size_;
+    g->kernels_->projectRays(nearStart, nearStep, farStart, farStep, g->size_, positions);
+    g->kernels_->sampleHeightmap(g->heightmap_, g->dimX_, g->dimY_, g->origin_, g->spacing_, positions, g->size_,
+      g->samples_ + row * g->size_);
+  }
+
+  int ProjectedGrid::Upload()
+  {
+    immediateContext_->UpdateSubresource(positionBuffer_, 0, NULL, positions_, 0, 0);
+    immediateContext_->UpdateSubresource(sampleBuffer_, 0, NULL, samples_, 0, 0);
+
+    return (sizeof(XMFLOAT2) + sizeof(VertexDispNor)) * size_ * size_;
+  }
+
+  void ProjectedGrid::Render()
+  {
+    ID3D11Buffer* buffers[] = { positionBuffer_, sampleBuffer_ };
+    UINT strides[] = { sizeof(XMFLOAT2), sizeof(VertexDispNor) };
+    UINT offsets[] = { 0, 0 };
+
+    immediateContext_->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+    immediateContext_->IASetIndexBuffer(indexBuffer_, DXGI_FORMAT_R16_UINT, 0);
+    immediateContext_->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+    immediateContext_->DrawIndexed(numIndices_, 0, 0);
+  }
+
+  void WriteProjectedGridBenchmark(const char* fileName)
+  {
+    static const float heights[] = { 2.0f, 20.0f, 200.0f };
+    static const float pitches[] = { 5.0f, 30.0f, 89.0f }; // Degrees below the horizon
+    static const int sizes[] = { 64, 128, 256 };
+    const int dim = 256, repeats = 50;
+
+    FILE* file = OpenReport(fileName, "projected grid benchmark report",
+      "Path,Threads,Size,Height,Pitch,ProjectMs,BelowFarPlane,NearSpacing,FarSpacing");
+
+    // A heightmap of crossing swells, laid out as the ocean's
+    VertexDispNor* heightmap = new VertexDispNor[dim * dim];
+    for (int z = 0; z < dim; ++z)
+    {
+      for (int x = 0; x < dim; ++x)
+      {
+        float phase = 2.0f * XM_PI * (3.0f * x + 2.0f * z) / dim;
+        VertexDispNor& v = heightmap[x + z * dim];
+        v.Disp = XMFLOAT3(0.1f * cosf(phase), 0.5f * sinf(phase), 0.05f * cosf(phase));
+        v.Nor = XMFLOAT2(-0.1f * cosf(phase), -0.07f * cosf(phase));
+      }
+    }
+    XMFLOAT2 origin(-(dim - 1) * 0.1f, -(dim - 1) * 0.1f);
+
+    ThreadPool threadPool;
+    threadPool.Init(0);
+    XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 2000.0f);
+
+    // Every path up to the best one the CPU supports
+    SimdPath best = SelectSimdPath(SIMD_PATH_AUTO);
+    for (int path = SIMD_PATH_SSE2; path <= best; ++path)
+    {
+      const OceanKernels& kernels = SelectOceanKernels(dim, dim, static_cast<SimdPath>(path));
+
+      for (int s = 0; s < ARRAYSIZE(sizes); ++s)
+      {
+        ProjectedGrid grid;
+        grid.Init(sizes[s], 0.1f, &kernels, &threadPool);
+
+        for (int h = 0; h < ARRAYSIZE(heights); ++h)
+        {
+          for (int p = 0; p < ARRAYSIZE(pitches); ++p)
+          {
+            float pitch = XMConvertToRadians(pitches[p]);
+            XMVECTOR eye = XMVectorSet(0.0f, heights[h], 0.0f, 1.0f);
+            XMVECTOR at = XMVectorAdd(eye, XMVectorSet(0.0f, -sinf(pitch), cosf(pitch), 0.0f));
+            XMMATRIX viewProjection = XMMatrixMultiply(XMMatrixLookAtLH(eye, at, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)),
+              projection);
+            XMVECTOR determinant;
+            XMFLOAT4X4 inverseViewProjection;
+            XMStoreFloat4x4(&inverseViewProjection, XMMatrixInverse(&determinant, viewProjection));
+
+            Timer timer;
+            timer.Start();
+            for (int i = 0; i < repeats; ++i) {
+              grid.Project(inverseViewProjection, heightmap, dim, dim, origin, 0.2f);
+            }
+            float time = timer.Stop() / repeats;
+
+            // How much of the grid lands on the sea, and how far apart neighbours are at the bottom and middle of the screen
+            const XMFLOAT2* positions = grid.GetPositions();
+            int size = grid.GetSize(), belowFar = 0;
+            float farDistance = 2000.0f * 0.99f;
+            for (int i = 0; i < size * size; ++i)
+            {
+              float dx = positions[i].x, dz = positions[i].y;
+              if (dx * dx + heights[h] * heights[h] + dz * dz < farDistance * farDistance) {
+                ++belowFar;
+              }
+            }
+            int bottom = size / 2, middle = (size / 2) * size + size / 2;
+            float nearSpacing = sqrtf(powf(positions[bottom + 1].x - positions[bottom].x, 2.0f) +
+              powf(positions[bottom + 1].y - positions[bottom].y, 2.0f));
+            float farSpacing = sqrtf(powf(positions[middle + 1].x - positions[middle].x, 2.0f) +
+              powf(positions[middle + 1].y - positions[middle].y, 2.0f));
+
+            fprintf(file, "%s,%d,%d,%.0f,%.0f,%.4f,%.3f,%.4f,%.4f\n", GetSimdPathName(static_cast<SimdPath>(path)),
+              threadPool.GetNumThreads(), size, heights[h], pitches[p], time, belowFar / static_cast<float>(size * size),
+              nearSpacing, farSpacing);
+          }
+        }
+      }
+    }
+
+    fclose(file);
+    SafeDeleteArray(heightmap);
+  }
+}
@@ -0,0 +1,201 @@
+/*!
+  @file QueryBenchmark.cpp @date 18/10/26 @brief Throughput and accuracy of the batched ocean queries.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdexcept>
+#include <vector>
+
+#include "Ocean.h"
+#include "QueryBenchmark.h"
+#include "Utilities.h"
+
+namespace OceanWaves
+{
+  namespace
+  {
+    // A batch of height queries split into blocks over a thread pool, as Ocean::QueryHeightsParallel splits them
+    struct HeightBatch
+    {
+      const OceanKernels* kernels;
+      const VertexDispNor* heightmap;
+      int dim;
+      XMFLOAT2 origin;
+      float spacing;
+      const XMFLOAT2* positions;
+      int count;
+      float* heights;
+      XMFLOAT3* normals;
+    };
+
+    void QueryBlock(void* batch, int block)
+    {
+      const HeightBatch* b = static_cast<const HeightBatch*>(batch);
+
+      int first = block * OCEAN_QUERY_BLOCK;
+      int count = min(OCEAN_QUERY_BLOCK, b->count - first);
+      b->kernels->sampleHeights(b->heightmap, b->dim, b->dim, b->origin, b->spacing, b->positions + first, count,
+        b->heights + first, b->normals ? b->normals + first : NULL);
+    }
+  }
+
+  void WriteQueryBenchmark(const char* fileName)
+  {
+    static const int sizes[] = { 128, 256, 512 };
+    const int queries = 1 << 20, repeats = 8;
+    const float spacing = 0.2f;
+
+    FILE* file = OpenReport(fileName, "query benchmark report",
+      "Path,HeightmapSize,Normals,Threads,MQueriesPerSec,HeightError,NormalError");
+
+    ThreadPool threadPool;
+    threadPool.Init(0);
+
+    // Every path up to the best one the CPU supports
+    SimdPath best = SelectSimdPath(SIMD_PATH_AUTO);
+    for (int path = SIMD_PATH_SSE2; path <= best; ++path)
+    {
+      for (int s = 0; s < ARRAYSIZE(sizes); ++s)
+      {
+        int dim = sizes[s];
+        float period = dim * spacing;
+        const OceanKernels& kernels = SelectOceanKernels(dim, dim, static_cast<SimdPath>(path));
+
+        // Random vertices, whose normals are unit length, queried all over several copies of the patch
+        srand(0);
+        std::vector<VertexDispNor> heightmap(dim * dim);
+        for (int i = 0; i < dim * dim; ++i)
+        {
+          heightmap[i].Disp = XMFLOAT3(GaussRand(), GaussRand(), GaussRand());
+          heightmap[i].Nor = XMFLOAT2(0.3f * GaussRand(), 0.3f * GaussRand());
+        }
+        std::vector<XMFLOAT2> positions(queries);
+        for (int i = 0; i < queries; ++i) {
+          positions[i] = XMFLOAT2(period * (4.0f * rand() / RAND_MAX - 2.0f), period * (4.0f * rand() / RAND_MAX - 2.0f));
+        }
+
+        HeightBatch batch;
+        batch.kernels = &kernels;
+        batch.heightmap = &heightmap[0];
+        batch.dim = dim;
+        batch.origin = XMFLOAT2(-(dim - 1) * 0.5f * spacing, -(dim - 1) * 0.5f * spacing);
+        batch.spacing = spacing;
+        batch.positions = &positions[0];
+        batch.count = queries;
+
+        // Checked against the sampler the projected grid uses, which blends every component
+        std::vector<VertexDispNor> reference(queries);
+        kernels.sampleHeightmap(&heightmap[0], dim, dim, batch.origin, spacing, &positions[0], queries, &reference[0]);
+
+        std::vector<float> heights(queries);
+        std::vector<XMFLOAT3> normals(queries);
+        for (int withNormals = 0; withNormals < 2; ++withNormals)
+        {
+          batch.heights = &heights[0];
+          batch.normals = withNormals ? &normals[0] : NULL;
+
+          for (int parallel = 0; parallel < 2; ++parallel)
+          {
+            Timer timer;
+            timer.Start();
+            for (int r = 0; r < repeats; ++r)
+            {
+              if (parallel) {
+                threadPool.ParallelFor((queries + OCEAN_QUERY_BLOCK - 1) / OCEAN_QUERY_BLOCK, QueryBlock, &batch);
+              }
+              else {
+                kernels.sampleHeights(&heightmap[0], dim, dim, batch.origin, spacing, &positions[0], queries, batch.heights,
+                  batch.normals);
+              }
+            }
+            float time = timer.Stop();
+
+            float heightError = 0.0f, normalError = 0.0f;
+            for (int i = 0; i < queries; ++i)
+            {
+              heightError = max(heightError, fabsf(heights[i] - reference[i].Disp.y));
+              if (withNormals)
+              {
+                normalError = max(normalError, fabsf(normals[i].x - reference[i].Nor.x));
+                normalError = max(normalError, fabsf(normals[i].z - reference[i].Nor.y));
+              }
+            }
+
+            fprintf(file, "%s,%d,%d,%d,%.1f,%g,%g\n", GetSimdPathName(static_cast<SimdPath>(path)), dim, withNormals,
+              parallel ? threadPool.GetNumThreads() : 1, repeats * queries / (1000.0f * time), heightError, normalError);
+          }
+        }
+      }
+    }
+
+    fclose(file);
+  }
+
+  void WriteDisplacedQueryReport(const char* fileName)
+  {
+    static const float choppiness[] = { 0.5f, 1.0f, 1.5f };
+    static const int maxIterations[] = { 0, 1, 2, 4, 8 };
+    const int dim = 256, queries = 1 << 18, repeats = 8;
+    const float spacing = 0.2f, tolerance = 1e-4f;
+
+    FILE* file = OpenReport(fileName, "displaced query report",
+      "Path,Choppiness,MaxIterations,MQueriesPerSec,MeanIterations,Converged,MeanResidual,MaxResidual,HeightError");
+
+    float period = dim * spacing;
+    std::vector<XMFLOAT2> positions(queries);
+    srand(0);
+    for (int i = 0; i < queries; ++i) {
+      positions[i] = XMFLOAT2(period * (2.0f * rand() / RAND_MAX - 1.0f), period * (2.0f * rand() / RAND_MAX - 1.0f));
+    }
+
+    std::vector<float> heights(queries), residuals(queries), reference(queries);
+    std::vector<int> iterations(queries);
+
+    // Every path up to the best one the CPU supports
+    SimdPath best = SelectSimdPath(SIMD_PATH_AUTO);
+    for (int path = SIMD_PATH_SSE2; path <= best; ++path)
+    {
+      const OceanKernels& kernels = SelectOceanKernels(dim, dim, static_cast<SimdPath>(path));
+
+      for (int c = 0; c < ARRAYSIZE(choppiness); ++c)
+      {
+        WavePatch patch(dim, spacing, choppiness[c]);
+
+        // Checked against the heights found with as many steps as it takes
+        kernels.sampleDisplacedHeights(&patch.heightmap[0], dim, dim, patch.origin, spacing, &positions[0], queries, 64, 0.0f,
+          &reference[0], NULL, NULL, NULL);
+
+        for (int m = 0; m < ARRAYSIZE(maxIterations); ++m)
+        {
+          Timer timer;
+          timer.Start();
+          for (int r = 0; r < repeats; ++r)
+          {
+            kernels.sampleDisplacedHeights(&patch.heightmap[0], dim, dim, patch.origin, spacing, &positions[0], queries,
+              maxIterations[m], tolerance, &heights[0], NULL, &iterations[0], &residuals[0]);
+          }
+          float time = timer.Stop();
+
+          double totalIterations = 0.0, totalResidual = 0.0;
+          int converged = 0;
+          float maxResidual = 0.0f, heightError = 0.0f;
+          for (int i = 0; i < queries; ++i)
+          {
+            totalIterations += iterations[i];
+            totalResidual += residuals[i];
+            converged += (residuals[i] < tolerance);
+            maxResidual = max(maxResidual, residuals[i]);
+            heightError = max(heightError, fabsf(heights[i] - reference[i]));
+          }
+
+          fprintf(file, "%s,%.2f,%d,%.1f,%.3f,%.4f,%g,%g,%g\n", GetSimdPathName(static_cast<SimdPath>(path)), choppiness[c],
+            maxIterations[m], repeats * queries / (1000.0f * time), totalIterations / queries,
+            static_cast<float>(converged) / queries, totalResidual / queries, maxResidual, heightError);
+        }
+      }
+    }
+
+    fclose(file);
+  }
+}
@@ -0,0 +1,501 @@
+/*!
+  @file RayCaster.cpp @date 18/10/26 @brief Rays cast against the ocean surface.
+*/
+
+#include <float.h>
+#include <math.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <vector>
+
+#include "RayCaster.h"
+#include "Utilities.h"
+
+namespace OceanWaves
+{
+  namespace
+  {
+    const int STACK_SIZE = 4 * HEIGHT_PYRAMID_MAX_LEVELS;
+
+    // A cell of the pyramid waiting to be descended, where it lies on the plane and in the patch, and where the ray enters its
+    // bounds. Only the walk's cells need wrapping into the patch, their children's indices being in range of their own levels.
+    struct PendingCell
+    {
+      int level, x, z;
+      int patchX, patchZ;
+      float entry;
+    };
+
+    // A ray and the nearest hit along it so far
+    struct Ray
+    {
+      XMFLOAT3 origin, direction, inverse;
+      float first, last; // The span of the ray that can meet the surface, last shrinking to the nearest hit
+      int quadX, quadZ; // The quad hit, unwrapped, and where on it
+      int triangle;
+      float u, v;
+      int numTriangles;
+    };
+
+    int Wrap(int i, int n)
+    {
+      return (i % n + n) % n;
+    }
+
+    // Where the ray enters and leaves a box, if it does so within its span
+    bool IntersectBox(const Ray& ray, const XMFLOAT3& boxMin, const XMFLOAT3& boxMax, float* entry)
+    {
+      float tx0 = (boxMin.x - ray.origin.x) * ray.inverse.x, tx1 = (boxMax.x - ray.origin.x) * ray.inverse.x;
+      float ty0 = (boxMin.y - ray.origin.y) * ray.inverse.y, ty1 = (boxMax.y - ray.origin.y) * ray.inverse.y;
+      float tz0 = (boxMin.z - ray.origin.z) * ray.inverse.z, tz1 = (boxMax.z - ray.origin.z) * ray.inverse.z;
+      float enter = max(max(min(tx0, tx1), min(ty0, ty1)), max(min(tz0, tz1), ray.first));
+      float exit = min(min(max(tx0, tx1), max(ty0, ty1)), min(max(tz0, tz1), ray.last));
+      *entry = enter;
+      return enter <= exit;
+    }
+
+    // Moller-Trumbore, from either side, returning the distance and the barycentrics of p1 and p2
+    bool IntersectTriangle(const Ray& ray, const XMFLOAT3& p0, const XMFLOAT3& p1, const XMFLOAT3& p2, float* t, float* u,
+      float* v)
+    {
+      XMFLOAT3 e1(p1.x - p0.x, p1.y - p0.y, p1.z - p0.z), e2(p2.x - p0.x, p2.y - p0.y, p2.z - p0.z);
+      const XMFLOAT3& d = ray.direction;
+      XMFLOAT3 p(d.y * e2.z - d.z * e2.y, d.z * e2.x - d.x * e2.z, d.x * e2.y - d.y * e2.x);
+      float det = e1.x * p.x + e1.y * p.y + e1.z * p.z;
+      if (det == 0.0f) {
+        return false;
+      }
+
+      float inverseDet = 1.0f / det;
+      XMFLOAT3 s(ray.origin.x - p0.x, ray.origin.y - p0.y, ray.origin.z - p0.z);
+      *u = (s.x * p.x + s.y * p.y + s.z * p.z) * inverseDet;
+      if (*u < 0.0f || *u > 1.0f) {
+        return false;
+      }
+      XMFLOAT3 q(s.y * e1.z - s.z * e1.y, s.z * e1.x - s.x * e1.z, s.x * e1.y - s.y * e1.x);
+      *v = (d.x * q.x + d.y * q.y + d.z * q.z) * inverseDet;
+      if (*v < 0.0f || *u + *v > 1.0f) {
+        return false;
+      }
+      *t = (e2.x * q.x + e2.y * q.y + e2.z * q.z) * inverseDet;
+      return *t >= 0.0f;
+    }
+
+    // The corners of each of a quad's triangles, as (x, z) steps from its first vertex, split along either diagonal. A strip runs
+    // left to right along its even rows and back along its odd ones, so splits them along opposite diagonals, as a list does too.
+    const int QUAD_TRIANGLES[2][2][3][2] = {
+      { { { 0, 0 }, { 0, 1 }, { 1, 0 } }, { { 0, 1 }, { 1, 1 }, { 1, 0 } } },
+      { { { 1, 0 }, { 1, 1 }, { 0, 0 } }, { { 1, 1 }, { 0, 1 }, { 0, 0 } } }
+    };
+
+    // The heightmap's vertices, displaced, on the tiled plane, and their bounds
+    struct Surface
+    {
+      const VertexDispNor* heightmap;
+      int dimX, dimY;
+      XMFLOAT2 origin;
+      float spacing;
+      const BYTE* diagonals;
+      const HeightPyramid* pyramid;
+
+      // Which diagonal a row of quads, wrapped into the patch, is split along
+      int Diagonal(int patchZ) const
+      {
+        return diagonals ? diagonals[patchZ] : patchZ & 1;
+      }
+
+      const VertexDispNor& Vertex(int x, int z) const
+      {
+        return heightmap[Wrap(z, dimY) * dimX + Wrap(x, dimX)];
+      }
+
+      XMFLOAT3 Normal(int x, int z) const
+      {
+        const VertexDispNor& v = Vertex(x, z);
+        return XMFLOAT3(v.Nor.x, sqrtf(max(0.0f, 1.0f - v.Nor.x * v.Nor.x - v.Nor.y * v.Nor.y)), v.Nor.y);
+      }
+
+      // Test the ray against both triangles of a quad, keeping the nearer hit
+      void IntersectQuad(int x, int z, Ray* ray) const
+      {
+        // Its corners, the last column and row of vertices joining the first
+        int patchX = Wrap(x, dimX), patchZ = Wrap(z, dimY);
+        int columns[] = { patchX, patchX + 1 < dimX ? patchX + 1 : 0 };
+        int rows[] = { patchZ * dimX, (patchZ + 1 < dimY ? patchZ + 1 : 0) * dimX };
+        XMFLOAT3 corners[2][2];
+        for (int j = 0; j < 2; ++j)
+        {
+          for (int i = 0; i < 2; ++i)
+          {
+            const VertexDispNor& v = heightmap[rows[j] + columns[i]];
+            corners[j][i] = XMFLOAT3(origin.x + (x + i) * spacing + v.Disp.x, v.Disp.y, origin.y + (z + j) * spacing + v.Disp.z);
+          }
+        }
+
+        const int (*triangles)[3][2] = QUAD_TRIANGLES[Diagonal(patchZ)];
+        for (int i = 0; i < 2; ++i)
+        {
+          const int (*c)[2] = triangles[i];
+          float t, u, v;
+          if (IntersectTriangle(*ray, corners[c[0][1]][c[0][0]], corners[c[1][1]][c[1][0]], corners[c[2][1]][c[2][0]], &t, &u,
+            &v) && t < ray->last)
+          {
+            ray->last = t;
+            ray->quadX = x;
+            ray->quadZ = z;
+            ray->triangle = i;
+            ray->u = u;
+            ray->v = v;
+          }
+        }
+        ray->numTriangles += 2;
+      }
+
+      // A cell of a level of the pyramid, if the ray enters its bounds before the nearest hit so far. Its bounds are of the
+      // vertices it spans, which the displacement moves out from its quads.
+      bool IntersectCell(int level, int x, int z, int patchX, int patchZ, const Ray& ray, PendingCell* cell) const
+      {
+        const VertexDispNor* lowerCells, * upperCells;
+        pyramid->GetLevel(level, &lowerCells, &upperCells);
+        int i = patchZ * (dimX >> level) + patchX;
+        const VertexDispNor& lower = lowerCells[i], & upper = upperCells[i];
+        float width = spacing * (1 << level);
+        XMFLOAT3 boxMin(origin.x + x * width + lower.Disp.x, lower.Disp.y, origin.y + z * width + lower.Disp.z);
+        XMFLOAT3 boxMax(origin.x + (x + 1) * width + upper.Disp.x, upper.Disp.y, origin.y + (z + 1) * width + upper.Disp.z);
+
+        cell->level = level;
+        cell->x = x;
+        cell->z = z;
+        cell->patchX = patchX;
+        cell->patchZ = patchZ;
+        return IntersectBox(ray, boxMin, boxMax, &cell->entry);
+      }
+
+      // The hit's position and interpolated normal
+      void Resolve(const Ray& ray, RayHit* hit) const
+      {
+        const int (*c)[2] = QUAD_TRIANGLES[Diagonal(Wrap(ray.quadZ, dimY))][ray.triangle];
+        XMFLOAT3 n0 = Normal(ray.quadX + c[0][0], ray.quadZ + c[0][1]);
+        XMFLOAT3 n1 = Normal(ray.quadX + c[1][0], ray.quadZ + c[1][1]);
+        XMFLOAT3 n2 = Normal(ray.quadX + c[2][0], ray.quadZ + c[2][1]);
+        float w = 1.0f - ray.u - ray.v;
+        XMVECTOR n = XMVectorSet(w * n0.x + ray.u * n1.x + ray.v * n2.x, w * n0.y + ray.u * n1.y + ray.v * n2.y,
+          w * n0.z + ray.u * n1.z + ray.v * n2.z, 0.0f);
+        XMStoreFloat3(&hit->normal, XMVector3Normalize(n));
+        hit->distance = ray.last;
+      }
+    };
+
+    // The ray's span within the surface's height bounds and maxDistance, false if there's none
+    bool ClipRay(const VertexDispNor& lower, const VertexDispNor& upper, float maxDistance, Ray* ray)
+    {
+      ray->first = 0.0f;
+      ray->last = maxDistance;
+      if (ray->direction.y != 0.0f)
+      {
+        float t0 = (lower.Disp.y - ray->origin.y) / ray->direction.y, t1 = (upper.Disp.y - ray->origin.y) / ray->direction.y;
+        ray->first = max(ray->first, min(t0, t1));
+        ray->last = min(ray->last, max(t0, t1));
+      }
+      else if (ray->origin.y < lower.Disp.y || ray->origin.y > upper.Disp.y) {
+        return false;
+      }
+      return ray->first <= ray->last;
+    }
+
+    void InitRay(const XMFLOAT3& origin, const XMFLOAT3& direction, Ray* ray)
+    {
+      ray->origin = origin;
+      ray->direction = direction;
+
+      // A huge reciprocal rather than an infinite one, so a ray in the plane of a box's face doesn't make a NaN
+      const float* d = &direction.x;
+      float* inverse = &ray->inverse.x;
+      for (int i = 0; i < 3; ++i) {
+        inverse[i] = fabsf(d[i]) > 1e-20f ? 1.0f / d[i] : (d[i] < 0.0f ? -1e30f : 1e30f);
+      }
+      ray->triangle = -1;
+      ray->numTriangles = 0;
+    }
+  }
+
+  void RayCaster::Init(const HeightPyramid* pyramid, int dimX, int dimY, const XMFLOAT2& origin, float spacing,
+    const BYTE* diagonals, ThreadPool* threadPool)
+  {
+    if (pyramid->GetNumLevels() < 1) {
+      throw std::runtime_error("The ray caster's height pyramid must be initialised first");
+    }
+
+    pyramid_ = pyramid;
+    dimX_ = dimX;
+    dimY_ = dimY;
+    origin_ = origin;
+    spacing_ = spacing;
+    diagonals_ = diagonals;
+    threadPool_ = threadPool;
+  }
+
+  void RayCaster::Cast(const VertexDispNor* heightmap, const XMFLOAT3* origins, const XMFLOAT3* directions, int count,
+    float maxDistance, RayHit* hits)
+  {
+    heightmap_ = heightmap;
+    origins_ = origins;
+    directions_ = directions;
+    count_ = count;
+    maxDistance_ = maxDistance;
+    hits_ = hits;
+
+    int numBlocks = (count + RAY_BLOCK - 1) / RAY_BLOCK;
+    if (threadPool_) {
+      threadPool_->ParallelFor(numBlocks, CastBlock, this);
+    }
+    else
+    {
+      for (int block = 0; block < numBlocks; ++block) {
+        CastBlock(this, block);
+      }
+    }
+  }
+
+  void RayCaster::CastBlock(void* rayCaster, int block)
+  {
+    const RayCaster* r = static_cast<const RayCaster*>(rayCaster);
+
+    int first = block * RAY_BLOCK;
+    int last = min(first + RAY_BLOCK, r->count_);
+    for (int i = first; i < last; ++i) {
+      r->CastRay(r->heightmap_, r->origins_[i], r->directions_[i], r->maxDistance_, &r->hits_[i]);
+    }
+  }
+
+  int RayCaster::CastRay(const VertexDispNor* heightmap, const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance,
+    RayHit* hit) const
+  {
+    hit->position = XMFLOAT3(0.0f, 0.0f, 0.0f);
+    hit->normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+    hit->distance = FLT_MAX;
+
+    // Cast from the patch's own copy of the origin, so the cells stay near the patch however far out the ray starts
+    float periodX = dimX_ * spacing_, periodZ = dimY_ * spacing_;
+    float shiftX = periodX * floorf((origin.x - origin_.x) / periodX);
+    float shiftZ = periodZ * floorf((origin.z - origin_.y) / periodZ);
+
+    Ray ray;
+    InitRay(XMFLOAT3(origin.x - shiftX, origin.y, origin.z - shiftZ), direction, &ray);
+    VertexDispNor lower, upper;
+    pyramid_->GetBounds(&lower, &upper);
+    if (!ClipRay(lower, upper, maxDistance, &ray)) {
+      return 0;
+    }
+
+    Surface surface = { heightmap, dimX_, dimY_, origin_, spacing_, diagonals_, pyramid_ };
+    // Walked at the lowest level whose cells are as wide as the displacement, so a vertex can only be displaced into the cell
+    // the ray is crossing from the ring around it. The pyramid culls finer, and coarser cells bound the surface more loosely.
+    float reach = max(max(-lower.Disp.x, upper.Disp.x), max(-lower.Disp.z, upper.Disp.z));
+    int root = 0;
+    while (root < pyramid_->GetNumLevels() - 1 && spacing_ * (1 << root) < reach) {
+      ++root;
+    }
+    float cellSize = spacing_ * (1 << root);
+    int ring = static_cast<int>(ceilf(reach / cellSize));
+
+    // Walk the cells under the ray's path across the plane
+    float startX = ray.origin.x + ray.first * direction.x, startZ = ray.origin.z + ray.first * direction.z;
+    int cellX = static_cast<int>(floorf((startX - origin_.x) / cellSize));
+    int cellZ = static_cast<int>(floorf((startZ - origin_.y) / cellSize));
+    int stepX = direction.x < 0.0f ? -1 : 1, stepZ = direction.z < 0.0f ? -1 : 1;
+    float deltaX = fabsf(cellSize * ray.inverse.x), deltaZ = fabsf(cellSize * ray.inverse.z);
+    float nextX = ray.first + (origin_.x + (cellX + (stepX > 0)) * cellSize - startX) * ray.inverse.x;
+    float nextZ = ray.first + (origin_.y + (cellZ + (stepZ > 0)) * cellSize - startZ) * ray.inverse.z;
+
+    // The first cell brings in its whole ring, and each step the ring's leading edge, the rest having been descended already
+    int fromX = cellX - ring, toX = cellX + ring, fromZ = cellZ - ring, toZ = cellZ + ring;
+    PendingCell stack[STACK_SIZE];
+    for (;;)
+    {
+      for (int z = fromZ; z <= toZ; ++z)
+      {
+        for (int x = fromX; x <= toX; ++x)
+        {
+          int size = 0;
+          if (!surface.IntersectCell(root, x, z, Wrap(x, dimX_ >> root), Wrap(z, dimY_ >> root), ray, &stack[size])) {
+            continue;
+          }
+          ++size;
+
+          while (size)
+          {
+            const PendingCell cell = stack[--size];
+            if (cell.entry > ray.last) {
+              continue;
+            }
+            if (cell.level == 0)
+            {
+              surface.IntersectQuad(cell.x, cell.z, &ray);
+              continue;
+            }
+
+            // The children the ray enters, farthest first, so the nearest is descended next
+            PendingCell children[4];
+            int numChildren = 0;
+            for (int c = 0; c < 4; ++c)
+            {
+              PendingCell child;
+              int x = c & 1, z = c >> 1;
+              if (!surface.IntersectCell(cell.level - 1, 2 * cell.x + x, 2 * cell.z + z, 2 * cell.patchX + x, 2 * cell.patchZ + z,
+                ray, &child)) {
+                continue;
+              }
+              int i = numChildren++;
+              for (; i > 0 && children[i - 1].entry < child.entry; --i) {
+                children[i] = children[i - 1];
+              }
+              children[i] = child;
+            }
+            for (int c = 0; c < numChildren; ++c) {
+              stack[size++] = children[c];
+            }
+          }
+        }
+      }
+
+      // Every hit nearer than the next cell's entry has been found
+      float entry = min(nextX, nextZ);
+      if (entry > ray.last) {
+        break;
+      }
+      if (nextX < nextZ)
+      {
+        cellX += stepX;
+        nextX += deltaX;
+        fromX = toX = cellX + stepX * ring;
+        fromZ = cellZ - ring;
+        toZ = cellZ + ring;
+      }
+      else
+      {
+        cellZ += stepZ;
+        nextZ += deltaZ;
+        fromZ = toZ = cellZ + stepZ * ring;
+        fromX = cellX - ring;
+        toX = cellX + ring;
+      }
+    }
+
+    if (ray.triangle >= 0)
+    {
+      surface.Resolve(ray, hit);
+      hit->position = XMFLOAT3(origin.x + ray.last * direction.x, origin.y + ray.last * direction.y,
+        origin.z + ray.last * direction.z);
+    }
+    return ray.numTriangles;
+  }
+
+  void WriteRayReport(const char* fileName)
+  {
+    static const int sizes[] = { 32, 128, 512 };
+    static const char* kinds[] = { "Steep", "Grazing" };
+    const int numRays = 16384, numChecked = 128;
+    const float spacing = 0.2f, maxDistance = 1000.0f;
+
+    FILE* file = OpenReport(fileName, "ray report",
+      "Rays,HeightmapSize,Levels,Threads,MRaysPerSec,HitRate,MeanTriangles,Mismatches,MaxDistanceError");
+
+    ThreadPool threadPool;
+    threadPool.Init(0);
+
+    for (int s = 0; s < ARRAYSIZE(sizes); ++s)
+    {
+      int dim = sizes[s];
+      const OceanKernels& kernels = SelectOceanKernels(dim, dim, SelectSimdPath(SIMD_PATH_AUTO));
+
+      WavePatch patch(dim, spacing, 1.0f);
+      const VertexDispNor* heightmap = &patch.heightmap[0];
+      const XMFLOAT2& origin = patch.origin;
+      float period = patch.period;
+      HeightPyramid pyramid;
+      pyramid.Init(dim, dim, origin, spacing, &kernels, &threadPool);
+      pyramid.Build(heightmap);
+      VertexDispNor lower, upper;
+      pyramid.GetBounds(&lower, &upper);
+
+      for (int k = 0; k < ARRAYSIZE(kinds); ++k)
+      {
+        // Rays from anywhere over the patch, steep ones from well above the waves and grazing ones from just above them
+        srand(0);
+        std::vector<XMFLOAT3> origins(numRays), directions(numRays);
+        for (int i = 0; i < numRays; ++i)
+        {
+          float range = upper.Disp.y - lower.Disp.y;
+          float height = k ? upper.Disp.y + UniformRand(0.0f, 0.5f) * range : upper.Disp.y + UniformRand(1.0f, 10.0f);
+          origins[i] = XMFLOAT3(UniformRand(-0.5f, 0.5f) * period, height, UniformRand(-0.5f, 0.5f) * period);
+
+          float pitch = k ? UniformRand(0.02f, 0.1f) : UniformRand(0.3f, 1.0f), heading = UniformRand(0.0f, XM_2PI);
+          float across = sqrtf(1.0f - pitch * pitch);
+          directions[i] = XMFLOAT3(across * cosf(heading), -pitch, across * sinf(heading));
+        }
+
+        std::vector<RayHit> hits(numRays);
+        for (int t = 0; t < 2; ++t)
+        {
+          RayCaster rayCaster;
+          rayCaster.Init(&pyramid, dim, dim, origin, spacing, NULL, t ? &threadPool : NULL);
+
+          Timer timer;
+          timer.Start();
+          rayCaster.Cast(heightmap, &origins[0], &directions[0], numRays, maxDistance, &hits[0]);
+          float time = timer.Stop();
+
+          int numHits = 0, numTriangles = 0;
+          for (int i = 0; i < numRays; ++i)
+          {
+            numHits += hits[i].distance != FLT_MAX;
+            RayHit hit;
+            numTriangles += rayCaster.CastRay(heightmap, origins[i], directions[i], maxDistance, &hit);
+          }
+
+          // Against every triangle of the quads that can be displaced under the rays' spans, however the pyramid bounds them
+          int mismatches = 0;
+          float maxError = 0.0f;
+          float reach = max(max(-lower.Disp.x, upper.Disp.x), max(-lower.Disp.z, upper.Disp.z)) + spacing;
+          Surface surface = { heightmap, dim, dim, origin, spacing, NULL, NULL };
+          for (int i = 0; i < numChecked; ++i)
+          {
+            Ray ray;
+            InitRay(origins[i], directions[i], &ray);
+            bool hit = false;
+            if (ClipRay(lower, upper, maxDistance, &ray))
+            {
+              float x0 = origins[i].x + ray.first * directions[i].x, x1 = origins[i].x + ray.last * directions[i].x;
+              float z0 = origins[i].z + ray.first * directions[i].z, z1 = origins[i].z + ray.last * directions[i].z;
+              int quadX0 = static_cast<int>(floorf((min(x0, x1) - reach - origin.x) / spacing));
+              int quadX1 = static_cast<int>(floorf((max(x0, x1) + reach - origin.x) / spacing));
+              int quadZ0 = static_cast<int>(floorf((min(z0, z1) - reach - origin.y) / spacing));
+              int quadZ1 = static_cast<int>(floorf((max(z0, z1) + reach - origin.y) / spacing));
+              for (int z = quadZ0; z <= quadZ1; ++z)
+              {
+                for (int x = quadX0; x <= quadX1; ++x) {
+                  surface.IntersectQuad(x, z, &ray);
+                }
+              }
+              hit = ray.triangle >= 0;
+            }
+
+            if (hit != (hits[i].distance != FLT_MAX)) {
+              ++mismatches;
+            }
+            else if (hit) {
+              maxError = max(maxError, fabsf(hits[i].distance - ray.last));
+            }
+          }
+
+          fprintf(file, "%s,%d,%d,%d,%.3f,%.3f,%.1f,%d,%g\n", kinds[k], dim, pyramid.GetNumLevels(),
+            t ? threadPool.GetNumThreads() : 1, numRays / (1000.0f * time), numHits / static_cast<float>(numRays),
+            numTriangles / static_cast<float>(numRays), mismatches, maxError);
+        }
+      }
+    }
+
+    fclose(file);
+  }
+}
@@ -59,6 +59,12 @@ namespace OceanWaves
     *static_cast<bool*>(value) = cbd->wireframe;
   }
 
+  void TW_CALL GetSimdPathCB(void* value, void* clientData)
+  {
+    Ocean* ocean = static_cast<Ocean*>(clientData);
+    *static_cast<SimdPath*>(value) = ocean->GetSimdPath();
+  }
+
   Scene::Scene() : renderTargetView_(NULL), depthStencil_(NULL), depthStencilView_(NULL),
     rasterizerState_(NULL), paused_(false), exitCode_(1)
   {
@@ -247,13 +253,57 @@ namespace OceanWaves
     TwAddVarRW(settingsBar_, "Pause", TW_TYPE_BOOLCPP, &paused_, "group=Application key=p");
 
     // Ocean settings
-    TwAddVarRO(settingsBar_, "FFT size", TW_TYPE_INT32, &settings_.ocean_.fftDim, "group=Ocean");
-    TwAddVarRO(settingsBar_, "Heightmap size", TW_TYPE_INT32, &settings_.ocean_.heightmapDim, "group=Ocean");
-    TwAddVarRO(settingsBar_, "Patch length", TW_TYPE_INT32, &settings_.ocean_.patchLength, "group=Ocean");
+    TwAddVarRO(settingsBar_, "FFT width", TW_TYPE_INT32, &settings_.ocean_.fftDimX, "group=Ocean");
+    TwAddVarRO(settingsBar_, "FFT height", TW_TYPE_INT32, &settings_.ocean_.fftDimY, "group=Ocean");
+    TwAddVarRO(settingsBar_, "Heightmap width", TW_TYPE_INT32, &settings_.ocean_.heightmapDimX, "group=Ocean");
+    TwAddVarRO(settingsBar_, "Heightmap height", TW_TYPE_INT32, &settings_.ocean_.heightmapDimY, "group=Ocean");
+    TwAddVarRO(settingsBar_, "Patch length x", TW_TYPE_INT32, &settings_.ocean_.patchLengthX, "group=Ocean");
+    TwAddVarRO(settingsBar_, "Patch length z", TW_TYPE_INT32, &settings_.ocean_.patchLengthY, "group=Ocean");
     TwAddVarRO(settingsBar_, "Wind velocity", TW_TYPE_FLOAT, &settings_.ocean_.V, "group=Ocean");
     TwAddVarRO(settingsBar_, "Choppiness", TW_TYPE_FLOAT, &settings_.ocean_.choppiness, "group=Ocean");
     TwAddVarRO(settingsBar_, "Wave period", TW_TYPE_FLOAT, &settings_.ocean_.wavePeriod, "group=Ocean");
+    TwAddVarRO(settingsBar_, "Displacement interval", TW_TYPE_INT32, &settings_.ocean_.displacementInterval, "group=Ocean");
+    TwAddVarRO(settingsBar_, "Normal interval", TW_TYPE_INT32, &settings_.ocean_.normalInterval, "group=Ocean");
+    TwAddVarRO(settingsBar_, "Half precision", TW_TYPE_INT32, &settings_.ocean_.halfPrecision, "group=Ocean");
+    TwAddVarRO(settingsBar_, "Packed normal bits", TW_TYPE_INT32, &settings_.ocean_.packedVertices, "group=Ocean");
+    TwAddVarRO(settingsBar_, "Chunked mesh", TW_TYPE_INT32, &settings_.ocean_.chunkedMesh, "group=Ocean");
+    TwAddVarRO(settingsBar_, "Index cache size", TW_TYPE_INT32, &settings_.ocean_.indexCacheSize, "group=Ocean");
+    TwAddVarRO(settingsBar_, "Clipmap levels", TW_TYPE_INT32, &settings_.ocean_.clipmapLevels, "group=Ocean");
+    TwAddVarRO(settingsBar_, "Projected grid size", TW_TYPE_INT32, &settings_.ocean_.projectedGridSize, "group=Ocean");
+    TwAddVarRO(settingsBar_, "CDLOD levels", TW_TYPE_INT32, &settings_.ocean_.cdlodLevels, "group=Ocean");
+    TwAddVarRO(settingsBar_, "Tile radius", TW_TYPE_INT32, &settings_.ocean_.tileRadius, "group=Ocean");
+    TwAddVarRO(settingsBar_, "Upload frames", TW_TYPE_INT32, &settings_.ocean_.uploadFrames, "group=Ocean");
+    TwAddVarRO(settingsBar_, "Normal method", TW_TYPE_INT32, &settings_.ocean_.normalMethod, "group=Ocean");
+    TwAddVarRO(settingsBar_, "Mip filter", TW_TYPE_INT32, &settings_.ocean_.mipFilter, "group=Ocean");
+    TwAddVarRO(settingsBar_, "Half textures", TW_TYPE_INT32, &settings_.ocean_.halfTextures, "group=Ocean");
+    TwAddVarRO(settingsBar_, "LOD levels", TW_TYPE_INT32, &settings_.ocean_.lodLevels, "group=Ocean");
+    TwType simdPathType = TwDefineEnumFromString("SimdPath", "Auto,SSE2,SSE4.2,AVX2,AVX-512");
+    TwAddVarCB(settingsBar_, "SIMD path", simdPathType, NULL, GetSimdPathCB, &ocean_, "group=Ocean");
     TwAddVarRO(settingsBar_, "Wind direction", TW_TYPE_DIR3F, &windDir, "opened=true axisz=-z showval=false");
+
+    // Per-frame simulation statistics
+    const OceanFrameStats& stats = ocean_.GetFrameStats();
+    TwAddVarRO(settingsBar_, "Update time (ms)", TW_TYPE_FLOAT, &stats.updateTime, "group=Stats");
+    TwAddVarRO(settingsBar_, "Worst update time (ms)", TW_TYPE_FLOAT, &stats.worstUpdateTime, "group=Stats");
+    TwAddVarRO(settingsBar_, "Update skipped", TW_TYPE_BOOLCPP, &stats.updateSkipped, "group=Stats");
+    TwAddVarRO(settingsBar_, "Channels computed", TW_TYPE_INT32, &stats.channelsComputed, "group=Stats");
+    TwAddVarRO(settingsBar_, "Channels skipped", TW_TYPE_INT32, &stats.channelsSkipped, "group=Stats");
+    TwAddVarRO(settingsBar_, "Channels interpolated", TW_TYPE_INT32, &stats.channelsInterpolated, "group=Stats");
+    TwAddVarRO(settingsBar_, "FFTs executed", TW_TYPE_INT32, &stats.fftsExecuted, "group=Stats");
+    TwAddVarRO(settingsBar_, "FFTs skipped", TW_TYPE_INT32, &stats.fftsSkipped, "group=Stats");
+    TwAddVarRO(settingsBar_, "LOD time (ms)", TW_TYPE_FLOAT, &stats.lodTime, "group=Stats");
+    TwAddVarRO(settingsBar_, "Foam time (ms)", TW_TYPE_FLOAT, &stats.foamTime, "group=Stats");
+    TwAddVarRO(settingsBar_, "Mip time (ms)", TW_TYPE_FLOAT, &stats.mipTime, "group=Stats");
+    TwAddVarRO(settingsBar_, "Bounds time (ms)", TW_TYPE_FLOAT, &stats.boundsTime, "group=Stats");
+    TwAddVarRO(settingsBar_, "Velocity time (ms)", TW_TYPE_FLOAT, &stats.velocityTime, "group=Stats");
+    TwAddVarRO(settingsBar_, "Upload (bytes)", TW_TYPE_INT32, &stats.uploadBytes, "group=Stats");
+    TwAddVarRO(settingsBar_, "Tiles drawn", TW_TYPE_INT32, &stats.tilesDrawn, "group=Stats");
+    TwAddVarRO(settingsBar_, "Tiles culled", TW_TYPE_INT32, &stats.tilesCulled, "group=Stats");
+    TwAddVarRO(settingsBar_, "Upload stalls", TW_TYPE_INT32, &stats.uploadStalls, "group=Stats");
+    TwAddVarRO(settingsBar_, "Cull time (ms)", TW_TYPE_FLOAT, &stats.cullTime, "group=Stats");
+    TwAddVarRO(settingsBar_, "History (bytes)", TW_TYPE_INT32, &stats.historyBytes, "group=Stats");
+    TwAddVarRO(settingsBar_, "Stream position error (m)", TW_TYPE_FLOAT, &stats.streamPositionError, "group=Stats");
+    TwAddVarRO(settingsBar_, "Stream normal error (deg)", TW_TYPE_FLOAT, &stats.streamNormalError, "group=Stats");
   }
 
   HRESULT Scene::ResizeWindow()
@@ -322,8 +372,13 @@ namespace OceanWaves
     skybox_.Update(camera_.GetViewMatrix(), camera_.GetProjectionMatrix());
     ocean_.Update(world_, worldViewProjection_, camera_.GetPosition(), camera_.GetLookAt());
 
+    // OceanWireframePS ignores normals, so they aren't computed while the wireframe is drawn
+    ocean_.SetChannelDemand(OCEAN_CONSUMER_RENDER, cbd_.wireframe ? (OCEAN_CHANNEL_HEIGHT | OCEAN_CHANNEL_DISPLACEMENT) :
+      OCEAN_CHANNEL_SURFACE);
+
+    // The ocean skips the update itself when paused and nothing new is demanded
+    ocean_.UpdateHeightmap(t);
     if (!paused_) {
-      ocean_.UpdateHeightmap(t);
       t += 0.005f;
     }
   }
@@ -54,13 +54,22 @@ namespace OceanWaves
 
       ocean_.skyboxTexture = skyboxTexture_;
 
-      ocean_.fftDim = atoi(pNode->GetText());
+      ocean_.fftDimX = atoi(pNode->GetText());
       pNode = pNode->NextSiblingElement();
 
-      ocean_.heightmapDim = atoi(pNode->GetText());
+      ocean_.fftDimY = atoi(pNode->GetText());
       pNode = pNode->NextSiblingElement();
 
-      ocean_.patchLength = atoi(pNode->GetText());
+      ocean_.heightmapDimX = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.heightmapDimY = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.patchLengthX = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.patchLengthY = atoi(pNode->GetText());
       pNode = pNode->NextSiblingElement();
 
       ocean_.w = atof(pNode->GetText());
@@ -85,6 +94,54 @@ namespace OceanWaves
       pNode = pNode->NextSiblingElement();
 
       ocean_.wireframe = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.displacementInterval = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.normalInterval = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.halfPrecision = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.packedVertices = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.chunkedMesh = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.indexCacheSize = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.clipmapLevels = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.projectedGridSize = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.cdlodLevels = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.tileRadius = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.uploadFrames = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.normalMethod = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.mipFilter = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.halfTextures = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.lodLevels = atoi(pNode->GetText());
+      pNode = pNode->NextSiblingElement();
+
+      ocean_.simdPath = atoi(pNode->GetText());
     }
 
     // Camera
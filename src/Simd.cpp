@@ -0,0 +1,130 @@
+/*!
+  @file Simd.cpp @date 18/10/26 @brief CPU feature detection and SIMD helpers.
+*/
+
+#include <intrin.h>
+#include <immintrin.h>
+#include <stdexcept>
+#include <string>
+
+#include "Simd.h"
+
+namespace OceanWaves
+{
+  static CpuFeatures DetectCpuFeatures()
+  {
+    CpuFeatures features;
+    ZeroMemory(&features, sizeof(features));
+
+    int info[4];
+    __cpuid(info, 0);
+    int maxFunction = info[0];
+
+    if (maxFunction >= 1)
+    {
+      __cpuid(info, 1);
+      features.sse41 = (info[2] & (1 << 19)) != 0;
+      features.sse42 = (info[2] & (1 << 20)) != 0;
+
+      // AVX state must also be enabled by the OS (OSXSAVE, with XMM and YMM state in XCR0)
+      bool osxsave = (info[2] & (1 << 27)) != 0;
+      bool avxState = osxsave && (_xgetbv(0) & 0x6) == 0x6;
+      features.avx = avxState && (info[2] & (1 << 28)) != 0;
+      features.fma = features.avx && (info[2] & (1 << 12)) != 0;
+      features.f16c = features.avx && (info[2] & (1 << 29)) != 0;
+
+      if (maxFunction >= 7)
+      {
+        __cpuidex(info, 7, 0);
+        features.avx2 = features.avx && (info[1] & (1 << 5)) != 0;
+
+        // AVX-512 additionally needs the opmask and ZMM state enabled
+        bool avx512State = avxState && (_xgetbv(0) & 0xE6) == 0xE6;
+        features.avx512f = avx512State && (info[1] & (1 << 16)) != 0;
+      }
+    }
+    return features;
+  }
+
+  const CpuFeatures& GetCpuFeatures()
+  {
+    static const CpuFeatures features = DetectCpuFeatures();
+    return features;
+  }
+
+  static bool IsSimdPathSupported(SimdPath path)
+  {
+    const CpuFeatures& features = GetCpuFeatures();
+    switch (path)
+    {
+    case SIMD_PATH_SSE2:
+      return true;
+    case SIMD_PATH_SSE42:
+      return features.sse41 && features.sse42;
+    case SIMD_PATH_AVX2:
+      return features.avx2 && features.fma;
+    case SIMD_PATH_AVX512:
+      return features.avx512f;
+    default:
+      return false;
+    }
+  }
+
+  SimdPath SelectSimdPath(SimdPath requested)
+  {
+    if (requested != SIMD_PATH_AUTO)
+    {
+      if (requested < SIMD_PATH_AUTO || requested >= SIMD_NUM_PATHS || !IsSimdPathSupported(requested)) {
+        throw std::runtime_error(std::string("The CPU doesn't support the forced SIMD path ") + GetSimdPathName(requested));
+      }
+      return requested;
+    }
+
+    int path = SIMD_NUM_PATHS - 1;
+    while (!IsSimdPathSupported(static_cast<SimdPath>(path))) {
+      --path;
+    }
+    return static_cast<SimdPath>(path);
+  }
+
+  const char* GetSimdPathName(SimdPath path)
+  {
+    static const char* names[] = { "Auto", "SSE2", "SSE4.2", "AVX2", "AVX-512" };
+    return (path >= SIMD_PATH_AUTO && path < SIMD_NUM_PATHS) ? names[path] : "Unknown";
+  }
+
+  void FloatToHalf(HALF* dst, const float* src, unsigned int count)
+  {
+    unsigned int i = 0;
+    if (GetCpuFeatures().f16c)
+    {
+      for (; i + 8 <= count; i += 8)
+      {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+      }
+      _mm256_zeroupper();
+    }
+    // Scalar remainder, or everything on CPUs without F16C
+    for (; i < count; ++i) {
+      dst[i] = XMConvertFloatToHalf(src[i]);
+    }
+  }
+
+  void HalfToFloat(float* dst, const HALF* src, unsigned int count)
+  {
+    unsigned int i = 0;
+    if (GetCpuFeatures().f16c)
+    {
+      for (; i + 8 <= count; i += 8)
+      {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+      }
+      _mm256_zeroupper();
+    }
+    for (; i < count; ++i) {
+      dst[i] = XMConvertHalfToFloat(src[i]);
+    }
+  }
+}
@@ -0,0 +1,110 @@
+/*!
+  @file ThreadPool.cpp @date 18/10/26 @brief A pool of worker threads for data-parallel loops.
+*/
+
+#include <stdexcept>
+
+#include "ThreadPool.h"
+#include "Utilities.h"
+
+namespace OceanWaves
+{
+  ThreadPool::~ThreadPool()
+  {
+    if (threads_)
+    {
+      quit_ = true;
+      ReleaseSemaphore(startSemaphore_, numThreads_, NULL);
+      WaitForMultipleObjects(numThreads_, threads_, TRUE, INFINITE);
+      for (int i = 0; i < numThreads_; ++i) {
+        CloseHandle(threads_[i]);
+      }
+    }
+    if (doneEvent_) {
+      CloseHandle(doneEvent_);
+    }
+    if (startSemaphore_) {
+      CloseHandle(startSemaphore_);
+    }
+    SafeDeleteArray(threads_);
+  }
+
+  void ThreadPool::Init(int numThreads)
+  {
+    if (numThreads == 0)
+    {
+      SYSTEM_INFO info;
+      GetSystemInfo(&info);
+      numThreads = info.dwNumberOfProcessors - 1;
+    }
+    numThreads_ = max(0, numThreads);
+    if (numThreads_ == 0) {
+      return;
+    }
+
+    startSemaphore_ = CreateSemaphore(NULL, 0, numThreads_, NULL);
+    doneEvent_ = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!startSemaphore_ || !doneEvent_) {
+      throw std::runtime_error("Failed to create the thread pool's synchronisation objects");
+    }
+
+    threads_ = new HANDLE[numThreads_];
+    for (int i = 0; i < numThreads_; ++i)
+    {
+      threads_[i] = CreateThread(NULL, 0, WorkerProc, this, 0, NULL);
+      if (!threads_[i])
+      {
+        numThreads_ = i;
+        throw std::runtime_error("Failed to create a worker thread");
+      }
+    }
+  }
+
+  void ThreadPool::ParallelFor(int count, Task task, void* context)
+  {
+    // Not worth waking the workers for a single iteration
+    if (numThreads_ == 0 || count <= 1)
+    {
+      for (int i = 0; i < count; ++i) {
+        task(context, i);
+      }
+      return;
+    }
+
+    task_ = task;
+    context_ = context;
+    count_ = count;
+    next_ = 0;
+    activeWorkers_ = numThreads_;
+    ResetEvent(doneEvent_);
+
+    // Every worker is woken once per loop, whichever of them takes each wake up
+    ReleaseSemaphore(startSemaphore_, numThreads_, NULL);
+    RunTasks();
+    WaitForSingleObject(doneEvent_, INFINITE);
+  }
+
+  DWORD WINAPI ThreadPool::WorkerProc(LPVOID param)
+  {
+    ThreadPool* pool = static_cast<ThreadPool*>(param);
+
+    for (;;)
+    {
+      WaitForSingleObject(pool->startSemaphore_, INFINITE);
+      if (pool->quit_) {
+        return 0;
+      }
+      pool->RunTasks();
+      if (InterlockedDecrement(&pool->activeWorkers_) == 0) {
+        SetEvent(pool->doneEvent_);
+      }
+    }
+  }
+
+  void ThreadPool::RunTasks()
+  {
+    for (int i = InterlockedIncrement(&next_) - 1; i < count_; i = InterlockedIncrement(&next_) - 1) {
+      task_(context_, i);
+    }
+  }
+}
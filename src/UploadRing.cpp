@@ -0,0 +1,244 @@
+/*!
+  @file UploadRing.cpp @date 18/10/26 @brief A ring of per-frame regions of one buffer for streaming data to the GPU.
+*/
+
+#include <assert.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <vector>
+
+#include "UploadRing.h"
+#include "Utilities.h"
+
+namespace OceanWaves
+{
+  D3D11UploadBackend::~D3D11UploadBackend()
+  {
+    for (int i = 0; i < numFences_; ++i) {
+      SafeRelease(queries_[i]);
+    }
+    SafeRelease(buffer_);
+  }
+
+  HRESULT D3D11UploadBackend::Init(ID3D11Device* device, UINT bindFlags, unsigned int bytes, int numFences)
+  {
+    HRESULT hr;
+
+    // Get device and immediate context
+    device_ = device;
+    assert(device_);
+    device_->GetImmediateContext(&immediateContext_);
+    assert(immediateContext_);
+
+    // Create buffer, which the CPU writes and the GPU reads
+    D3D11_BUFFER_DESC bd;
+    ZeroMemory(&bd, sizeof(bd));
+    bd.ByteWidth = bytes;
+    bd.Usage = D3D11_USAGE_DYNAMIC;
+    bd.BindFlags = bindFlags;
+    bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    DXCALL(device_->CreateBuffer(&bd, NULL, &buffer_));
+
+    // Create an event query for each fence, which is signalled once the GPU has passed where it was ended
+    D3D11_QUERY_DESC qd;
+    ZeroMemory(&qd, sizeof(qd));
+    qd.Query = D3D11_QUERY_EVENT;
+    numFences_ = numFences;
+    for (int i = 0; i < numFences_; ++i) {
+      DXCALL(device_->CreateQuery(&qd, &queries_[i]));
+    }
+
+    return S_OK;
+  }
+
+  void* D3D11UploadBackend::Map(unsigned int offset, unsigned int size, bool discard)
+  {
+    // Buffers are mapped whole, so the region is only an offset into them
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (FAILED(immediateContext_->Map(buffer_, 0, discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped))) {
+      throw std::runtime_error("Failed to map the upload ring's buffer");
+    }
+    return static_cast<BYTE*>(mapped.pData) + offset;
+  }
+
+  void D3D11UploadBackend::Unmap()
+  {
+    immediateContext_->Unmap(buffer_, 0);
+  }
+
+  void D3D11UploadBackend::IssueFence(int fence)
+  {
+    immediateContext_->End(queries_[fence]);
+  }
+
+  bool D3D11UploadBackend::IsFenceComplete(int fence)
+  {
+    // Flushes, so a fence still in the command buffer gets to the GPU
+    return immediateContext_->GetData(queries_[fence], NULL, 0, 0) == S_OK;
+  }
+
+  void UploadRing::Init(UploadBackend* backend, unsigned int frameBytes, int numFrames)
+  {
+    if (numFrames < 1 || numFrames > UPLOAD_RING_MAX_FRAMES) {
+      throw std::runtime_error("The upload ring must have between 1 and 4 frames");
+    }
+    backend_ = backend;
+    frameBytes_ = frameBytes;
+    numFrames_ = numFrames;
+  }
+
+  void* UploadRing::Begin()
+  {
+    assert(writing_ < 0);
+
+    // Everything drawn from the last frame has been submitted by now
+    if (current_ >= 0)
+    {
+      backend_->IssueFence(current_);
+      fenced_[current_] = true;
+    }
+
+    writing_ = (current_ + 1) % numFrames_;
+    if (fenced_[writing_] && !backend_->IsFenceComplete(writing_))
+    {
+      ++stats_.stalls;
+      do {
+        ++stats_.waitPolls;
+      } while (!backend_->IsFenceComplete(writing_));
+    }
+
+    // Nothing has been drawn before the first frame, so the buffer can be thrown away then
+    return backend_->Map(writing_ * frameBytes_, frameBytes_, stats_.framesWritten == 0);
+  }
+
+  void UploadRing::End()
+  {
+    assert(writing_ >= 0);
+
+    backend_->Unmap();
+    current_ = writing_;
+    writing_ = -1;
+    ++stats_.framesWritten;
+  }
+
+  namespace
+  {
+    /*
+      A GPU that runs a fixed number of fences behind the CPU, catching up a fence each time the CPU
+      polls one it hasn't reached. Draws run as late as they can, just before the next fence, and
+      check the region they read still holds what it did when they were submitted.
+    */
+    class MockUploadBackend : public UploadBackend
+    {
+      struct Draw
+      {
+        int fence; // The last fence issued before it
+        unsigned int offset, size, value;
+      };
+
+    public:
+      MockUploadBackend(unsigned int bytes, int latency) : memory_(bytes / sizeof(unsigned int)), latency_(latency), issued_(0),
+        completed_(0), corruptReads_(0)
+      {
+        ZeroMemory(fenceValues_, sizeof(fenceValues_));
+      }
+
+      void* Map(unsigned int offset, unsigned int size, bool discard) { return reinterpret_cast<BYTE*>(&memory_[0]) + offset; }
+      void Unmap() {}
+
+      void IssueFence(int fence)
+      {
+        fenceValues_[fence] = ++issued_;
+        Advance(issued_ - latency_);
+      }
+
+      bool IsFenceComplete(int fence)
+      {
+        if (fenceValues_[fence] <= completed_) {
+          return true;
+        }
+        Advance(completed_ + 1);
+        return false;
+      }
+
+      //! Draw from a region filled with value
+      void Submit(unsigned int offset, unsigned int size, unsigned int value)
+      {
+        Draw draw = { issued_, offset, size, value };
+        draws_.push_back(draw);
+      }
+
+      //! Run everything submitted
+      void Finish() { Advance(issued_ + 1); }
+
+      int GetCorruptReads() const { return corruptReads_; }
+
+    private:
+      void Advance(int fence)
+      {
+        for (; completed_ < fence; ++completed_)
+        {
+          size_t run = 0;
+          for (; run < draws_.size() && draws_[run].fence <= completed_; ++run)
+          {
+            const Draw& draw = draws_[run];
+            for (unsigned int i = draw.offset / sizeof(unsigned int); i < (draw.offset + draw.size) / sizeof(unsigned int); ++i)
+            {
+              if (memory_[i] != draw.value)
+              {
+                ++corruptReads_;
+                break;
+              }
+            }
+          }
+          draws_.erase(draws_.begin(), draws_.begin() + run);
+        }
+      }
+
+    private:
+      std::vector<unsigned int> memory_;
+      std::vector<Draw> draws_;
+      int latency_, issued_, completed_;
+      int fenceValues_[UPLOAD_RING_MAX_FRAMES];
+      int corruptReads_;
+    };
+  }
+
+  void WriteUploadRingReport(const char* fileName)
+  {
+    const int frames = 600, maxLatency = 4;
+    const unsigned int frameBytes = 4096;
+
+    FILE* file = OpenReport(fileName, "upload ring report", "RingFrames,GpuLatency,FramesWritten,Stalls,WaitPolls,CorruptReads");
+
+    for (int numFrames = 1; numFrames <= UPLOAD_RING_MAX_FRAMES; ++numFrames)
+    {
+      for (int latency = 0; latency <= maxLatency; ++latency)
+      {
+        MockUploadBackend backend(frameBytes * numFrames, latency);
+        UploadRing ring;
+        ring.Init(&backend, frameBytes, numFrames);
+
+        // Each frame fills its region with its number and is drawn from twice before the next, as when paused
+        for (unsigned int frame = 1; frame <= frames; ++frame)
+        {
+          unsigned int* region = static_cast<unsigned int*>(ring.Begin());
+          for (unsigned int i = 0; i < frameBytes / sizeof(unsigned int); ++i) {
+            region[i] = frame;
+          }
+          ring.End();
+
+          backend.Submit(ring.GetOffset(), frameBytes, frame);
+          backend.Submit(ring.GetOffset(), frameBytes, frame);
+        }
+        backend.Finish();
+
+        const UploadRingStats& stats = ring.GetStats();
+        fprintf(file, "%d,%d,%d,%d,%d,%d\n", numFrames, latency, stats.framesWritten, stats.stalls, stats.waitPolls,
+          backend.GetCorruptReads());
+      }
+    }
+
+    fclose(file);
+  }
+}
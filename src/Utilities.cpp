@@ -2,6 +2,9 @@
   @file Utilities.cpp @author Joel Barrett @date 01/01/12 @brief Utility functions.
 */
 
+#include <cstdio>
+#include <stdexcept>
+#include <string>
 #include <windows.h>
 #include <d3dcompiler.h>
 #include <D3Dcommon.h>
@@ -11,6 +14,24 @@
 
 namespace OceanWaves
 {
+  Timer::Timer()
+  {
+    QueryPerformanceFrequency(&frequency_);
+    start_.QuadPart = 0;
+  }
+
+  void Timer::Start()
+  {
+    QueryPerformanceCounter(&start_);
+  }
+
+  float Timer::Stop()
+  {
+    LARGE_INTEGER end;
+    QueryPerformanceCounter(&end);
+    return static_cast<float>(end.QuadPart - start_.QuadPart) * 1000.0f / frequency_.QuadPart;
+  }
+
   float GaussRand()
   {
     // Uniform random numbers
@@ -24,66 +45,147 @@ namespace OceanWaves
     return sqrtf(-2.0f * logf(u1)) * cosf(XM_2PI * u2);
   }
 
-  unsigned int GenerateVertices(VertexPosNor** vertices, int dimensions, float stride)
+  float UniformRand(float lower, float upper)
   {
-    unsigned int numVertices = dimensions * dimensions;
-    *vertices = new VertexPosNor[numVertices];
-
-    float halfDim = (dimensions - 1.0f) / 2.0f;
-
-    for (int z = 0; z < dimensions; ++z)
-    {
-      for (int x = 0; x < dimensions; ++x)
-      {
-        (*vertices)[z * dimensions + x] = VertexPosNor((x - halfDim) * stride, 0.0f,
-          (z - halfDim) * stride, 0.0f, 1.0f, 0.0f);
-      }
-    }
-    return numVertices;
+    return lower + (upper - lower) * rand() / RAND_MAX;
   }
 
-  unsigned int GenerateIndices(WORD** indices, int dimensions)
+  unsigned int GenerateIndices(WORD** indices, int dimensionsX, int dimensionsZ)
   {
-    unsigned int numIndices = (dimensions * 2) * (dimensions - 1) + (dimensions - 2);
+    unsigned int numIndices = (dimensionsX * 2) * (dimensionsZ - 1) + (dimensionsZ - 2);
     *indices = new WORD[numIndices];
 
     unsigned int index = 0;
-    for (int z = 0; z < dimensions - 1; ++z)
+    for (int z = 0; z < dimensionsZ - 1; ++z)
     {
       // Even rows move left to right, odd rows move right to left
       if (z % 2 == 0)
       {
         // Even row
         int x;
-        for (x = 0; x < dimensions; ++x)
+        for (x = 0; x < dimensionsX; ++x)
         {
-          (*indices)[index++] = x + (z * dimensions);
-          (*indices)[index++] = x + (z * dimensions) + dimensions;
+          (*indices)[index++] = x + (z * dimensionsX);
+          (*indices)[index++] = x + (z * dimensionsX) + dimensionsX;
         }
         // Insert degenerate vertex if this isn't the last row
-        if (z != dimensions - 2)
+        if (z != dimensionsZ - 2)
         {
-          (*indices)[index++] = --x + (z * dimensions);
+          (*indices)[index++] = --x + (z * dimensionsX);
         }
       }
       else {
         // Odd row
         int x;
-        for (x = dimensions - 1; x >= 0; --x)
+        for (x = dimensionsX - 1; x >= 0; --x)
         {
-          (*indices)[index++] = x + (z * dimensions);
-          (*indices)[index++] = x + (z * dimensions) + dimensions;
+          (*indices)[index++] = x + (z * dimensionsX);
+          (*indices)[index++] = x + (z * dimensionsX) + dimensionsX;
         }
         // Insert degenerate vertex if this isn't the last row
-        if (z != dimensions - 2)
+        if (z != dimensionsZ - 2)
+        {
+          (*indices)[index++] = ++x + (z * dimensionsX);
+        }
+      }
+    }
+    return numIndices;
+  }
+
+  unsigned int GenerateListIndices(WORD** indices, int dimensionsX, int dimensionsZ, int cacheSize)
+  {
+    unsigned int numIndices = 6 * (dimensionsX - 1) * (dimensionsZ - 1);
+    *indices = new WORD[numIndices];
+
+    // A stripe's row and the one below it have to fit in the cache together
+    int stripeWidth = max(2, cacheSize / 2);
+
+    unsigned int index = 0;
+    for (int left = 0; left < dimensionsX - 1; left += stripeWidth - 1)
+    {
+      int right = min(left + stripeWidth - 1, dimensionsX - 1);
+      for (int z = 0; z < dimensionsZ - 1; ++z)
+      {
+        for (int x = left; x < right; ++x)
         {
-          (*indices)[index++] = ++x + (z * dimensions);
+          // The same two triangles, wound the same way, as GenerateIndices' strip makes of the quad. The strip runs left
+          // to right along even rows and back along odd ones, which splits their quads along opposite diagonals.
+          WORD topLeft = x + z * dimensionsX;
+          WORD bottomLeft = topLeft + dimensionsX;
+          if (z % 2 == 0)
+          {
+            (*indices)[index++] = topLeft;
+            (*indices)[index++] = bottomLeft;
+            (*indices)[index++] = topLeft + 1;
+            (*indices)[index++] = topLeft + 1;
+            (*indices)[index++] = bottomLeft;
+            (*indices)[index++] = bottomLeft + 1;
+          }
+          else
+          {
+            (*indices)[index++] = bottomLeft + 1;
+            (*indices)[index++] = topLeft + 1;
+            (*indices)[index++] = topLeft;
+            (*indices)[index++] = bottomLeft + 1;
+            (*indices)[index++] = topLeft;
+            (*indices)[index++] = bottomLeft;
+          }
         }
       }
     }
     return numIndices;
   }
 
+  void GenerateWaveHeightmap(int dim, float spacing, const XMFLOAT2& origin, float choppiness, VertexDispNor* heightmap)
+  {
+    static const int waves[][2] = { { 3, 1 }, { -2, 5 }, { 7, -4 }, { 11, 9 } };
+    static const float steepness[] = { 0.35f, 0.2f, 0.15f, 0.1f };
+
+    float period = dim * spacing;
+    for (int z = 0; z < dim; ++z)
+    {
+      for (int x = 0; x < dim; ++x)
+      {
+        float px = origin.x + x * spacing, pz = origin.y + z * spacing;
+        float slopeX = 0.0f, slopeZ = 0.0f;
+        VertexDispNor& v = heightmap[z * dim + x];
+        v.Disp = XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+        for (int w = 0; w < ARRAYSIZE(waves); ++w)
+        {
+          float kx = XM_2PI * waves[w][0] / period, kz = XM_2PI * waves[w][1] / period;
+          float k = sqrtf(kx * kx + kz * kz), amplitude = steepness[w] / k;
+          float phase = kx * px + kz * pz + w;
+          v.Disp.x -= choppiness * amplitude * (kx / k) * sinf(phase);
+          v.Disp.y += amplitude * cosf(phase);
+          v.Disp.z -= choppiness * amplitude * (kz / k) * sinf(phase);
+          slopeX -= amplitude * kx * sinf(phase);
+          slopeZ -= amplitude * kz * sinf(phase);
+        }
+
+        // The normal of the undisplaced heightfield
+        float inverseLength = 1.0f / sqrtf(1.0f + slopeX * slopeX + slopeZ * slopeZ);
+        v.Nor = XMFLOAT2(-slopeX * inverseLength, -slopeZ * inverseLength);
+      }
+    }
+  }
+
+  WavePatch::WavePatch(int dim, float spacing, float choppiness) : dim(dim), spacing(spacing), period(dim * spacing),
+    origin(-(dim - 1) * 0.5f * spacing, -(dim - 1) * 0.5f * spacing), heightmap(dim * dim)
+  {
+    GenerateWaveHeightmap(dim, spacing, origin, choppiness, &heightmap[0]);
+  }
+
+  FILE* OpenReport(const char* fileName, const char* report, const char* header)
+  {
+    FILE* file = NULL;
+    if (fopen_s(&file, fileName, "w") != 0) {
+      throw std::runtime_error(std::string("Failed to open the ") + report);
+    }
+    fprintf(file, "%s\n", header);
+    return file;
+  }
+
   HRESULT CompileShaderFromFile(char* fileName, LPCSTR entryPoint, LPCSTR shaderModel, ID3DBlob** blob)
   {
     HRESULT hr;
@@ -0,0 +1,113 @@
+/*!
+  @file VelocityBenchmark.cpp @date 18/10/26 @brief Cost and accuracy of the surface's spectral velocity and acceleration.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdexcept>
+#include <vector>
+
+#include "OceanKernels.h"
+#include "Utilities.h"
+#include "VelocityBenchmark.h"
+
+namespace OceanWaves
+{
+  namespace
+  {
+    // The largest difference between two spectra, relative to the largest magnitude of the first
+    float RelativeError(const std::vector<XMFLOAT2>& exact, const std::vector<XMFLOAT2>& estimate)
+    {
+      float largest = 0.0f, error = 0.0f;
+      for (size_t i = 0; i < exact.size(); ++i)
+      {
+        largest = max(largest, sqrtf(exact[i].x * exact[i].x + exact[i].y * exact[i].y));
+        float dx = exact[i].x - estimate[i].x, dy = exact[i].y - estimate[i].y;
+        error = max(error, sqrtf(dx * dx + dy * dy));
+      }
+      return (largest > 0.0f) ? error / largest : 0.0f;
+    }
+  }
+
+  void WriteVelocityBenchmark(const char* fileName)
+  {
+    static const int sizes[] = { 64, 128, 256, 512 };
+    const int frames = 64;
+    const float patchLength = 50.0f, windSpeed = 10.0f, gravity = 9.81f, time = 10.0f, dt = 1e-2f;
+
+    FILE* file = OpenReport(fileName, "velocity benchmark report",
+      "Path,FFTSize,EvolveMs,EvolveWithRatesMs,VelocityError,AccelerationError");
+
+    SpectrumParams params;
+    params.A = 0.0005f;
+    params.windX = cosf(XM_PIDIV4);
+    params.windZ = sinf(XM_PIDIV4);
+    params.S = 1.0f;
+    params.L = windSpeed * windSpeed / gravity;
+    params.l = params.L / 1000.0f;
+    params.gravity = gravity;
+
+    // Every path up to the best one the CPU supports
+    SimdPath best = SelectSimdPath(SIMD_PATH_AUTO);
+    for (int path = SIMD_PATH_SSE2; path <= best; ++path)
+    {
+      for (int s = 0; s < ARRAYSIZE(sizes); ++s)
+      {
+        int dim = sizes[s], spectrumDimX = dim / 2 + 1, fftSize = dim * dim, spectrumSize = spectrumDimX * dim;
+        const OceanKernels& kernels = SelectOceanKernels(dim, dim, static_cast<SimdPath>(path));
+
+        KernelGrid grid;
+        grid.dimX = grid.dimY = dim;
+        grid.spectrumDimX = spectrumDimX;
+        grid.patchLengthX = grid.patchLengthY = patchLength;
+
+        srand(0);
+        std::vector<XMFLOAT2> gauss(fftSize), h0k(fftSize);
+        for (int i = 0; i < fftSize; ++i) {
+          gauss[i] = XMFLOAT2(GaussRand(), GaussRand());
+        }
+        std::vector<float> wk(spectrumSize), terms(4 * spectrumSize);
+        kernels.initSpectrum(grid, params, &gauss[0], &h0k[0], &wk[0], &terms[0]);
+
+        std::vector<XMFLOAT2> h(spectrumSize), velocity(spectrumSize), acceleration(spectrumSize);
+        fftwf_complex* hkt = reinterpret_cast<fftwf_complex*>(&h[0]);
+        fftwf_complex* vkt = reinterpret_cast<fftwf_complex*>(&velocity[0]);
+        fftwf_complex* akt = reinterpret_cast<fftwf_complex*>(&acceleration[0]);
+
+        // What the derivatives add to the evolution
+        Timer timer;
+        timer.Start();
+        for (int frame = 0; frame < frames; ++frame) {
+          kernels.evolveSpectrum(grid, &terms[0], &wk[0], 0.25f * frame, 1.0f, hkt, NULL, NULL);
+        }
+        float evolveTime = timer.Stop();
+
+        timer.Start();
+        for (int frame = 0; frame < frames; ++frame) {
+          kernels.evolveSpectrum(grid, &terms[0], &wk[0], 0.25f * frame, 1.0f, hkt, vkt, akt);
+        }
+        float ratesTime = timer.Stop();
+
+        // Central differences of the spectrum and of its velocity, either side of the same time
+        std::vector<XMFLOAT2> before(spectrumSize), after(spectrumSize), velocityBefore(spectrumSize), velocityAfter(spectrumSize);
+        std::vector<XMFLOAT2> differenced(spectrumSize), differencedVelocity(spectrumSize);
+        kernels.evolveSpectrum(grid, &terms[0], &wk[0], time - dt, 1.0f, reinterpret_cast<fftwf_complex*>(&before[0]),
+          reinterpret_cast<fftwf_complex*>(&velocityBefore[0]), NULL);
+        kernels.evolveSpectrum(grid, &terms[0], &wk[0], time + dt, 1.0f, reinterpret_cast<fftwf_complex*>(&after[0]),
+          reinterpret_cast<fftwf_complex*>(&velocityAfter[0]), NULL);
+        kernels.evolveSpectrum(grid, &terms[0], &wk[0], time, 1.0f, hkt, vkt, akt);
+        for (int i = 0; i < spectrumSize; ++i)
+        {
+          differenced[i] = XMFLOAT2((after[i].x - before[i].x) / (2.0f * dt), (after[i].y - before[i].y) / (2.0f * dt));
+          differencedVelocity[i] = XMFLOAT2((velocityAfter[i].x - velocityBefore[i].x) / (2.0f * dt),
+            (velocityAfter[i].y - velocityBefore[i].y) / (2.0f * dt));
+        }
+
+        fprintf(file, "%s,%d,%.4f,%.4f,%g,%g\n", GetSimdPathName(static_cast<SimdPath>(path)), dim, evolveTime / frames,
+          ratesTime / frames, RelativeError(velocity, differenced), RelativeError(acceleration, differencedVelocity));
+      }
+    }
+
+    fclose(file);
+  }
+}